@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "deep_learning/SimplePerceptron.hpp"
+
+namespace mywheels {
+  // 多数のサンプルの 2 値の特徴量を，特徴量ごとに 1 サンプル 1 ビットで詰めて持つ (ビットスライス)．
+  // 特徴量 i の語 k のビット s がサンプル 64 k + s の値
+  class BitPlanes {
+  public:
+    // 一度に処理する語の数 (512 サンプル)．AVX-512 では 1 レジスタ，AVX2 では 2 レジスタに収まる
+    static constexpr std::size_t kBlockWords = 8;
+
+  private:
+    std::size_t m_features;
+    std::size_t m_samples;
+    std::size_t m_stride; // 特徴量 1 つ分の語数．kBlockWords の倍数
+    std::vector<std::uint64_t> m_words;
+
+  public:
+    explicit BitPlanes(std::size_t features, std::size_t samples);
+
+    std::size_t features() const;
+    std::size_t samples() const;
+    std::size_t stride() const;
+
+    bool get(std::size_t sample, std::size_t feature) const;
+    void set(std::size_t sample, std::size_t feature, bool value);
+
+    std::uint64_t *plane(std::size_t feature);
+    const std::uint64_t *plane(std::size_t feature) const;
+  };
+
+  // 重みが ±1，入力と出力が 0/1 の全結合層．
+  // 入力ビットと重みビット (1 が +1) の XNOR の数が閾値以上なら 1 を出力する
+  class BinaryLayer {
+  private:
+    std::size_t m_inputs;
+    std::size_t m_words; // 1 つのニューロンの重みの語数
+    std::vector<std::uint64_t> m_weights;
+    std::vector<int> m_thresholds;
+    int m_counterBits; // 一致数を数えるのに必要なビット数
+
+  public:
+    explicit BinaryLayer(std::size_t inputs);
+
+    std::size_t inputs() const;
+    std::size_t outputs() const;
+
+    // signs[i] が true なら重み +1．一致数が threshold 以上で発火する
+    void addNeuron(const std::vector<bool> &signs, int threshold);
+
+    // 重みの絶対値がすべて等しいパーセプトロン w x + b > 0 を変換する．
+    // 重み a s_i (s_i = ±1) に対し，0/1 の入力では w x = a (一致数 - 負の重みの数) なので，
+    // 閾値は floor(負の重みの数 - b / a) + 1 になる
+    void addPerceptron(const Vecf &w, float b);
+    void addPerceptron(const SimplePerceptron &p);
+
+    // 1 サンプルを 64 入力ずつ語に詰めて評価する．in は ceil(inputs / 64) 語，out は ceil(outputs / 64) 語
+    void evaluate(const std::uint64_t *in, std::uint64_t *out) const;
+
+    // ビットスライス表現の kBlockWords 語分 (512 サンプル) を評価する．
+    // 入力 i の語は in + i * inStride から，出力 j の語は out + j * outStride へ
+    void evaluateBlock(const std::uint64_t *in, std::size_t inStride, std::uint64_t *out,
+      std::size_t outStride) const;
+  };
+
+  // BinaryLayer を順に適用するネットワーク．各層の入力は前の層の出力
+  class BinaryNetwork {
+  private:
+    std::vector<BinaryLayer> m_layers;
+
+  public:
+    void addLayer(BinaryLayer layer);
+
+    std::size_t inputs() const;
+    std::size_t outputs() const;
+    const std::vector<BinaryLayer> &layers() const;
+
+    // 1 サンプルを評価する
+    std::vector<bool> operator()(const std::vector<bool> &x) const;
+
+    // ビットスライス表現の全サンプルを，512 サンプルずつ並列に評価する
+    BitPlanes evaluate(const BitPlanes &x) const;
+
+    // 論理ゲート．XOR は NAND と OR の層，AND の層の 2 層になる
+    static BinaryNetwork OR();
+    static BinaryNetwork AND();
+    static BinaryNetwork NAND();
+    static BinaryNetwork XOR();
+  };
+} // namespace mywheels
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include "math/Matrix.hpp"
+#include "math/Vector.hpp"
+
+namespace mywheels {
+  // 全結合層を重ねた推論専用のモデル．
+  // テキスト形式で読み込む．# から行末まではコメント
+  //
+  //   dense <入力数> <出力数> <identity|sigmoid|relu|softmax>
+  //   <出力数 x 入力数の重み W (行優先)>
+  //   <出力数個のバイアス b>
+  //   dense ...
+  //
+  // 各層は y = f(W x + b) を計算する
+  class DenseModel {
+  public:
+    enum class Activation {
+      Identity,
+      Sigmoid,
+      Relu,
+      Softmax // 出力の各行に softmax を掛ける
+    };
+
+    struct Layer {
+      Matf weights; // 入力数 x 出力数．行ごとの入力に右から掛ける
+      Vecf bias;
+      Activation activation;
+    };
+
+  private:
+    std::vector<Layer> m_layers;
+
+  public:
+    // 読み込みに失敗した時は std::runtime_error を投げる
+    static DenseModel load(const std::string &path);
+    static DenseModel parse(std::istream &is);
+
+    std::size_t inputs() const;
+    std::size_t outputs() const;
+    const std::vector<Layer> &layers() const;
+
+    // x の各行を 1 つの入力として，バッチ全体を行列積でまとめて計算する
+    Matf forward(Matf x) const;
+  };
+} // namespace mywheels
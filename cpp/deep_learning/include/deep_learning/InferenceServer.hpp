@@ -0,0 +1,115 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "deep_learning/DenseModel.hpp"
+
+namespace mywheels {
+  // マイクロ秒単位の対数ヒストグラム．各 2 冪の区間を 8 等分するので相対誤差は 1/8 以内．
+  // record はロックなしで複数のスレッドから呼べる
+  class LatencyHistogram {
+  private:
+    static constexpr std::size_t kLinear = 16;
+    static constexpr std::size_t kSubBuckets = 8;
+    static constexpr std::size_t kBuckets = kLinear + (64 - 4) * kSubBuckets;
+
+    std::array<std::atomic<std::uint64_t>, kBuckets> m_counts{};
+
+    static std::size_t bucket(std::uint64_t us);
+    static std::uint64_t upperBound(std::size_t bucket);
+
+  public:
+    void record(std::chrono::nanoseconds latency);
+    std::uint64_t count() const;
+    // 分位点 q (0 < q <= 1) の上界．記録がなければ 0
+    std::chrono::microseconds percentile(double q) const;
+  };
+
+  struct ServerOptions {
+    std::size_t maxBatch = 32;                  // 1 つのバッチにまとめる最大の要求数
+    std::chrono::microseconds maxLatency{1000}; // 最初の要求が届いてからバッチを流すまでの最大の待ち時間
+    std::size_t workers = 1;                    // バッチを計算するスレッドの数
+  };
+
+  struct ServerStats {
+    std::uint64_t requests;
+    std::uint64_t batches;
+    double meanBatchSize;
+    double throughput; // 開始からの平均の要求数 / 秒
+    std::chrono::microseconds p50;
+    std::chrono::microseconds p99;
+  };
+
+  std::ostream &operator<<(std::ostream &os, const ServerStats &stats);
+
+  // 同時に届いた要求をマイクロバッチにまとめて DenseModel で推論する．
+  // バッチは maxBatch 個たまるか，最も古い要求が maxLatency だけ待った時点で流す
+  class InferenceServer {
+  private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Request {
+      std::vector<float> input;
+      std::promise<std::vector<float>> result;
+      Clock::time_point arrival;
+    };
+
+    const DenseModel &m_model;
+    ServerOptions m_options;
+
+    std::mutex m_mutex;
+    std::condition_variable m_arrived;
+    std::deque<Request> m_queue;
+    bool m_stop = false;
+    std::vector<std::thread> m_workers;
+
+    LatencyHistogram m_latency;
+    std::atomic<std::uint64_t> m_requests{0};
+    std::atomic<std::uint64_t> m_batches{0};
+    Clock::time_point m_start;
+
+    void workerLoop();
+    void runBatch(std::vector<Request> &batch);
+
+  public:
+    InferenceServer(const DenseModel &model, ServerOptions options);
+    ~InferenceServer();
+
+    InferenceServer(const InferenceServer &) = delete;
+    InferenceServer &operator=(const InferenceServer &) = delete;
+
+    // 入力の長さが合わない時は std::invalid_argument を投げる
+    std::future<std::vector<float>> submit(std::vector<float> input);
+
+    // 待っている要求をすべて処理してからワーカーを止める
+    void shutdown();
+
+    ServerStats stats() const;
+
+    // 1 行 1 要求 (空白区切りの入力) を読み，同じ順に 1 行ずつ出力を書く．
+    // 応答を待たずに次の行を読むので，1 つのストリームからの要求もバッチにまとまる．
+    // "stats" の行には統計を返す
+    void serveStream(std::istream &is, std::ostream &os);
+
+    // Unix ドメインソケット path で接続を待ち，接続ごとに serveStream と同じ形式で応答する．
+    // stop が true になると新しい接続を断り，処理中の接続を閉じて戻る．POSIX 以外では std::runtime_error を投げる
+    void serveSocket(const std::string &path, const std::atomic<bool> &stop);
+
+  private:
+    // 1 行の要求を処理し，応答を返す future を作る
+    std::future<std::string> handleLine(const std::string &line);
+    void serveLines(const std::function<bool(std::string &)> &readLine,
+      const std::function<void(const std::string &)> &writeLine);
+  };
+} // namespace mywheels
@@ -11,6 +11,14 @@ namespace mywheels {
   public:
     SimplePerceptron(Vecf w, float b);
     float operator()(Vecf x);
+    const Vecf &weights() const;
+    float bias() const;
+
+    // 論理ゲートを表すパーセプトロン
+    static SimplePerceptron orGate();
+    static SimplePerceptron andGate();
+    static SimplePerceptron nandGate();
+
     static float OR(Vecf x);
     static float AND(Vecf x);
     static float NAND(Vecf x);
@@ -0,0 +1,360 @@
+#include "deep_learning/BinaryNetwork.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include "math/Kernels.hpp"
+#include "math/Multiversion.hpp"
+#include "math/ThreadPool.hpp"
+
+#if defined(_MSC_VER)
+#  include <intrin.h>
+#endif
+
+using namespace mywheels;
+
+namespace {
+  constexpr std::size_t kWordBits = 64;
+  // ビットスライスで一致数を数えるカウンタの最大のビット数
+  constexpr int kMaxCounterBits = 32;
+
+  // popcnt を有効にした関数の中では 1 命令になる
+  inline int popcount64(std::uint64_t x) {
+#if defined(_MSC_VER)
+    return static_cast<int>(__popcnt64(x));
+#else
+    return __builtin_popcountll(x);
+#endif
+  }
+
+  std::size_t wordsFor(std::size_t bits) {
+    return (bits + kWordBits - 1) / kWordBits;
+  }
+
+  // n を表すのに必要なビット数
+  inline int bitLength(std::size_t n) {
+    int bits = 0;
+    for (; n > 0; n >>= 1) {
+      bits++;
+    }
+    return bits;
+  }
+
+  // カーネルに渡す層の中身
+  struct LayerData {
+    std::size_t inputs;
+    std::size_t words;
+    std::size_t outputs;
+    int counterBits;
+    const std::uint64_t *weights;
+    const int *thresholds;
+  };
+
+  inline void evaluateImpl(const LayerData &layer, const std::uint64_t *in, std::uint64_t *out) {
+    std::fill(out, out + wordsFor(layer.outputs), 0);
+    std::size_t tail = layer.inputs % kWordBits;
+    std::uint64_t lastMask = (tail == 0) ? ~std::uint64_t(0) : (std::uint64_t(1) << tail) - 1;
+    for (std::size_t j = 0; j < layer.outputs; j++) {
+      const std::uint64_t *w = layer.weights + j * layer.words;
+      int agree = 0;
+      for (std::size_t k = 0; k < layer.words; k++) {
+        std::uint64_t mask = (k + 1 == layer.words) ? lastMask : ~std::uint64_t(0);
+        agree += popcount64(~(in[k] ^ w[k]) & mask);
+      }
+      if (agree >= layer.thresholds[j]) {
+        out[j / kWordBits] |= std::uint64_t(1) << (j % kWordBits);
+      }
+    }
+  }
+
+  // kBlockWords 語の固定長のループは命令セットのベクトル幅で処理される (AVX-512 なら 1 命令)
+  inline void evaluateBlockImpl(const LayerData &layer, const std::uint64_t *in, std::size_t inStride,
+    std::uint64_t *out, std::size_t outStride) {
+    constexpr std::size_t W = BitPlanes::kBlockWords;
+    std::uint64_t counter[kMaxCounterBits][W];
+    for (std::size_t j = 0; j < layer.outputs; j++) {
+      std::uint64_t *o = out + j * outStride;
+      int t = layer.thresholds[j];
+      if (t <= 0 || t > static_cast<int>(layer.inputs)) {
+        std::fill(o, o + W, (t <= 0) ? ~std::uint64_t(0) : 0);
+        continue;
+      }
+
+      // サンプルごとの一致数を，ビットごとの平面に分けた縦のカウンタで数える
+      const std::uint64_t *w = layer.weights + j * layer.words;
+      for (int b = 0; b < layer.counterBits; b++) {
+        std::fill(counter[b], counter[b] + W, 0);
+      }
+      for (std::size_t i = 0; i < layer.inputs; i++) {
+        // 重みが -1 の入力は反転させると一致を表す
+        std::uint64_t flip = ((w[i / kWordBits] >> (i % kWordBits)) & 1) ? 0 : ~std::uint64_t(0);
+        const std::uint64_t *x = in + i * inStride;
+        std::uint64_t carry[W];
+        for (std::size_t k = 0; k < W; k++) {
+          carry[k] = x[k] ^ flip;
+        }
+        // i + 1 個までしか数えないので，それを表せるビットまで繰り上げる
+        int bits = bitLength(i + 1);
+        for (int b = 0; b < bits; b++) {
+          for (std::size_t k = 0; k < W; k++) {
+            std::uint64_t c = counter[b][k] & carry[k];
+            counter[b][k] ^= carry[k];
+            carry[k] = c;
+          }
+        }
+      }
+
+      // 上位ビットから比べて counter >= t を求める
+      std::uint64_t gt[W], eq[W];
+      std::fill(gt, gt + W, 0);
+      std::fill(eq, eq + W, ~std::uint64_t(0));
+      for (int b = layer.counterBits - 1; b >= 0; b--) {
+        if ((t >> b) & 1) {
+          for (std::size_t k = 0; k < W; k++) {
+            eq[k] &= counter[b][k];
+          }
+        } else {
+          for (std::size_t k = 0; k < W; k++) {
+            gt[k] |= eq[k] & counter[b][k];
+            eq[k] &= ~counter[b][k];
+          }
+        }
+      }
+      for (std::size_t k = 0; k < W; k++) {
+        o[k] = gt[k] | eq[k];
+      }
+    }
+  }
+
+  struct BinaryTable {
+    void (*evaluate)(const LayerData &layer, const std::uint64_t *in, std::uint64_t *out);
+    void (*evaluateBlock)(const LayerData &layer, const std::uint64_t *in, std::size_t inStride, std::uint64_t *out,
+      std::size_t outStride);
+  };
+} // namespace
+
+// 命令セット向けにコンパイルした層のカーネルを NS::binaryTable として定義する
+#define MYWHEELS_DEFINE_BINARY_KERNELS(NS, ISA, TARGET)                                                            \
+  namespace NS {                                                                                                     \
+    namespace {                                                                                                      \
+      TARGET void evaluate(const LayerData &layer, const std::uint64_t *in, std::uint64_t *out) {                    \
+        evaluateImpl(layer, in, out);                                                                                \
+      }                                                                                                              \
+      TARGET void evaluateBlock(const LayerData &layer, const std::uint64_t *in, std::size_t inStride,               \
+        std::uint64_t *out, std::size_t outStride) {                                                                 \
+        evaluateBlockImpl(layer, in, inStride, out, outStride);                                                      \
+      }                                                                                                              \
+      const BinaryTable binaryTable = {evaluate, evaluateBlock};                                                     \
+    }                                                                                                                \
+  }
+
+MYWHEELS_DEFINE_FOR_EACH_ISA(MYWHEELS_DEFINE_BINARY_KERNELS)
+
+#undef MYWHEELS_DEFINE_BINARY_KERNELS
+
+namespace {
+  // 浮動小数点数のカーネルと同じ命令セットのもの (kernels::useIsa に従う)
+  const BinaryTable &binaryTable() {
+    return selectIsa(kernels::table<float>().isa, generic::binaryTable, sse42::binaryTable, avx2::binaryTable,
+      avx512::binaryTable);
+  }
+} // namespace
+
+// BitPlanes
+
+BitPlanes::BitPlanes(std::size_t features, std::size_t samples) :
+  m_features(features), m_samples(samples),
+  m_stride((wordsFor(samples) + kBlockWords - 1) / kBlockWords * kBlockWords), m_words(features * m_stride, 0) {};
+
+std::size_t BitPlanes::features() const {
+  return m_features;
+}
+
+std::size_t BitPlanes::samples() const {
+  return m_samples;
+}
+
+std::size_t BitPlanes::stride() const {
+  return m_stride;
+}
+
+bool BitPlanes::get(std::size_t sample, std::size_t feature) const {
+  assert(sample < m_samples && feature < m_features);
+  return (plane(feature)[sample / kWordBits] >> (sample % kWordBits)) & 1;
+}
+
+void BitPlanes::set(std::size_t sample, std::size_t feature, bool value) {
+  assert(sample < m_samples && feature < m_features);
+  std::uint64_t bit = std::uint64_t(1) << (sample % kWordBits);
+  std::uint64_t &word = plane(feature)[sample / kWordBits];
+  word = value ? (word | bit) : (word & ~bit);
+}
+
+std::uint64_t *BitPlanes::plane(std::size_t feature) {
+  return m_words.data() + feature * m_stride;
+}
+
+const std::uint64_t *BitPlanes::plane(std::size_t feature) const {
+  return m_words.data() + feature * m_stride;
+}
+
+// BinaryLayer
+
+BinaryLayer::BinaryLayer(std::size_t inputs) :
+  m_inputs(inputs), m_words(wordsFor(inputs)), m_counterBits(bitLength(inputs)) {
+  assert(inputs > 0 && m_counterBits <= kMaxCounterBits);
+};
+
+std::size_t BinaryLayer::inputs() const {
+  return m_inputs;
+}
+
+std::size_t BinaryLayer::outputs() const {
+  return m_thresholds.size();
+}
+
+void BinaryLayer::addNeuron(const std::vector<bool> &signs, int threshold) {
+  assert(signs.size() == m_inputs);
+  std::size_t offset = m_weights.size();
+  m_weights.resize(offset + m_words, 0);
+  for (std::size_t i = 0; i < m_inputs; i++) {
+    if (signs[i]) {
+      m_weights[offset + i / kWordBits] |= std::uint64_t(1) << (i % kWordBits);
+    }
+  }
+  m_thresholds.push_back(threshold);
+}
+
+void BinaryLayer::addPerceptron(const Vecf &w, float b) {
+  assert(w.dim() == m_inputs);
+  float a = std::abs(w(0));
+  assert(a > 0.0f);
+  std::vector<bool> signs(m_inputs);
+  int negatives = 0;
+  for (std::size_t i = 0; i < m_inputs; i++) {
+    assert(std::abs(w(i)) == a);
+    signs[i] = w(i) > 0.0f;
+    negatives += signs[i] ? 0 : 1;
+  }
+  addNeuron(signs, static_cast<int>(std::floor(static_cast<float>(negatives) - b / a)) + 1);
+}
+
+void BinaryLayer::addPerceptron(const SimplePerceptron &p) {
+  addPerceptron(p.weights(), p.bias());
+}
+
+void BinaryLayer::evaluate(const std::uint64_t *in, std::uint64_t *out) const {
+  LayerData layer = {m_inputs, m_words, outputs(), m_counterBits, m_weights.data(), m_thresholds.data()};
+  binaryTable().evaluate(layer, in, out);
+}
+
+void BinaryLayer::evaluateBlock(const std::uint64_t *in, std::size_t inStride, std::uint64_t *out,
+  std::size_t outStride) const {
+  LayerData layer = {m_inputs, m_words, outputs(), m_counterBits, m_weights.data(), m_thresholds.data()};
+  binaryTable().evaluateBlock(layer, in, inStride, out, outStride);
+}
+
+// BinaryNetwork
+
+void BinaryNetwork::addLayer(BinaryLayer layer) {
+  assert(m_layers.empty() || m_layers.back().outputs() == layer.inputs());
+  m_layers.push_back(std::move(layer));
+}
+
+std::size_t BinaryNetwork::inputs() const {
+  return m_layers.front().inputs();
+}
+
+std::size_t BinaryNetwork::outputs() const {
+  return m_layers.back().outputs();
+}
+
+const std::vector<BinaryLayer> &BinaryNetwork::layers() const {
+  return m_layers;
+}
+
+std::vector<bool> BinaryNetwork::operator()(const std::vector<bool> &x) const {
+  assert(x.size() == inputs());
+  std::vector<std::uint64_t> in(wordsFor(x.size()), 0), out;
+  for (std::size_t i = 0; i < x.size(); i++) {
+    if (x[i]) {
+      in[i / kWordBits] |= std::uint64_t(1) << (i % kWordBits);
+    }
+  }
+  for (const auto &layer : m_layers) {
+    out.assign(wordsFor(layer.outputs()), 0);
+    layer.evaluate(in.data(), out.data());
+    in.swap(out);
+  }
+  std::vector<bool> ret(outputs());
+  for (std::size_t j = 0; j < ret.size(); j++) {
+    ret[j] = (in[j / kWordBits] >> (j % kWordBits)) & 1;
+  }
+  return ret;
+}
+
+BitPlanes BinaryNetwork::evaluate(const BitPlanes &x) const {
+  assert(x.features() == inputs());
+  constexpr std::size_t W = BitPlanes::kBlockWords;
+  BitPlanes ret(outputs(), x.samples());
+  std::size_t width = 0;
+  for (const auto &layer : m_layers) {
+    width = std::max(width, layer.outputs());
+  }
+
+  // ブロックごとに全層を通し，途中の層の出力は L1 に収まる作業領域に置く
+  std::size_t blocks = x.stride() / W;
+  parallelFor(0, blocks, [&](std::size_t first, std::size_t last) {
+    std::vector<std::uint64_t> a(width * W), b(width * W);
+    for (std::size_t block = first; block < last; block++) {
+      const std::uint64_t *in = x.plane(0) + block * W;
+      std::size_t inStride = x.stride();
+      for (std::size_t l = 0; l < m_layers.size(); l++) {
+        bool lastLayer = (l + 1 == m_layers.size());
+        std::uint64_t *out = lastLayer ? ret.plane(0) + block * W : a.data();
+        std::size_t outStride = lastLayer ? ret.stride() : W;
+        m_layers[l].evaluateBlock(in, inStride, out, outStride);
+        a.swap(b);
+        in = b.data();
+        inStride = W;
+      }
+    }
+  }, 64);
+  return ret;
+}
+
+BinaryNetwork BinaryNetwork::OR() {
+  BinaryLayer layer(2);
+  layer.addPerceptron(SimplePerceptron::orGate());
+  BinaryNetwork ret;
+  ret.addLayer(std::move(layer));
+  return ret;
+}
+
+BinaryNetwork BinaryNetwork::AND() {
+  BinaryLayer layer(2);
+  layer.addPerceptron(SimplePerceptron::andGate());
+  BinaryNetwork ret;
+  ret.addLayer(std::move(layer));
+  return ret;
+}
+
+BinaryNetwork BinaryNetwork::NAND() {
+  BinaryLayer layer(2);
+  layer.addPerceptron(SimplePerceptron::nandGate());
+  BinaryNetwork ret;
+  ret.addLayer(std::move(layer));
+  return ret;
+}
+
+BinaryNetwork BinaryNetwork::XOR() {
+  // SimplePerceptron::XOR と同じく AND(NAND(x), OR(x))
+  BinaryLayer hidden(2);
+  hidden.addPerceptron(SimplePerceptron::nandGate());
+  hidden.addPerceptron(SimplePerceptron::orGate());
+  BinaryLayer output(2);
+  output.addPerceptron(SimplePerceptron::andGate());
+  BinaryNetwork ret;
+  ret.addLayer(std::move(hidden));
+  ret.addLayer(std::move(output));
+  return ret;
+}
@@ -0,0 +1,145 @@
+#include "deep_learning/DenseModel.hpp"
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include "math/Softmax.hpp"
+
+using namespace mywheels;
+
+namespace {
+  // コメントを除いた字句を順に読む
+  class Tokenizer {
+  private:
+    std::istream &m_is;
+    std::istringstream m_line;
+
+  public:
+    explicit Tokenizer(std::istream &is) : m_is(is) {};
+
+    bool next(std::string &token) {
+      while (!(m_line >> token)) {
+        std::string line;
+        if (!std::getline(m_is, line)) {
+          return false;
+        }
+        line = line.substr(0, line.find('#'));
+        m_line.clear();
+        m_line.str(line);
+      }
+      return true;
+    }
+
+    template<typename T>
+    T read(const char *what) {
+      std::string token;
+      if (!next(token)) {
+        throw std::runtime_error(std::string("DenseModel: unexpected end of input while reading ") + what);
+      }
+      std::istringstream ss(token);
+      T value;
+      if (!(ss >> value) || !ss.eof()) {
+        throw std::runtime_error(std::string("DenseModel: invalid ") + what + " '" + token + "'");
+      }
+      return value;
+    }
+  };
+
+  DenseModel::Activation parseActivation(const std::string &name) {
+    if (name == "identity") {
+      return DenseModel::Activation::Identity;
+    } else if (name == "sigmoid") {
+      return DenseModel::Activation::Sigmoid;
+    } else if (name == "relu") {
+      return DenseModel::Activation::Relu;
+    } else if (name == "softmax") {
+      return DenseModel::Activation::Softmax;
+    }
+    throw std::runtime_error("DenseModel: unknown activation '" + name + "'");
+  }
+} // namespace
+
+DenseModel DenseModel::load(const std::string &path) {
+  std::ifstream ifs(path);
+  if (!ifs) {
+    throw std::runtime_error("DenseModel: cannot open '" + path + "'");
+  }
+  return parse(ifs);
+}
+
+DenseModel DenseModel::parse(std::istream &is) {
+  DenseModel model;
+  Tokenizer tokens(is);
+  std::string keyword;
+  while (tokens.next(keyword)) {
+    if (keyword != "dense") {
+      throw std::runtime_error("DenseModel: unknown layer '" + keyword + "'");
+    }
+    std::size_t in = tokens.read<std::size_t>("input size");
+    std::size_t out = tokens.read<std::size_t>("output size");
+    if (in == 0 || out == 0) {
+      throw std::runtime_error("DenseModel: layer size must be positive");
+    }
+    if (!model.m_layers.empty() && model.outputs() != in) {
+      throw std::runtime_error("DenseModel: input size does not match the previous layer");
+    }
+    std::string activation;
+    if (!tokens.next(activation)) {
+      throw std::runtime_error("DenseModel: unexpected end of input while reading activation");
+    }
+
+    // ファイルには W を出力数 x 入力数で書くので，転置して格納する
+    Layer layer{Matf(in, out), Vecf(out), parseActivation(activation)};
+    for (std::size_t i = 0; i < out; i++) {
+      for (std::size_t j = 0; j < in; j++) {
+        layer.weights(j, i) = tokens.read<float>("weight");
+      }
+    }
+    for (std::size_t i = 0; i < out; i++) {
+      layer.bias(i) = tokens.read<float>("bias");
+    }
+    model.m_layers.push_back(std::move(layer));
+  }
+  if (model.m_layers.empty()) {
+    throw std::runtime_error("DenseModel: no layers");
+  }
+  return model;
+}
+
+std::size_t DenseModel::inputs() const {
+  return m_layers.front().weights.dim().first;
+}
+
+std::size_t DenseModel::outputs() const {
+  return m_layers.back().weights.dim().second;
+}
+
+const std::vector<DenseModel::Layer> &DenseModel::layers() const {
+  return m_layers;
+}
+
+Matf DenseModel::forward(Matf x) const {
+  assert(x.dim().second == inputs());
+  std::size_t batch = x.dim().first;
+  for (const auto &layer : m_layers) {
+    x = std::move(x) * layer.weights;
+    std::size_t cols = x.dim().second;
+    for (std::size_t i = 0; i < batch; i++) {
+      float *row = x.data() + i * cols;
+      kernels::add(cols, row, layer.bias.data(), row);
+    }
+    switch (layer.activation) {
+    case Activation::Identity:
+      break;
+    case Activation::Sigmoid:
+      x = sigmoid(std::move(x));
+      break;
+    case Activation::Relu:
+      x = lamp(std::move(x));
+      break;
+    case Activation::Softmax:
+      x = softmax(std::move(x));
+      break;
+    }
+  }
+  return x;
+}
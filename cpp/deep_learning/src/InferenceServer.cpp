@@ -0,0 +1,447 @@
+#include "deep_learning/InferenceServer.hpp"
+#include <algorithm>
+#include <cmath>
+#include <list>
+#include <sstream>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#  define MYWHEELS_HAS_UNIX_SOCKET 1
+#  include <cerrno>
+#  include <poll.h>
+#  include <sys/socket.h>
+#  include <sys/un.h>
+#  include <unistd.h>
+#endif
+
+using namespace mywheels;
+
+// LatencyHistogram
+
+std::size_t LatencyHistogram::bucket(std::uint64_t us) {
+  if (us < kLinear) {
+    return static_cast<std::size_t>(us);
+  }
+  // us は [2^e, 2^(e+1)) にある．その区間を上位 3 ビットで 8 等分する
+  std::size_t e = 0;
+  for (std::uint64_t v = us; v > 1; v >>= 1) {
+    e++;
+  }
+  std::size_t sub = static_cast<std::size_t>((us >> (e - 3)) & (kSubBuckets - 1));
+  return kLinear + (e - 4) * kSubBuckets + sub;
+}
+
+std::uint64_t LatencyHistogram::upperBound(std::size_t bucket) {
+  if (bucket < kLinear) {
+    return bucket;
+  }
+  std::size_t e = (bucket - kLinear) / kSubBuckets + 4;
+  std::size_t sub = (bucket - kLinear) % kSubBuckets;
+  std::uint64_t width = std::uint64_t(1) << (e - 3);
+  return (kSubBuckets + sub) * width + width - 1;
+}
+
+void LatencyHistogram::record(std::chrono::nanoseconds latency) {
+  auto us = std::chrono::duration_cast<std::chrono::microseconds>(latency).count();
+  m_counts[bucket(static_cast<std::uint64_t>(std::max<decltype(us)>(0, us)))].fetch_add(1, std::memory_order_relaxed);
+}
+
+std::uint64_t LatencyHistogram::count() const {
+  std::uint64_t total = 0;
+  for (const auto &c : m_counts) {
+    total += c.load(std::memory_order_relaxed);
+  }
+  return total;
+}
+
+std::chrono::microseconds LatencyHistogram::percentile(double q) const {
+  std::uint64_t total = count();
+  if (total == 0) {
+    return std::chrono::microseconds(0);
+  }
+  auto target = static_cast<std::uint64_t>(std::ceil(q * static_cast<double>(total)));
+  target = std::clamp<std::uint64_t>(target, 1, total);
+  std::uint64_t seen = 0;
+  for (std::size_t b = 0; b < kBuckets; b++) {
+    seen += m_counts[b].load(std::memory_order_relaxed);
+    if (seen >= target) {
+      return std::chrono::microseconds(upperBound(b));
+    }
+  }
+  return std::chrono::microseconds(upperBound(kBuckets - 1));
+}
+
+std::ostream &mywheels::operator<<(std::ostream &os, const ServerStats &stats) {
+  os << "requests=" << stats.requests << " batches=" << stats.batches << " mean_batch=" << stats.meanBatchSize
+     << " throughput=" << stats.throughput << "/s p50=" << stats.p50.count() << "us p99=" << stats.p99.count() << "us";
+  return os;
+}
+
+// InferenceServer
+
+InferenceServer::InferenceServer(const DenseModel &model, ServerOptions options) :
+  m_model(model), m_options(options), m_start(Clock::now()) {
+  m_options.maxBatch = std::max<std::size_t>(1, m_options.maxBatch);
+  m_options.workers = std::max<std::size_t>(1, m_options.workers);
+  for (std::size_t i = 0; i < m_options.workers; i++) {
+    m_workers.emplace_back([this]() {
+      workerLoop();
+    });
+  }
+}
+
+InferenceServer::~InferenceServer() {
+  shutdown();
+}
+
+std::future<std::vector<float>> InferenceServer::submit(std::vector<float> input) {
+  if (input.size() != m_model.inputs()) {
+    throw std::invalid_argument("expected " + std::to_string(m_model.inputs()) + " inputs, got "
+                                + std::to_string(input.size()));
+  }
+  Request request{std::move(input), {}, Clock::now()};
+  auto future = request.result.get_future();
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_stop) {
+      throw std::runtime_error("server is shut down");
+    }
+    m_queue.push_back(std::move(request));
+  }
+  m_arrived.notify_all();
+  return future;
+}
+
+void InferenceServer::shutdown() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_stop) {
+      return;
+    }
+    m_stop = true;
+  }
+  m_arrived.notify_all();
+  for (auto &worker : m_workers) {
+    worker.join();
+  }
+}
+
+ServerStats InferenceServer::stats() const {
+  std::uint64_t requests = m_requests.load(std::memory_order_relaxed);
+  std::uint64_t batches = m_batches.load(std::memory_order_relaxed);
+  double seconds = std::chrono::duration<double>(Clock::now() - m_start).count();
+  return {requests, batches, batches == 0 ? 0.0 : double(requests) / double(batches),
+    seconds > 0 ? double(requests) / seconds : 0.0, m_latency.percentile(0.50), m_latency.percentile(0.99)};
+}
+
+void InferenceServer::workerLoop() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (true) {
+    m_arrived.wait(lock, [this]() {
+      return m_stop || !m_queue.empty();
+    });
+    if (m_queue.empty()) {
+      return;
+    }
+    // 最も古い要求の締め切りまで，バッチが埋まるのを待つ．停止する時は待たずに流す
+    auto deadline = m_queue.front().arrival + m_options.maxLatency;
+    m_arrived.wait_until(lock, deadline, [this]() {
+      return m_stop || m_queue.empty() || m_queue.size() >= m_options.maxBatch;
+    });
+    if (m_queue.empty()) {
+      continue;
+    }
+    std::size_t n = std::min(m_queue.size(), m_options.maxBatch);
+    std::vector<Request> batch;
+    batch.reserve(n);
+    for (std::size_t i = 0; i < n; i++) {
+      batch.push_back(std::move(m_queue.front()));
+      m_queue.pop_front();
+    }
+    lock.unlock();
+    runBatch(batch);
+    lock.lock();
+  }
+}
+
+void InferenceServer::runBatch(std::vector<Request> &batch) {
+  std::size_t inputs = m_model.inputs();
+  Matf y(std::size_t(0), std::size_t(0));
+  std::exception_ptr error;
+  try {
+    Matf x(batch.size(), inputs);
+    for (std::size_t i = 0; i < batch.size(); i++) {
+      std::copy(batch[i].input.begin(), batch[i].input.end(), x.data() + i * inputs);
+    }
+    y = m_model.forward(std::move(x));
+  } catch (...) {
+    error = std::current_exception();
+  }
+  // 結果を渡す前に数えるので，応答を受け取った後の stats には必ずこのバッチが含まれる
+  auto now = Clock::now();
+  for (const auto &request : batch) {
+    m_latency.record(now - request.arrival);
+  }
+  m_requests.fetch_add(batch.size(), std::memory_order_relaxed);
+  m_batches.fetch_add(1, std::memory_order_relaxed);
+  std::size_t outputs = y.dim().second;
+  for (std::size_t i = 0; i < batch.size(); i++) {
+    if (error) {
+      batch[i].result.set_exception(error);
+    } else {
+      const float *row = y.data() + i * outputs;
+      batch[i].result.set_value(std::vector<float>(row, row + outputs));
+    }
+  }
+}
+
+namespace {
+  std::future<std::string> ready(std::string text) {
+    std::promise<std::string> promise;
+    promise.set_value(std::move(text));
+    return promise.get_future();
+  }
+} // namespace
+
+std::future<std::string> InferenceServer::handleLine(const std::string &line) {
+  std::istringstream ss(line);
+  std::string first;
+  if (!(ss >> first)) {
+    return {};
+  }
+  if (first == "stats") {
+    // 先に読んだ要求の応答を書いた後に集計する
+    return std::async(std::launch::deferred, [this]() {
+      std::ostringstream os;
+      os << stats();
+      return os.str();
+    });
+  }
+
+  std::vector<float> input;
+  ss.clear();
+  ss.str(line);
+  float value;
+  while (ss >> value) {
+    input.push_back(value);
+  }
+  if (!ss.eof()) {
+    return ready("error: invalid number");
+  }
+
+  std::future<std::vector<float>> result;
+  try {
+    result = submit(std::move(input));
+  } catch (const std::exception &e) {
+    return ready(std::string("error: ") + e.what());
+  }
+  // 書き込むスレッドで結果を待ち，1 行に整形する
+  return std::async(std::launch::deferred, [result = std::move(result)]() mutable {
+    try {
+      std::vector<float> output = result.get();
+      std::ostringstream os;
+      for (std::size_t i = 0; i < output.size(); i++) {
+        os << (i == 0 ? "" : " ") << output[i];
+      }
+      return os.str();
+    } catch (const std::exception &e) {
+      return std::string("error: ") + e.what();
+    }
+  });
+}
+
+void InferenceServer::serveLines(const std::function<bool(std::string &)> &readLine,
+  const std::function<void(const std::string &)> &writeLine) {
+  // 読み込みと書き込みを別のスレッドにして，応答を待たずに次の要求を送る．
+  // 未応答の要求が kMaxPending を超えたら読み込みを止める
+  constexpr std::size_t kMaxPending = 4096;
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::deque<std::future<std::string>> pending;
+  bool done = false;
+
+  std::thread writer([&]() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+      changed.wait(lock, [&]() {
+        return done || !pending.empty();
+      });
+      if (pending.empty()) {
+        return;
+      }
+      auto response = std::move(pending.front());
+      pending.pop_front();
+      lock.unlock();
+      changed.notify_all();
+      writeLine(response.get());
+      lock.lock();
+    }
+  });
+
+  std::string line;
+  while (readLine(line)) {
+    auto response = handleLine(line);
+    if (!response.valid()) {
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(mutex);
+    changed.wait(lock, [&]() {
+      return pending.size() < kMaxPending;
+    });
+    pending.push_back(std::move(response));
+    lock.unlock();
+    changed.notify_all();
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    done = true;
+  }
+  changed.notify_all();
+  writer.join();
+}
+
+void InferenceServer::serveStream(std::istream &is, std::ostream &os) {
+  serveLines(
+    [&is](std::string &line) {
+      return static_cast<bool>(std::getline(is, line));
+    },
+    [&os](const std::string &line) {
+      os << line << '\n' << std::flush;
+    });
+}
+
+#ifdef MYWHEELS_HAS_UNIX_SOCKET
+
+namespace {
+  // ソケットから 1 行ずつ読む
+  class LineReader {
+  private:
+    int m_fd;
+    std::string m_buffer;
+    std::size_t m_pos = 0;
+
+  public:
+    explicit LineReader(int fd) : m_fd(fd) {};
+
+    bool operator()(std::string &line) {
+      while (true) {
+        std::size_t nl = m_buffer.find('\n', m_pos);
+        if (nl != std::string::npos) {
+          line.assign(m_buffer, m_pos, nl - m_pos);
+          m_pos = nl + 1;
+          return true;
+        }
+        m_buffer.erase(0, m_pos);
+        m_pos = 0;
+        char chunk[4096];
+        ssize_t n = ::read(m_fd, chunk, sizeof(chunk));
+        if (n < 0 && errno == EINTR) {
+          continue;
+        }
+        if (n <= 0) {
+          // 改行のない最後の行も 1 つの要求として扱う
+          if (m_buffer.empty()) {
+            return false;
+          }
+          line.swap(m_buffer);
+          m_buffer.clear();
+          return true;
+        }
+        m_buffer.append(chunk, static_cast<std::size_t>(n));
+      }
+    }
+  };
+
+  void writeAll(int fd, const std::string &text) {
+#  ifdef MSG_NOSIGNAL
+    constexpr int flags = MSG_NOSIGNAL;
+#  else
+    constexpr int flags = 0;
+#  endif
+    std::size_t sent = 0;
+    while (sent < text.size()) {
+      ssize_t n = ::send(fd, text.data() + sent, text.size() - sent, flags);
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n <= 0) {
+        return;
+      }
+      sent += static_cast<std::size_t>(n);
+    }
+  }
+
+  struct Connection {
+    int fd;
+    std::thread thread;
+    std::atomic<bool> finished{false};
+  };
+} // namespace
+
+void InferenceServer::serveSocket(const std::string &path, const std::atomic<bool> &stop) {
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(addr.sun_path)) {
+    throw std::runtime_error("socket path is too long: " + path);
+  }
+  std::copy(path.begin(), path.end(), addr.sun_path);
+
+  int listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listener < 0) {
+    throw std::runtime_error("socket() failed");
+  }
+  ::unlink(path.c_str());
+  if (::bind(listener, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr)) < 0 || ::listen(listener, 64) < 0) {
+    ::close(listener);
+    throw std::runtime_error("cannot listen on " + path);
+  }
+
+  std::list<Connection> connections;
+  auto reap = [&connections](bool all) {
+    for (auto it = connections.begin(); it != connections.end();) {
+      if (all || it->finished.load()) {
+        it->thread.join();
+        ::close(it->fd);
+        it = connections.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  };
+
+  while (!stop.load()) {
+    reap(false);
+    pollfd p{listener, POLLIN, 0};
+    if (::poll(&p, 1, 100) <= 0) {
+      continue;
+    }
+    int fd = ::accept(listener, nullptr, nullptr);
+    if (fd < 0) {
+      continue;
+    }
+    Connection &connection = connections.emplace_back();
+    connection.fd = fd;
+    connection.thread = std::thread([this, &connection]() {
+      serveLines(LineReader(connection.fd), [&connection](const std::string &line) {
+        writeAll(connection.fd, line + '\n');
+      });
+      connection.finished.store(true);
+    });
+  }
+
+  ::close(listener);
+  ::unlink(path.c_str());
+  // 読み込みを打ち切ると，各接続は受け付け済みの要求に応答してから終わる
+  for (auto &connection : connections) {
+    ::shutdown(connection.fd, SHUT_RD);
+  }
+  reap(true);
+}
+
+#else
+
+void InferenceServer::serveSocket(const std::string &path, const std::atomic<bool> &) {
+  throw std::runtime_error("Unix domain sockets are not supported on this platform: " + path);
+}
+
+#endif
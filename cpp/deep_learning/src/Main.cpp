@@ -1,25 +1,136 @@
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstring>
 #include <iostream>
+#include <random>
+#include <string>
+#include "deep_learning/BinaryNetwork.hpp"
+#include "deep_learning/InferenceServer.hpp"
 #include "deep_learning/SimplePerceptron.hpp"
 #include "math/Matrix.hpp"
 
 using namespace mywheels;
 using namespace std;
 
+namespace {
+  atomic<bool> g_stop{false};
+
+  void requestStop(int) {
+    g_stop.store(true);
+  }
+
+  // serve <model> [--socket path] [--max-batch N] [--max-latency-us N] [--workers N]
+  int serve(int argc, char *argv[]) {
+    if (argc < 3) {
+      cerr << "Usage: " << argv[0] << " serve <model> [--socket path] [--max-batch N] [--max-latency-us N]"
+           << " [--workers N]\n";
+      return 1;
+    }
+    ServerOptions options;
+    string socketPath;
+    for (int i = 3; i < argc; i++) {
+      if (i + 1 >= argc) {
+        cerr << "missing value for " << argv[i] << '\n';
+        return 1;
+      }
+      const char *value = argv[++i];
+      if (strcmp(argv[i - 1], "--socket") == 0) {
+        socketPath = value;
+      } else if (strcmp(argv[i - 1], "--max-batch") == 0) {
+        options.maxBatch = strtoul(value, nullptr, 10);
+      } else if (strcmp(argv[i - 1], "--max-latency-us") == 0) {
+        options.maxLatency = chrono::microseconds(strtoul(value, nullptr, 10));
+      } else if (strcmp(argv[i - 1], "--workers") == 0) {
+        options.workers = strtoul(value, nullptr, 10);
+      } else {
+        cerr << "unknown option " << argv[i - 1] << '\n';
+        return 1;
+      }
+    }
+
+    try {
+      DenseModel model = DenseModel::load(argv[2]);
+      InferenceServer server(model, options);
+      cerr << "model: " << model.inputs() << " -> " << model.outputs() << ", " << model.layers().size()
+           << " layers\n";
+      if (socketPath.empty()) {
+        server.serveStream(cin, cout);
+      } else {
+        signal(SIGINT, requestStop);
+        signal(SIGTERM, requestStop);
+        cerr << "listening on " << socketPath << '\n';
+        server.serveSocket(socketPath, g_stop);
+      }
+      server.shutdown();
+      cerr << server.stats() << '\n';
+    } catch (const exception &e) {
+      cerr << e.what() << '\n';
+      return 1;
+    }
+    return 0;
+  }
+
+  // ビットパックした 2 値ネットワークでゲートを評価し，SimplePerceptron と速さを比べる
+  void runBinaryNetwork() {
+    const pair<const char *, BinaryNetwork> gates[] = {{"OR", BinaryNetwork::OR()}, {"AND", BinaryNetwork::AND()},
+      {"NAND", BinaryNetwork::NAND()}, {"XOR", BinaryNetwork::XOR()}};
+    for (const auto &[name, net] : gates) {
+      cout << name << " Gate (" << net.layers().size() << " layers)\n";
+      cout << net({false, false})[0] << ' ' << net({false, true})[0] << ' ' << net({true, false})[0] << ' '
+           << net({true, true})[0] << '\n';
+    }
+
+    const size_t samples = size_t(1) << 22;
+    mt19937_64 rng(1);
+    BitPlanes x(2, samples);
+    for (size_t f = 0; f < 2; f++) {
+      for (size_t k = 0; k < x.stride(); k++) {
+        x.plane(f)[k] = rng();
+      }
+    }
+    BinaryNetwork xorNet = BinaryNetwork::XOR();
+
+    auto t0 = chrono::steady_clock::now();
+    BitPlanes y = xorNet.evaluate(x);
+    auto t1 = chrono::steady_clock::now();
+    size_t mismatches = 0;
+    for (size_t s = 0; s < samples; s++) {
+      float expected = SimplePerceptron::XOR({float(x.get(s, 0)), float(x.get(s, 1))});
+      mismatches += (y.get(s, 0) != (expected > 0.5f)) ? 1 : 0;
+    }
+    auto t2 = chrono::steady_clock::now();
+
+    double bitsliced = chrono::duration<double>(t1 - t0).count();
+    double perceptron = chrono::duration<double>(t2 - t1).count();
+    cout << "XOR over " << samples << " samples\n";
+    cout << "  BinaryNetwork:    " << bitsliced * 1e3 << " ms\n";
+    cout << "  SimplePerceptron: " << perceptron * 1e3 << " ms\n";
+    cout << "  mismatches: " << mismatches << '\n';
+  }
+} // namespace
+
 int main(int argc, char *argv[]) {
   if (argc == 1) {
     cout << "Usage: " << argv[0] << " <run_number> \n";
+    cout << "       " << argv[0] << " serve <model> [--socket path] [--max-batch N] [--max-latency-us N]"
+         << " [--workers N]\n";
     cout << "\n";
     cout << "run_number";
     cout << "   1: SimplePerceptron\n";
+    cout << "   2: BinaryNetwork\n";
     return 0;
   }
+  if (strcmp(argv[1], "serve") == 0) {
+    return serve(argc, argv);
+  }
   if (argc != 2) {
     return 1;
   }
 
   int arg = std::atoi(argv[1]);
   switch (arg) {
-  case 1:
+  case 1: {
     auto p = SimplePerceptron({0.5f, 0.5f}, -0.7f);
     cout << "SimplePerceptron\n";
     cout << p({0, 0}) << ' ' << p({0, 1}) << ' ' << p({1, 0}) << ' ' << p({1, 1}) << '\n';
@@ -35,6 +146,11 @@ int main(int argc, char *argv[]) {
     cout << "XOR Gate\n";
     cout << SimplePerceptron::XOR({0, 0}) << ' ' << SimplePerceptron::XOR({0, 1}) << ' '
          << SimplePerceptron::XOR({1, 0}) << ' ' << SimplePerceptron::XOR({1, 1}) << '\n';
+    break;
+  }
+  case 2:
+    runBinaryNetwork();
+    break;
   }
 
   return 0;
@@ -13,16 +13,36 @@ float SimplePerceptron::operator()(Vecf x) {
   }
 }
 
+const Vecf &SimplePerceptron::weights() const {
+  return w;
+}
+
+float SimplePerceptron::bias() const {
+  return b;
+}
+
+SimplePerceptron SimplePerceptron::orGate() {
+  return SimplePerceptron({0.5f, 0.5f}, -0.2f);
+}
+
+SimplePerceptron SimplePerceptron::andGate() {
+  return SimplePerceptron({0.5f, 0.5f}, -0.7f);
+}
+
+SimplePerceptron SimplePerceptron::nandGate() {
+  return SimplePerceptron({-0.5f, -0.5f}, 0.7f);
+}
+
 float SimplePerceptron::OR(Vecf x) {
-  return SimplePerceptron({0.5f, 0.5f}, -0.2f)(x);
+  return orGate()(x);
 }
 
 float SimplePerceptron::AND(Vecf x) {
-  return SimplePerceptron({0.5f, 0.5f}, -0.7f)(x);
+  return andGate()(x);
 }
 
 float SimplePerceptron::NAND(Vecf x) {
-  return SimplePerceptron({-0.5f, -0.5f}, 0.7f)(x);
+  return nandGate()(x);
 }
 
 float SimplePerceptron::XOR(Vecf x) {
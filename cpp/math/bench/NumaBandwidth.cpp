@@ -0,0 +1,83 @@
+// NUMA ノード間のメモリ帯域を測る．
+//   1. CPU のノードとメモリのノードの組ごとに，1 スレッドで読み出し (max) と書き込み (fill) の帯域を測る
+//   2. プール全体の axpy の帯域を，ページの置き場所 (first-touch, interleave, bind:0) ごとに比べる
+// 使い方: numa_bandwidth [MiB (既定 512)]．MYWHEELS_AFFINITY=compact などでワーカーを固定して実行する
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+#include "math/Numa.hpp"
+#include "math/ThreadPool.hpp"
+#include "math/Kernels.hpp"
+#include "math/Vector.hpp"
+
+using namespace mywheels;
+
+namespace {
+  // 読み出しの結果を捨てさせない
+  volatile double g_sink;
+
+  // fn を reps 回実行した中で最も短い時間 (秒)
+  template<typename F>
+  double best(int reps, const F &fn) {
+    double ret = 1e30;
+    for (int r = 0; r < reps; r++) {
+      auto t0 = std::chrono::steady_clock::now();
+      fn();
+      auto t1 = std::chrono::steady_clock::now();
+      ret = std::min(ret, std::chrono::duration<double>(t1 - t0).count());
+    }
+    return ret;
+  }
+
+  const char *placementName(numa::Placement policy) {
+    switch (policy) {
+    case numa::Placement::Interleave:
+      return "interleave";
+    case numa::Placement::Bind:
+      return "bind:0";
+    case numa::Placement::FirstTouch:
+    default:
+      return "first-touch";
+    }
+  }
+} // namespace
+
+int main(int argc, char **argv) {
+  std::size_t mib = (argc > 1) ? std::strtoul(argv[1], nullptr, 10) : 512;
+  std::size_t n = mib * (std::size_t(1) << 20) / sizeof(double);
+  double gib = static_cast<double>(n * sizeof(double)) / (1 << 30);
+  std::size_t nodes = numa::nodeCount();
+  std::printf("nodes: %zu, threads: %zu, buffer: %zu MiB\n", nodes, ThreadPool::global().size(), mib);
+
+  std::printf("\n[single thread] cpu node -> memory node: read GiB/s, write GiB/s\n");
+  for (std::size_t cpuNode = 0; cpuNode < nodes; cpuNode++) {
+    if (numa::nodeCpus(cpuNode).empty() || !numa::pinCurrentThread(numa::nodeCpus(cpuNode)[0])) {
+      continue;
+    }
+    for (std::size_t memNode = 0; memNode < nodes; memNode++) {
+      numa::setPlacement(numa::Placement::Bind, memNode);
+      Vecd x(n, 1.0, Execution::Sequential);
+      double read = best(3, [&]() {
+        g_sink = kernels::max(x.data(), n);
+      });
+      double write = best(3, [&]() {
+        kernels::fill(n, 2.0, x.data());
+      });
+      std::printf("  %zu -> %zu: %8.2f %8.2f\n", cpuNode, memNode, gib / read, gib / write);
+    }
+  }
+  numa::setPlacement(numa::Placement::FirstTouch);
+
+  // x, y, out の 3 本を読み書きする
+  std::printf("\n[all threads] axpy GiB/s by placement\n");
+  for (numa::Placement policy : {numa::Placement::FirstTouch, numa::Placement::Interleave, numa::Placement::Bind}) {
+    numa::setPlacement(policy, 0);
+    Vecd x(n, 1.0), y(n, 2.0);
+    double t = best(5, [&]() {
+      kernels::axpy(n, 0.5, x.data(), y.data(), y.data(), Execution::Parallel);
+    });
+    std::printf("  %-12s %8.2f\n", placementName(policy), 3 * gib / t);
+  }
+  numa::setPlacement(numa::Placement::FirstTouch);
+  return 0;
+}
@@ -0,0 +1,172 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <cassert>
+#include "math/Allocator.hpp"
+#include "math/ThreadPool.hpp"
+#include "math/Kernels.hpp"
+#include "math/Vector.hpp"
+#include "math/Matrix.hpp"
+
+namespace mywheels {
+  // 帯行列．下に lower 本，上に upper 本の副対角を持つ．
+  // 行 i は i - lower 列から lower + upper + 1 要素を連続に持ち，範囲外の列の分は 0 のまま使わない
+  template<typename Scalar>
+  class BandedMatrix {
+  private:
+    std::vector<Scalar, DefaultInitAllocator<Scalar>> m_values;
+    std::size_t m_rows;
+    std::size_t m_cols;
+    std::size_t m_lower;
+    std::size_t m_upper;
+
+    std::size_t width() const {
+      return m_lower + m_upper + 1;
+    }
+
+    static std::size_t rowGrain(std::size_t work) {
+      return std::max<std::size_t>(1, kDefaultGrain / std::max<std::size_t>(1, work));
+    }
+
+  public:
+    // 初期化
+
+    BandedMatrix(std::size_t rows, std::size_t cols, std::size_t lower, std::size_t upper) :
+      m_values(rows * (lower + upper + 1)), m_rows(rows), m_cols(cols), m_lower(lower), m_upper(upper) {
+      kernels::fill(m_values.size(), Scalar(0), m_values.data(), Execution::Auto);
+    };
+
+    // 密行列の帯の部分を取り出す
+    BandedMatrix(const Matrix<Scalar> &dense, std::size_t lower, std::size_t upper) :
+      BandedMatrix(dense.dim().first, dense.dim().second, lower, upper) {
+      for (std::size_t i = 0; i < m_rows; i++) {
+        for (std::size_t j = colBegin(i); j < colEnd(i); j++) {
+          (*this)(i, j) = dense(i, j);
+        }
+      }
+    }
+
+    // 要素の参照
+
+    std::pair<std::size_t, std::size_t> dim() const {
+      return {m_rows, m_cols};
+    }
+
+    std::size_t lower() const {
+      return m_lower;
+    }
+
+    std::size_t upper() const {
+      return m_upper;
+    }
+
+    // 行 i の帯に入る列の範囲 [colBegin(i), colEnd(i))
+    std::size_t colBegin(std::size_t i) const {
+      return (i > m_lower) ? i - m_lower : 0;
+    }
+
+    std::size_t colEnd(std::size_t i) const {
+      return std::min(m_cols, i + m_upper + 1);
+    }
+
+    // 行 i の colBegin(i) 列目の要素
+    const Scalar *row(std::size_t i) const {
+      return m_values.data() + i * width() + (colBegin(i) + m_lower - i);
+    }
+
+    static bool inBand(std::size_t i, std::size_t j, std::size_t lower, std::size_t upper) {
+      return j + lower >= i && j <= i + upper;
+    }
+
+    // 帯の中の要素だけ書き換えられる
+    Scalar &operator()(std::size_t i, std::size_t j) {
+      assert(i < m_rows && j < m_cols && inBand(i, j, m_lower, m_upper));
+      return m_values[i * width() + (j + m_lower - i)];
+    }
+
+    Scalar operator()(std::size_t i, std::size_t j) const {
+      assert(i < m_rows && j < m_cols);
+      return inBand(i, j, m_lower, m_upper) ? m_values[i * width() + (j + m_lower - i)] : Scalar(0);
+    }
+
+    Matrix<Scalar> toDense() const {
+      Matrix<Scalar> ret = Matrix<Scalar>::zero(m_rows, m_cols);
+      for (std::size_t i = 0; i < m_rows; i++) {
+        std::size_t b = colBegin(i), e = colEnd(i);
+        if (b < e) {
+          std::copy(row(i), row(i) + (e - b), ret.data() + i * m_cols + b);
+        }
+      }
+      return ret;
+    }
+
+    // 演算子
+
+    BandedMatrix &operator*=(const Scalar &r) {
+      kernels::scale(m_values.size(), m_values.data(), r, m_values.data(), Execution::Auto);
+      return *this;
+    }
+
+    friend Vector<Scalar> operator*(const BandedMatrix &l, const Vector<Scalar> &r) {
+      assert(l.m_cols == r.dim());
+      Vector<Scalar> ret(l.m_rows);
+      for (std::size_t i = 0; i < l.m_rows; i++) {
+        std::size_t b = l.colBegin(i), e = l.colEnd(i);
+        if (b < e) {
+          ret(i) = kernels::dot(l.row(i), r.data() + b, e - b);
+        }
+      }
+      return ret;
+    }
+
+    // 行 i は帯の中の r の行だけを使う．演算量は O(rows (lower + upper + 1) k)
+    friend Matrix<Scalar> operator*(const BandedMatrix &l, const Matrix<Scalar> &r) {
+      std::size_t n = r.dim().first, k = r.dim().second;
+      assert(l.m_cols == n);
+      Matrix<Scalar> ret = Matrix<Scalar>::zero(l.m_rows, k);
+      Scalar *c = ret.data();
+      std::size_t work = l.width() * k;
+      parallelFor(resolveExecution(Execution::Auto, l.m_rows * work), 0, l.m_rows,
+        [&](std::size_t first, std::size_t last) {
+          for (std::size_t i = first; i < last; i++) {
+            std::size_t b = l.colBegin(i), e = l.colEnd(i);
+            if (b < e) {
+              kernels::gemm(1, k, e - b, l.row(i), e - b, r.data() + b * k, k, c + i * k, k);
+            }
+          }
+        }, rowGrain(work));
+      return ret;
+    }
+
+    // l の行 i は r の各行 p を l(i, p) 倍して帯の列に足したもの
+    friend Matrix<Scalar> operator*(const Matrix<Scalar> &l, const BandedMatrix &r) {
+      std::size_t m = l.dim().first, n = l.dim().second;
+      assert(r.m_rows == n);
+      Matrix<Scalar> ret = Matrix<Scalar>::zero(m, r.m_cols);
+      const Scalar *a = l.data();
+      Scalar *c = ret.data();
+      std::size_t work = n * r.width();
+      parallelFor(resolveExecution(Execution::Auto, m * work), 0, m, [&](std::size_t first, std::size_t last) {
+        for (std::size_t i = first; i < last; i++) {
+          Scalar *ci = c + i * r.m_cols;
+          for (std::size_t p = 0; p < n; p++) {
+            std::size_t b = r.colBegin(p), e = r.colEnd(p);
+            if (b < e) {
+              kernels::axpy(e - b, a[i * n + p], r.row(p), ci + b, ci + b);
+            }
+          }
+        }
+      }, rowGrain(work));
+      return ret;
+    }
+
+    friend std::ostream &operator<<(std::ostream &os, const BandedMatrix &b) {
+      return os << b.toDense();
+    }
+  };
+
+  using Bandf = BandedMatrix<float>;
+  using Bandd = BandedMatrix<double>;
+} // namespace mywheels
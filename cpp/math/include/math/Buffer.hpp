@@ -0,0 +1,189 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <utility>
+#include <initializer_list>
+#include "math/Allocator.hpp"
+#include "math/ThreadPool.hpp"
+#include "math/Kernels.hpp"
+
+namespace mywheels {
+  // Matrix と Vector のコピーが格納領域を共有するか (コピーオンライト)．既定は無効で，コピーは要素を複製する．
+  // 初期値は環境変数 MYWHEELS_COPY_ON_WRITE (0, 1) で決める
+  bool copyOnWrite();
+  void setCopyOnWrite(bool enable);
+
+  namespace detail {
+    // 共有を始める時に参照カウント付きの領域を作る処理を直列にする
+    std::mutex &bufferShareMutex();
+  } // namespace detail
+
+  // 要素の格納領域．独占している間は std::vector と同じで，コピーすると初めて参照カウント付きの領域へ移して共有する．
+  // const でない参照を取る時に共有していれば，他に持ち主がいる時だけ複製する．
+  // 同じ Buffer を複数のスレッドから使えるのは const の参照 (コピー元にすることを含む) だけの時で，
+  // const でない参照を取るのは書き込みと同じく他のアクセスと同時に行わない．
+  // 領域を共有する別々の Buffer は，それぞれ別のスレッドから書き込んでよい．
+  // 共有を始める前に取った書き込み用のポインタは，共有後に書き込むと共有先にも見えるので使わない
+  template<typename T>
+  class Buffer {
+  public:
+    // Tensor と同じ格納の型．Tensor とは領域をそのまま受け渡す
+    using Storage = std::vector<T, DefaultInitAllocator<T>>;
+
+  private:
+    // 独占している要素．共有している間は空
+    mutable Storage m_owned;
+    // 共有している要素．独占している間は nullptr
+    mutable std::shared_ptr<Storage> m_storage;
+    T *m_data;
+    std::size_t m_size;
+
+    // r の領域を参照カウント付きにして返す．要素は動かないので r を読んでいる他のスレッドには影響しない
+    static std::shared_ptr<Storage> shareOf(const Buffer &r) {
+      std::lock_guard<std::mutex> lock(detail::bufferShareMutex());
+      if (!r.m_storage) {
+        r.m_storage = std::make_shared<Storage>(std::move(r.m_owned));
+      }
+      return r.m_storage;
+    }
+
+    // 共有をやめて独占する．他に持ち主がいれば複製し，いなければ領域を引き取る．
+    // 持ち主の数は共有を始める処理や他の持ち主の detach と排他して調べる
+    void detach() {
+      {
+        std::lock_guard<std::mutex> lock(detail::bufferShareMutex());
+        if (!m_storage) {
+          return;
+        }
+        if (m_storage.use_count() == 1) {
+          m_owned = std::move(*m_storage);
+          m_storage.reset();
+          m_data = m_owned.data();
+          return;
+        }
+      }
+      // 複製は排他の外で行う．まだ持ち主なので，他の持ち主が領域を引き取って書き込むことはない
+      Storage owned(m_size);
+      kernels::copy(m_size, m_data, owned.data(), Execution::Auto);
+      std::lock_guard<std::mutex> lock(detail::bufferShareMutex());
+      m_owned = std::move(owned);
+      m_storage.reset();
+      m_data = m_owned.data();
+    }
+
+    T *mutableData() {
+      if (m_storage) {
+        detach();
+      }
+      return m_data;
+    }
+
+  public:
+    // 初期化
+
+    // 要素は初期化しない
+    explicit Buffer(std::size_t n = 0) : m_owned(n), m_data(m_owned.data()), m_size(n) {};
+
+    Buffer(std::initializer_list<T> list) : m_owned(list), m_data(m_owned.data()), m_size(list.size()) {};
+
+    // 他と共有していない格納領域を引き取る
+    explicit Buffer(std::shared_ptr<Storage> storage) :
+      m_owned(std::move(*storage)), m_data(m_owned.data()), m_size(m_owned.size()) {};
+
+    Buffer(const Buffer &r) : m_storage(shareOf(r)), m_data(r.m_data), m_size(r.m_size) {};
+
+    Buffer(Buffer &&r) noexcept :
+      m_owned(std::move(r.m_owned)), m_storage(std::move(r.m_storage)), m_data(r.m_data), m_size(r.m_size) {
+      r.m_data = nullptr;
+      r.m_size = 0;
+    }
+
+    Buffer &operator=(const Buffer &r) {
+      if (this != &r) {
+        m_storage = shareOf(r);
+        m_owned = Storage();
+        m_data = r.m_data;
+        m_size = r.m_size;
+      }
+      return *this;
+    }
+
+    Buffer &operator=(Buffer &&r) noexcept {
+      if (this != &r) {
+        m_owned = std::move(r.m_owned);
+        m_storage = std::move(r.m_storage);
+        m_data = r.m_data;
+        m_size = r.m_size;
+        r.m_data = nullptr;
+        r.m_size = 0;
+      }
+      return *this;
+    }
+
+    // 共有しない複製
+    Buffer clone(Execution policy = Execution::Auto) const {
+      Buffer ret(m_size);
+      kernels::copy(m_size, m_data, ret.m_data, policy);
+      return ret;
+    }
+
+    // 他と共有していない格納領域を引き渡す．この Buffer は空になる
+    std::shared_ptr<Storage> release() {
+      mutableData();
+      m_data = nullptr;
+      m_size = 0;
+      return std::make_shared<Storage>(std::move(m_owned));
+    }
+
+    // 要素の参照．const でない参照は共有をやめる
+
+    T *data() {
+      return mutableData();
+    }
+
+    const T *data() const {
+      return m_data;
+    }
+
+    T *begin() {
+      return mutableData();
+    }
+
+    T *end() {
+      return mutableData() + m_size;
+    }
+
+    const T *begin() const {
+      return m_data;
+    }
+
+    const T *end() const {
+      return m_data + m_size;
+    }
+
+    T &operator[](std::size_t i) {
+      return mutableData()[i];
+    }
+
+    const T &operator[](std::size_t i) const {
+      return m_data[i];
+    }
+
+    std::size_t size() const {
+      return m_size;
+    }
+
+    // 他と格納領域を共有している．m_storage は他のスレッドが共有を始める時に書き換えるので排他して読む
+    bool shared() const {
+      std::lock_guard<std::mutex> lock(detail::bufferShareMutex());
+      return m_storage.use_count() > 1;
+    }
+
+    bool sharesStorage(const Buffer &r) const {
+      std::lock_guard<std::mutex> lock(detail::bufferShareMutex());
+      return m_storage && m_storage == r.m_storage;
+    }
+  };
+} // namespace mywheels
@@ -0,0 +1,36 @@
+#pragma once
+
+namespace mywheels {
+  // カーネルの命令セットの段階．大きいほど高速
+  enum class Isa {
+    Generic, // x86-64 のベースライン (SSE2) またはその他のアーキテクチャ
+    SSE42,   // SSE4.2 + POPCNT
+    AVX2,    // AVX2 + FMA
+    AVX512   // AVX-512 F/DQ/BW/VL + FMA
+  };
+
+  struct CpuFeatures {
+    bool sse42 = false;
+    bool popcnt = false;
+    bool avx = false;
+    bool avx2 = false;
+    bool fma = false;
+    bool avx512f = false;
+    bool avx512dq = false;
+    bool avx512bw = false;
+    bool avx512vl = false;
+    bool avx512vpopcntdq = false;
+  };
+
+  // 実行中の CPU と OS が対応する機能．初回呼び出し時に CPUID で検出する
+  const CpuFeatures &cpuFeatures();
+
+  // CPU が対応する最も高速な命令セット
+  Isa detectedIsa();
+
+  // 実際に使う命令セット．環境変数 MYWHEELS_ISA (generic, sse4.2, avx2, avx512) で
+  // 固定できるが，CPU が対応していない場合は detectedIsa() に切り詰める
+  Isa activeIsa();
+
+  const char *isaName(Isa isa);
+} // namespace mywheels
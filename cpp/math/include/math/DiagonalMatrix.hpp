@@ -0,0 +1,153 @@
+#pragma once
+
+#include <iostream>
+#include <algorithm>
+#include <cassert>
+#include "math/ThreadPool.hpp"
+#include "math/Kernels.hpp"
+#include "math/Vector.hpp"
+#include "math/Matrix.hpp"
+
+namespace mywheels {
+  // 対角行列．対角成分だけを持ち，密行列との積は O(n^2) の行や列のスケーリングになる
+  template<typename Scalar>
+  class DiagonalMatrix {
+  private:
+    Vector<Scalar> m_diag;
+
+  public:
+    // 初期化
+
+    explicit DiagonalMatrix(std::size_t dim, Scalar val = Scalar(0)) : m_diag(dim, val) {};
+
+    explicit DiagonalMatrix(Vector<Scalar> diag) : m_diag(std::move(diag)) {};
+
+    DiagonalMatrix(std::initializer_list<Scalar> list) : m_diag(list) {};
+
+    // 要素の参照
+
+    std::size_t dim() const {
+      return m_diag.dim();
+    }
+
+    Scalar &operator()(std::size_t i) {
+      return m_diag(i);
+    }
+
+    const Scalar &operator()(std::size_t i) const {
+      return m_diag(i);
+    }
+
+    Scalar operator()(std::size_t i, std::size_t j) const {
+      return (i == j) ? m_diag(i) : Scalar(0);
+    }
+
+    const Vector<Scalar> &diagonal() const {
+      return m_diag;
+    }
+
+    Matrix<Scalar> toDense() const {
+      Matrix<Scalar> ret = Matrix<Scalar>::zero(dim(), dim());
+      for (std::size_t i = 0; i < dim(); i++) {
+        ret(i, i) = m_diag(i);
+      }
+      return ret;
+    }
+
+    // 演算子
+
+    DiagonalMatrix &operator*=(const Scalar &r) {
+      m_diag *= r;
+      return *this;
+    }
+
+    friend DiagonalMatrix operator*(const DiagonalMatrix &l, const DiagonalMatrix &r) {
+      assert(l.dim() == r.dim());
+      DiagonalMatrix ret(l.dim());
+      kernels::mul(l.dim(), l.m_diag.data(), r.m_diag.data(), ret.m_diag.data());
+      return ret;
+    }
+
+    friend DiagonalMatrix operator+(const DiagonalMatrix &l, const DiagonalMatrix &r) {
+      return DiagonalMatrix(l.m_diag + r.m_diag);
+    }
+
+    friend Vector<Scalar> operator*(const DiagonalMatrix &l, const Vector<Scalar> &r) {
+      assert(l.dim() == r.dim());
+      Vector<Scalar> ret(r.dim());
+      kernels::mul(r.dim(), l.m_diag.data(), r.data(), ret.data(), Execution::Auto);
+      return ret;
+    }
+
+    // 行 i を d_i 倍する
+    friend Matrix<Scalar> operator*(const DiagonalMatrix &l, Matrix<Scalar> r) {
+      std::size_t rows = r.dim().first, cols = r.dim().second;
+      assert(l.dim() == rows);
+      Scalar *x = r.data();
+      const Scalar *d = l.m_diag.data();
+      std::size_t grain = std::max<std::size_t>(1, kDefaultGrain / std::max<std::size_t>(1, cols));
+      parallelFor(resolveExecution(Execution::Auto, r.size()), 0, rows, [=](std::size_t first, std::size_t last) {
+        for (std::size_t i = first; i < last; i++) {
+          kernels::scale(cols, x + i * cols, d[i], x + i * cols);
+        }
+      }, grain);
+      return r;
+    }
+
+    // 列 j を d_j 倍する
+    friend Matrix<Scalar> operator*(Matrix<Scalar> l, const DiagonalMatrix &r) {
+      std::size_t rows = l.dim().first, cols = l.dim().second;
+      assert(r.dim() == cols);
+      Scalar *x = l.data();
+      const Scalar *d = r.m_diag.data();
+      std::size_t grain = std::max<std::size_t>(1, kDefaultGrain / std::max<std::size_t>(1, cols));
+      parallelFor(resolveExecution(Execution::Auto, l.size()), 0, rows, [=](std::size_t first, std::size_t last) {
+        for (std::size_t i = first; i < last; i++) {
+          kernels::mul(cols, x + i * cols, d, x + i * cols);
+        }
+      }, grain);
+      return l;
+    }
+
+    friend Matrix<Scalar> operator+(const DiagonalMatrix &l, Matrix<Scalar> r) {
+      assert(r.dim().first == l.dim() && r.dim().second == l.dim());
+      for (std::size_t i = 0; i < l.dim(); i++) {
+        r(i, i) += l.m_diag(i);
+      }
+      return r;
+    }
+
+    friend Matrix<Scalar> operator+(Matrix<Scalar> l, const DiagonalMatrix &r) {
+      return r + std::move(l);
+    }
+
+    friend std::ostream &operator<<(std::ostream &os, const DiagonalMatrix &d) {
+      return os << d.toDense();
+    }
+
+    // 関数
+
+    // 対角成分がすべて 0 でないこと
+    DiagonalMatrix inverse() const {
+      DiagonalMatrix ret(dim());
+      for (std::size_t i = 0; i < dim(); i++) {
+        assert(m_diag(i) != Scalar(0));
+        ret.m_diag(i) = Scalar(1) / m_diag(i);
+      }
+      return ret;
+    }
+
+    friend Scalar tr(const DiagonalMatrix &d) {
+      return d.m_diag.sum();
+    }
+
+    // 定数
+
+    static DiagonalMatrix identity(std::size_t dim) {
+      return DiagonalMatrix(dim, Scalar(1));
+    }
+  };
+
+  using Diagf = DiagonalMatrix<float>;
+  using Diagd = DiagonalMatrix<double>;
+} // namespace mywheels
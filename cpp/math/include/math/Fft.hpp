@@ -0,0 +1,374 @@
+#pragma once
+
+#include <complex>
+#include <memory>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cassert>
+#include "math/ThreadPool.hpp"
+#include "math/Kernels.hpp"
+#include "math/Vector.hpp"
+#include "math/Matrix.hpp"
+
+namespace mywheels {
+  // 長さ n の複素 DFT X[k] = sum_j x[j] exp(-2πi jk / n) の計画．
+  // n を 4, 2, 3, 5, 7, 11, 13 の基数に分けて Stockham 法 (並べ替え不要) で計算し，
+  // それより大きな素因数を持つ n は Bluestein 法で長さ 2 のべきの巡回畳み込みに直す．
+  // 回転因子は計画を作る時に段ごとに並べておく．データは実部と虚部を別の配列に持ち，各段のループは命令セットごとに
+  // コンパイルしたものをカーネルの関数表と同じ命令セットで選ぶ
+  template<typename T>
+  class FftPlan {
+  public:
+    using Complex = std::complex<T>;
+
+  private:
+    // Stockham 法の 1 段．長さ length の列 stride 本を基数 radix で分ける
+    struct Pass {
+      std::size_t radix;
+      std::size_t length;
+      std::size_t stride;
+      std::size_t twiddle; // 回転因子 exp(-2πi jt / length) の m_twiddleRe/Im の中の位置
+      std::size_t root;    // cos(2πk / radix), sin(2πk / radix) の m_rootCos/Sin の中の位置
+    };
+
+    std::size_t m_n;
+    std::vector<Pass> m_passes;
+    std::vector<T> m_twiddleRe;
+    std::vector<T> m_twiddleIm;
+    std::vector<T> m_rootCos;
+    std::vector<T> m_rootSin;
+    // Bluestein 法で使う長さ 2 のべきの計画，chirp exp(-πi k^2 / n) と，畳み込む列の FFT を 1 / m 倍したもの
+    std::shared_ptr<const FftPlan> m_inner;
+    std::vector<T> m_chirpRe;
+    std::vector<T> m_chirpIm;
+    std::vector<T> m_filterRe;
+    std::vector<T> m_filterIm;
+
+    void stockham(T *re, T *im, T *scratch) const;
+    void bluestein(T *re, T *im, T *scratch) const;
+
+  public:
+    explicit FftPlan(std::size_t n);
+
+    // 長さ n の計画．一度作った計画は使い回す (スレッドセーフ)
+    static std::shared_ptr<const FftPlan> get(std::size_t n);
+
+    std::size_t size() const {
+      return m_n;
+    }
+
+    // transform に渡す作業領域の要素数
+    std::size_t scratchSize() const;
+
+    // 実部 re と虚部 im に分けて持つ列をその場で変換する．inverse なら exp(+2πi jk / n) で変換し，1 / n は掛けない
+    void transform(T *re, T *im, T *scratch, bool inverse = false) const;
+
+    // 交互に並んだ列の変換．inverse は 1 / n を掛ける．in と out は同じでもよい
+    void forward(const Complex *in, Complex *out) const;
+    void inverse(const Complex *in, Complex *out) const;
+  };
+
+  // 長さ n の実数列の DFT の前半 n / 2 + 1 項の計画．後半は前半の共役になる．
+  // n が偶数なら偶数番目と奇数番目を実部と虚部にした長さ n / 2 の複素 FFT 1 回と後処理で求める
+  template<typename T>
+  class RealFftPlan {
+  public:
+    using Complex = std::complex<T>;
+
+  private:
+    std::size_t m_n;
+    std::shared_ptr<const FftPlan<T>> m_plan;
+    // exp(-2πi k / n) (k <= n / 2)
+    std::vector<T> m_twiddleRe;
+    std::vector<T> m_twiddleIm;
+
+  public:
+    explicit RealFftPlan(std::size_t n);
+
+    static std::shared_ptr<const RealFftPlan> get(std::size_t n);
+
+    std::size_t size() const {
+      return m_n;
+    }
+
+    std::size_t scratchSize() const;
+
+    // in (n 要素) の DFT の前半 n / 2 + 1 項を out へ．scratch が nullptr なら作業領域を確保する
+    void forward(const T *in, Complex *out, T *scratch = nullptr) const;
+
+    // in (n / 2 + 1 項) を前半に持つ DFT を逆変換し，1 / n を掛けて out (n 要素) へ
+    void inverse(const Complex *in, T *out, T *scratch = nullptr) const;
+  };
+
+  extern template class FftPlan<float>;
+  extern template class FftPlan<double>;
+  extern template class RealFftPlan<float>;
+  extern template class RealFftPlan<double>;
+
+  // 2, 3, 5 以外の素因数を持たない n 以上の最小の偶数．FFT による畳み込みの長さに使う
+  std::size_t fftLength(std::size_t n);
+
+  namespace detail {
+    // 2 次元 FFT で一度に読み書きする列の数
+    constexpr std::size_t kFftColumnBlock = 16;
+
+    // 長さ n の変換 1 回の演算量の目安
+    inline std::size_t fftWork(std::size_t n) {
+      std::size_t lg = 1;
+      while ((std::size_t(1) << lg) < n) {
+        lg++;
+      }
+      return n * lg;
+    }
+
+    // 行優先 rows x cols の複素行列の各行をその場で変換する．inverse なら 1 / cols を掛ける
+    template<typename T>
+    void fftRows(std::size_t rows, std::size_t cols, std::complex<T> *x, bool inverse, Execution policy) {
+      if (rows == 0 || cols == 0) {
+        return;
+      }
+      auto plan = FftPlan<T>::get(cols);
+      std::size_t work = fftWork(cols);
+      std::size_t grain = std::max<std::size_t>(1, kDefaultGrain / work);
+      parallelFor(resolveExecution(policy, rows * work), 0, rows, [&](std::size_t first, std::size_t last) {
+        std::vector<T> buf(2 * cols + plan->scratchSize());
+        T *re = buf.data(), *im = re + cols, *scratch = im + cols;
+        T s = inverse ? T(1) / static_cast<T>(cols) : T(1);
+        for (std::size_t i = first; i < last; i++) {
+          std::complex<T> *row = x + i * cols;
+          for (std::size_t j = 0; j < cols; j++) {
+            re[j] = row[j].real();
+            im[j] = row[j].imag();
+          }
+          plan->transform(re, im, scratch, inverse);
+          for (std::size_t j = 0; j < cols; j++) {
+            row[j] = std::complex<T>(re[j] * s, im[j] * s);
+          }
+        }
+      }, grain);
+    }
+
+    // 各列をその場で変換する．kFftColumnBlock 列ずつまとめて読み書きする
+    template<typename T>
+    void fftColumns(std::size_t rows, std::size_t cols, std::complex<T> *x, bool inverse, Execution policy) {
+      if (rows == 0 || cols == 0) {
+        return;
+      }
+      auto plan = FftPlan<T>::get(rows);
+      std::size_t blocks = (cols + kFftColumnBlock - 1) / kFftColumnBlock;
+      std::size_t work = fftWork(rows) * kFftColumnBlock;
+      std::size_t grain = std::max<std::size_t>(1, kDefaultGrain / work);
+      parallelFor(resolveExecution(policy, rows * cols), 0, blocks, [&](std::size_t first, std::size_t last) {
+        std::vector<T> buf(2 * rows * kFftColumnBlock + plan->scratchSize());
+        T *re = buf.data(), *im = re + rows * kFftColumnBlock, *scratch = im + rows * kFftColumnBlock;
+        T s = inverse ? T(1) / static_cast<T>(rows) : T(1);
+        for (std::size_t block = first; block < last; block++) {
+          std::size_t j0 = block * kFftColumnBlock, w = std::min(kFftColumnBlock, cols - j0);
+          for (std::size_t i = 0; i < rows; i++) {
+            for (std::size_t j = 0; j < w; j++) {
+              re[j * rows + i] = x[i * cols + j0 + j].real();
+              im[j * rows + i] = x[i * cols + j0 + j].imag();
+            }
+          }
+          for (std::size_t j = 0; j < w; j++) {
+            plan->transform(re + j * rows, im + j * rows, scratch, inverse);
+          }
+          for (std::size_t i = 0; i < rows; i++) {
+            for (std::size_t j = 0; j < w; j++) {
+              x[i * cols + j0 + j] = std::complex<T>(re[j * rows + i] * s, im[j * rows + i] * s);
+            }
+          }
+        }
+      }, grain);
+    }
+
+    // 長さ n の x と長さ m の h の畳み込み (n + m - 1 要素) を 0 で初期化された out に足す．
+    // 出力を区間に分けて並列化し，区間ごとに h の各要素について axpy を 1 回ずつ呼ぶ
+    template<typename Scalar>
+    void convolveDirect(const Scalar *x, std::size_t n, const Scalar *h, std::size_t m, Scalar *out,
+      Execution policy) {
+      if (n < m) {
+        std::swap(x, h);
+        std::swap(n, m);
+      }
+      std::size_t len = n + m - 1;
+      std::size_t grain = std::max<std::size_t>(256, kDefaultGrain / m);
+      parallelFor(resolveExecution(policy, n * m), 0, len, [&](std::size_t first, std::size_t last) {
+        for (std::size_t j = 0; j < m; j++) {
+          std::size_t lo = std::max(first, j), hi = std::min(last, j + n);
+          if (lo < hi) {
+            kernels::axpy(hi - lo, h[j], x + (lo - j), out + lo, out + lo);
+          }
+        }
+      }, grain);
+    }
+
+    // 長さ fftLength(n + m - 1) の実数 FFT 2 回と逆変換 1 回で畳み込みを out へ書き込む
+    template<typename Scalar>
+    void convolveFft(const Scalar *x, std::size_t n, const Scalar *h, std::size_t m, Scalar *out) {
+      using Complex = std::complex<Scalar>;
+      std::size_t len = n + m - 1, size = fftLength(len);
+      auto plan = RealFftPlan<Scalar>::get(size);
+      std::vector<Scalar> buf(size), scratch(plan->scratchSize());
+      std::vector<Complex> fx(size / 2 + 1), fh(size / 2 + 1);
+      std::copy(x, x + n, buf.begin());
+      plan->forward(buf.data(), fx.data(), scratch.data());
+      std::fill(buf.begin(), buf.end(), Scalar(0));
+      std::copy(h, h + m, buf.begin());
+      plan->forward(buf.data(), fh.data(), scratch.data());
+      // std::complex の積は NaN の扱いのために遅い関数呼び出しになるので展開して書く
+      for (std::size_t k = 0; k < fx.size(); k++) {
+        Scalar ar = fx[k].real(), ai = fx[k].imag(), br = fh[k].real(), bi = fh[k].imag();
+        fx[k] = Complex(ar * br - ai * bi, ar * bi + ai * br);
+      }
+      plan->inverse(fx.data(), buf.data(), scratch.data());
+      std::copy(buf.begin(), buf.begin() + len, out);
+    }
+
+    // 短い方がこれ以下なら常に直接法を使う
+    constexpr std::size_t kDirectConvolutionLength = 64;
+    // FFT による畳み込みの演算量 size log2(size) に掛ける係数．直接法の積和 n m 回と比べる
+    constexpr double kFftConvolutionCost = 10.0;
+
+    inline bool preferFftConvolution(std::size_t n, std::size_t m) {
+      if (std::min(n, m) <= kDirectConvolutionLength) {
+        return false;
+      }
+      double size = static_cast<double>(fftLength(n + m - 1));
+      return static_cast<double>(n) * static_cast<double>(m) > kFftConvolutionCost * size * std::log2(size);
+    }
+  } // namespace detail
+
+  // 変換
+
+  template<typename Scalar>
+  std::vector<std::complex<Scalar>> fft(std::vector<std::complex<Scalar>> x) {
+    if (!x.empty()) {
+      FftPlan<Scalar>::get(x.size())->forward(x.data(), x.data());
+    }
+    return x;
+  }
+
+  // 逆変換．1 / n を掛ける
+  template<typename Scalar>
+  std::vector<std::complex<Scalar>> ifft(std::vector<std::complex<Scalar>> x) {
+    if (!x.empty()) {
+      FftPlan<Scalar>::get(x.size())->inverse(x.data(), x.data());
+    }
+    return x;
+  }
+
+  // 実数列の DFT の前半 n / 2 + 1 項
+  template<typename Scalar>
+  std::vector<std::complex<Scalar>> rfft(const Vector<Scalar> &x) {
+    assert(x.dim() > 0);
+    std::vector<std::complex<Scalar>> ret(x.dim() / 2 + 1);
+    RealFftPlan<Scalar>::get(x.dim())->forward(x.data(), ret.data());
+    return ret;
+  }
+
+  // rfft の逆変換．元の長さ n を指定する
+  template<typename Scalar>
+  Vector<Scalar> irfft(const std::vector<std::complex<Scalar>> &x, std::size_t n) {
+    assert(n > 0 && x.size() == n / 2 + 1);
+    Vector<Scalar> ret(n);
+    RealFftPlan<Scalar>::get(n)->inverse(x.data(), ret.data());
+    return ret;
+  }
+
+  // 2 次元 FFT．各行を変換した後に各列を変換する
+  template<typename Scalar>
+  Matrix<std::complex<Scalar>> fft2(Matrix<std::complex<Scalar>> x, Execution policy = Execution::Auto) {
+    auto [rows, cols] = x.dim();
+    detail::fftRows(rows, cols, x.data(), false, policy);
+    detail::fftColumns(rows, cols, x.data(), false, policy);
+    return x;
+  }
+
+  template<typename Scalar>
+  Matrix<std::complex<Scalar>> ifft2(Matrix<std::complex<Scalar>> x, Execution policy = Execution::Auto) {
+    auto [rows, cols] = x.dim();
+    detail::fftColumns(rows, cols, x.data(), true, policy);
+    detail::fftRows(rows, cols, x.data(), true, policy);
+    return x;
+  }
+
+  // 実行列の 2 次元 FFT の左半分 rows x (cols / 2 + 1)．各行を実数 FFT で変換してから各列を変換する
+  template<typename Scalar>
+  Matrix<std::complex<Scalar>> rfft2(const Matrix<Scalar> &x, Execution policy = Execution::Auto) {
+    std::size_t rows = x.dim().first, cols = x.dim().second;
+    assert(cols > 0);
+    std::size_t half = cols / 2 + 1;
+    Matrix<std::complex<Scalar>> ret(rows, half);
+    auto plan = RealFftPlan<Scalar>::get(cols);
+    std::size_t work = detail::fftWork(cols);
+    std::complex<Scalar> *out = ret.data();
+    parallelFor(resolveExecution(policy, rows * work), 0, rows, [&](std::size_t first, std::size_t last) {
+      std::vector<Scalar> scratch(plan->scratchSize());
+      for (std::size_t i = first; i < last; i++) {
+        plan->forward(x.data() + i * cols, out + i * half, scratch.data());
+      }
+    }, std::max<std::size_t>(1, kDefaultGrain / work));
+    detail::fftColumns(rows, half, out, false, policy);
+    return ret;
+  }
+
+  // rfft2 の逆変換．元の列数 cols を指定する
+  template<typename Scalar>
+  Matrix<Scalar> irfft2(Matrix<std::complex<Scalar>> x, std::size_t cols, Execution policy = Execution::Auto) {
+    std::size_t rows = x.dim().first, half = x.dim().second;
+    assert(cols > 0 && half == cols / 2 + 1);
+    std::complex<Scalar> *in = x.data();
+    detail::fftColumns(rows, half, in, true, policy);
+    Matrix<Scalar> ret(rows, cols);
+    Scalar *out = ret.data();
+    auto plan = RealFftPlan<Scalar>::get(cols);
+    std::size_t work = detail::fftWork(cols);
+    parallelFor(resolveExecution(policy, rows * work), 0, rows, [&](std::size_t first, std::size_t last) {
+      std::vector<Scalar> scratch(plan->scratchSize());
+      for (std::size_t i = first; i < last; i++) {
+        plan->inverse(in + i * half, out + i * cols, scratch.data());
+      }
+    }, std::max<std::size_t>(1, kDefaultGrain / work));
+    return ret;
+  }
+
+  // 畳み込み
+
+  enum class ConvolutionMethod {
+    Auto,   // 長さから演算量の少ない方を選ぶ
+    Direct, // O(n m) の直接法
+    Fft     // O((n + m) log(n + m)) の FFT．誤差は最大の要素の大きさに比例する
+  };
+
+  // 長さ n + m - 1 の畳み込み (x * h)[k] = sum_j x[k - j] h[j]
+  template<typename Scalar>
+  Vector<Scalar> convolve(const Vector<Scalar> &x, const Vector<Scalar> &h,
+    ConvolutionMethod method = ConvolutionMethod::Auto, Execution policy = Execution::Auto) {
+    std::size_t n = x.dim(), m = h.dim();
+    if (n == 0 || m == 0) {
+      return Vector<Scalar>(std::size_t(0));
+    }
+    if (method == ConvolutionMethod::Auto) {
+      method = detail::preferFftConvolution(n, m) ? ConvolutionMethod::Fft : ConvolutionMethod::Direct;
+    }
+    if (method == ConvolutionMethod::Fft) {
+      Vector<Scalar> ret(n + m - 1);
+      detail::convolveFft(x.data(), n, h.data(), m, ret.data());
+      return ret;
+    }
+    Vector<Scalar> ret = Vector<Scalar>::zero(n + m - 1);
+    detail::convolveDirect(x.data(), n, h.data(), m, ret.data(), policy);
+    return ret;
+  }
+
+  // 長さ n + m - 1 の相互相関 r[k] = sum_j x[k + j - (m - 1)] h[j]．r[m - 1] がずれ 0 にあたる
+  template<typename Scalar>
+  Vector<Scalar> correlate(const Vector<Scalar> &x, const Vector<Scalar> &h,
+    ConvolutionMethod method = ConvolutionMethod::Auto, Execution policy = Execution::Auto) {
+    Vector<Scalar> reversed(h.dim());
+    std::reverse_copy(h.begin(), h.end(), reversed.begin());
+    return convolve(x, reversed, method, policy);
+  }
+} // namespace mywheels
@@ -13,6 +13,23 @@ namespace mywheels {
   float exp(float x);
   double exp(double x);
 
+  // 自然数乗．繰り返し二乗法をコンパイル時に展開する
+  template<unsigned int P, typename T>
+  constexpr T ipow(T x) {
+    if constexpr (P == 0) {
+      return T(1);
+    } else if constexpr (P == 1) {
+      return x;
+    } else {
+      T h = ipow<P / 2>(x);
+      if constexpr (P % 2 == 0) {
+        return h * h;
+      } else {
+        return h * h * x;
+      }
+    }
+  }
+
   template<typename T>
   T sigmoid(T x) {
     return 1 / (1 + exp(-x));
@@ -0,0 +1,512 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <type_traits>
+#include "math/Cpu.hpp"
+#include "math/Function.hpp"
+#include "math/Reduction.hpp"
+#include "math/ThreadPool.hpp"
+
+namespace mywheels {
+  namespace kernels {
+    // 命令セットごとにコンパイルされたカーネルの関数表
+    template<typename T>
+    struct Table {
+      Isa isa;
+      // c[m x n] += a[m x k] * b[k x n]．いずれも行優先で，各行の先頭の間隔が lda, ldb, ldc
+      void (*gemm)(std::size_t m, std::size_t n, std::size_t k, const T *a, std::size_t lda, const T *b,
+        std::size_t ldb, T *c, std::size_t ldc);
+      // c[m x n] += t(a) * b．a は k x m
+      void (*gemmTN)(std::size_t m, std::size_t n, std::size_t k, const T *a, std::size_t lda, const T *b,
+        std::size_t ldb, T *c, std::size_t ldc);
+      // c[m x n] += a * t(b)．b は n x k
+      void (*gemmNT)(std::size_t m, std::size_t n, std::size_t k, const T *a, std::size_t lda, const T *b,
+        std::size_t ldb, T *c, std::size_t ldc);
+      T (*sum)(std::size_t n, const T *x, Summation method);
+      T (*dot)(std::size_t n, const T *x, const T *y, Summation method);
+      void (*add)(std::size_t n, const T *x, const T *y, T *out);
+      void (*sub)(std::size_t n, const T *x, const T *y, T *out);
+      void (*mul)(std::size_t n, const T *x, const T *y, T *out);
+      void (*scale)(std::size_t n, const T *x, T s, T *out);
+      void (*div)(std::size_t n, const T *x, T s, T *out);
+      // out = x * y + z
+      void (*fma)(std::size_t n, const T *x, const T *y, const T *z, T *out);
+      // out = x * y - z
+      void (*fms)(std::size_t n, const T *x, const T *y, const T *z, T *out);
+      // out = a * x + y
+      void (*axpy)(std::size_t n, T a, const T *x, const T *y, T *out);
+      // out = x / y
+      void (*quot)(std::size_t n, const T *x, const T *y, T *out);
+      void (*sqrt)(std::size_t n, const T *x, T *out);
+      void (*exp)(std::size_t n, const T *x, T *out);
+      void (*sigmoid)(std::size_t n, const T *x, T *out);
+      void (*lamp)(std::size_t n, const T *x, T *out);
+      T (*max)(std::size_t n, const T *x);
+      // out = exp(x - shift) を書き込み (out が nullptr なら書き込まず)，その総和を返す
+      T (*expSum)(std::size_t n, const T *x, T shift, T *out);
+    };
+
+    // 関数表が用意されている型
+    template<typename T>
+    constexpr bool kDispatched = std::is_same_v<T, float> || std::is_same_v<T, double>;
+
+    // これより短い配列は関数表を引かずにその場で計算する
+    constexpr std::size_t kDispatchThreshold = 32;
+
+    // activeIsa() に従って選ばれた関数表
+    template<typename T>
+    const Table<T> &table();
+
+    template<>
+    const Table<float> &table<float>();
+
+    template<>
+    const Table<double> &table<double>();
+
+    // 関数表を指定した命令セットのものへ差し替える (ベンチマーク用)．
+    // CPU が対応していない場合は detectedIsa() に切り詰め，実際に選ばれた命令セットを返す
+    Isa useIsa(Isa isa);
+
+    // Execution::Auto で gemm を並列化する最小の積和回数
+    constexpr std::size_t kGemmParallelThreshold = std::size_t(1) << 21;
+
+    namespace detail {
+      template<typename T>
+      void gemm(std::size_t m, std::size_t n, std::size_t k, const T *a, std::size_t lda, const T *b,
+        std::size_t ldb, T *c, std::size_t ldc) {
+        if constexpr (kDispatched<T>) {
+          table<T>().gemm(m, n, k, a, lda, b, ldb, c, ldc);
+        } else {
+          for (std::size_t i = 0; i < m; i++) {
+            for (std::size_t p = 0; p < k; p++) {
+              const T &aip = a[i * lda + p];
+              for (std::size_t j = 0; j < n; j++) {
+                c[i * ldc + j] += aip * b[p * ldb + j];
+              }
+            }
+          }
+        }
+      }
+
+      template<typename T>
+      void gemmTN(std::size_t m, std::size_t n, std::size_t k, const T *a, std::size_t lda, const T *b,
+        std::size_t ldb, T *c, std::size_t ldc) {
+        if constexpr (kDispatched<T>) {
+          table<T>().gemmTN(m, n, k, a, lda, b, ldb, c, ldc);
+        } else {
+          for (std::size_t i = 0; i < m; i++) {
+            for (std::size_t p = 0; p < k; p++) {
+              const T &api = a[p * lda + i];
+              for (std::size_t j = 0; j < n; j++) {
+                c[i * ldc + j] += api * b[p * ldb + j];
+              }
+            }
+          }
+        }
+      }
+
+      template<typename T>
+      void gemmNT(std::size_t m, std::size_t n, std::size_t k, const T *a, std::size_t lda, const T *b,
+        std::size_t ldb, T *c, std::size_t ldc) {
+        if constexpr (kDispatched<T>) {
+          table<T>().gemmNT(m, n, k, a, lda, b, ldb, c, ldc);
+        } else {
+          for (std::size_t i = 0; i < m; i++) {
+            for (std::size_t j = 0; j < n; j++) {
+              T s = T(0);
+              for (std::size_t p = 0; p < k; p++) {
+                s += a[i * lda + p] * b[j * ldb + p];
+              }
+              c[i * ldc + j] += s;
+            }
+          }
+        }
+      }
+
+      template<typename T>
+      void add(std::size_t n, const T *x, const T *y, T *out) {
+        if constexpr (kDispatched<T>) {
+          if (n >= kDispatchThreshold) {
+            table<T>().add(n, x, y, out);
+            return;
+          }
+        }
+        for (std::size_t i = 0; i < n; i++) {
+          out[i] = x[i] + y[i];
+        }
+      }
+
+      template<typename T>
+      void sub(std::size_t n, const T *x, const T *y, T *out) {
+        if constexpr (kDispatched<T>) {
+          if (n >= kDispatchThreshold) {
+            table<T>().sub(n, x, y, out);
+            return;
+          }
+        }
+        for (std::size_t i = 0; i < n; i++) {
+          out[i] = x[i] - y[i];
+        }
+      }
+
+      template<typename T>
+      void mul(std::size_t n, const T *x, const T *y, T *out) {
+        if constexpr (kDispatched<T>) {
+          if (n >= kDispatchThreshold) {
+            table<T>().mul(n, x, y, out);
+            return;
+          }
+        }
+        for (std::size_t i = 0; i < n; i++) {
+          out[i] = x[i] * y[i];
+        }
+      }
+
+      template<typename T>
+      void scale(std::size_t n, const T *x, const T &s, T *out) {
+        if constexpr (kDispatched<T>) {
+          if (n >= kDispatchThreshold) {
+            table<T>().scale(n, x, s, out);
+            return;
+          }
+        }
+        for (std::size_t i = 0; i < n; i++) {
+          out[i] = x[i] * s;
+        }
+      }
+
+      template<typename T>
+      void div(std::size_t n, const T *x, const T &s, T *out) {
+        if constexpr (kDispatched<T>) {
+          if (n >= kDispatchThreshold) {
+            table<T>().div(n, x, s, out);
+            return;
+          }
+        }
+        for (std::size_t i = 0; i < n; i++) {
+          out[i] = x[i] / s;
+        }
+      }
+
+      template<typename T>
+      void fma(std::size_t n, const T *x, const T *y, const T *z, T *out) {
+        if constexpr (kDispatched<T>) {
+          if (n >= kDispatchThreshold) {
+            table<T>().fma(n, x, y, z, out);
+            return;
+          }
+        }
+        for (std::size_t i = 0; i < n; i++) {
+          out[i] = x[i] * y[i] + z[i];
+        }
+      }
+
+      template<typename T>
+      void fms(std::size_t n, const T *x, const T *y, const T *z, T *out) {
+        if constexpr (kDispatched<T>) {
+          if (n >= kDispatchThreshold) {
+            table<T>().fms(n, x, y, z, out);
+            return;
+          }
+        }
+        for (std::size_t i = 0; i < n; i++) {
+          out[i] = x[i] * y[i] - z[i];
+        }
+      }
+
+      template<typename T>
+      void axpy(std::size_t n, const T &a, const T *x, const T *y, T *out) {
+        if constexpr (kDispatched<T>) {
+          if (n >= kDispatchThreshold) {
+            table<T>().axpy(n, a, x, y, out);
+            return;
+          }
+        }
+        for (std::size_t i = 0; i < n; i++) {
+          out[i] = a * x[i] + y[i];
+        }
+      }
+
+      template<typename T>
+      void quot(std::size_t n, const T *x, const T *y, T *out) {
+        if constexpr (kDispatched<T>) {
+          if (n >= kDispatchThreshold) {
+            table<T>().quot(n, x, y, out);
+            return;
+          }
+        }
+        for (std::size_t i = 0; i < n; i++) {
+          out[i] = x[i] / y[i];
+        }
+      }
+
+      template<typename T>
+      void sqrt(std::size_t n, const T *x, T *out) {
+        if constexpr (kDispatched<T>) {
+          if (n >= kDispatchThreshold) {
+            table<T>().sqrt(n, x, out);
+            return;
+          }
+        }
+        for (std::size_t i = 0; i < n; i++) {
+          out[i] = mywheels::sqrt(x[i]);
+        }
+      }
+
+      template<typename T>
+      void exp(std::size_t n, const T *x, T *out) {
+        if constexpr (kDispatched<T>) {
+          table<T>().exp(n, x, out);
+        } else {
+          for (std::size_t i = 0; i < n; i++) {
+            out[i] = mywheels::exp(x[i]);
+          }
+        }
+      }
+
+      template<typename T>
+      void sigmoid(std::size_t n, const T *x, T *out) {
+        if constexpr (kDispatched<T>) {
+          table<T>().sigmoid(n, x, out);
+        } else {
+          for (std::size_t i = 0; i < n; i++) {
+            out[i] = mywheels::sigmoid(x[i]);
+          }
+        }
+      }
+
+      template<typename T>
+      void lamp(std::size_t n, const T *x, T *out) {
+        if constexpr (kDispatched<T>) {
+          if (n >= kDispatchThreshold) {
+            table<T>().lamp(n, x, out);
+            return;
+          }
+        }
+        for (std::size_t i = 0; i < n; i++) {
+          out[i] = mywheels::lamp(x[i]);
+        }
+      }
+
+      template<typename T>
+      T max(const T *x, std::size_t n) {
+        if constexpr (kDispatched<T>) {
+          if (n >= kDispatchThreshold) {
+            return table<T>().max(n, x);
+          }
+        }
+        T ret = x[0];
+        for (std::size_t i = 1; i < n; i++) {
+          ret = std::max(ret, x[i]);
+        }
+        return ret;
+      }
+
+      template<typename T>
+      T expSum(std::size_t n, const T *x, const T &shift, T *out) {
+        if constexpr (kDispatched<T>) {
+          return table<T>().expSum(n, x, shift, out);
+        } else {
+          T ret = T(0);
+          for (std::size_t i = 0; i < n; i++) {
+            T e = mywheels::exp(x[i] - shift);
+            if (out != nullptr) {
+              out[i] = e;
+            }
+            ret += e;
+          }
+          return ret;
+        }
+      }
+    } // namespace detail
+
+    namespace detail {
+      // c の行のブロックごとに kernel(rows, first) を並列に呼ぶ
+      template<typename F>
+      void forGemmRows(std::size_t m, std::size_t n, std::size_t k, Execution policy, const F &kernel) {
+        std::size_t threads = ThreadPool::global().size();
+        if (policy == Execution::Sequential || threads <= 1 || m < 8
+            || (policy == Execution::Auto && m * n * k < kGemmParallelThreshold)) {
+          kernel(m, std::size_t(0));
+          return;
+        }
+        std::size_t grain = std::max<std::size_t>(4, (m / (4 * threads) + 3) / 4 * 4);
+        parallelFor(0, m, [&](std::size_t first, std::size_t last) {
+          kernel(last - first, first);
+        }, grain);
+      }
+    } // namespace detail
+
+    template<typename T>
+    void gemm(std::size_t m, std::size_t n, std::size_t k, const T *a, std::size_t lda, const T *b, std::size_t ldb,
+      T *c, std::size_t ldc, Execution policy = Execution::Sequential) {
+      detail::forGemmRows(m, n, k, policy, [=](std::size_t rows, std::size_t first) {
+        detail::gemm(rows, n, k, a + first * lda, lda, b, ldb, c + first * ldc, ldc);
+      });
+    }
+
+    // c[m x n] += t(a) * b．a は k x m の行優先
+    template<typename T>
+    void gemmTN(std::size_t m, std::size_t n, std::size_t k, const T *a, std::size_t lda, const T *b,
+      std::size_t ldb, T *c, std::size_t ldc, Execution policy = Execution::Sequential) {
+      detail::forGemmRows(m, n, k, policy, [=](std::size_t rows, std::size_t first) {
+        detail::gemmTN(rows, n, k, a + first, lda, b, ldb, c + first * ldc, ldc);
+      });
+    }
+
+    // c[m x n] += a * t(b)．b は n x k の行優先
+    template<typename T>
+    void gemmNT(std::size_t m, std::size_t n, std::size_t k, const T *a, std::size_t lda, const T *b,
+      std::size_t ldb, T *c, std::size_t ldc, Execution policy = Execution::Sequential) {
+      detail::forGemmRows(m, n, k, policy, [=](std::size_t rows, std::size_t first) {
+        detail::gemmNT(rows, n, k, a + first * lda, lda, b, ldb, c + first * ldc, ldc);
+      });
+    }
+
+    template<typename T>
+    T sum(const T *x, std::size_t n, Summation method = Summation::Pairwise) {
+      if constexpr (kDispatched<T>) {
+        if (n >= kDispatchThreshold) {
+          return reduction::chunkedSum<T>(n, [&](std::size_t first, std::size_t last) {
+            return table<T>().sum(last - first, x + first, method);
+          });
+        }
+      }
+      return reduction::sum(x, n, method);
+    }
+
+    template<typename T>
+    T dot(const T *x, const T *y, std::size_t n, Summation method = Summation::Pairwise) {
+      if constexpr (kDispatched<T>) {
+        if (n >= kDispatchThreshold) {
+          return reduction::chunkedSum<T>(n, [&](std::size_t first, std::size_t last) {
+            return table<T>().dot(last - first, x + first, y + first, method);
+          });
+        }
+      }
+      return reduction::dot(x, y, n, method);
+    }
+
+    template<typename T>
+    void add(std::size_t n, const T *x, const T *y, T *out, Execution policy = Execution::Sequential) {
+      parallelFor(policy, 0, n, [=](std::size_t first, std::size_t last) {
+        detail::add(last - first, x + first, y + first, out + first);
+      });
+    }
+
+    template<typename T>
+    void sub(std::size_t n, const T *x, const T *y, T *out, Execution policy = Execution::Sequential) {
+      parallelFor(policy, 0, n, [=](std::size_t first, std::size_t last) {
+        detail::sub(last - first, x + first, y + first, out + first);
+      });
+    }
+
+    // 要素ごとの積
+    template<typename T>
+    void mul(std::size_t n, const T *x, const T *y, T *out, Execution policy = Execution::Sequential) {
+      parallelFor(policy, 0, n, [=](std::size_t first, std::size_t last) {
+        detail::mul(last - first, x + first, y + first, out + first);
+      });
+    }
+
+    template<typename T>
+    void scale(std::size_t n, const T *x, const T &s, T *out, Execution policy = Execution::Sequential) {
+      parallelFor(policy, 0, n, [=, &s](std::size_t first, std::size_t last) {
+        detail::scale(last - first, x + first, s, out + first);
+      });
+    }
+
+    template<typename T>
+    void div(std::size_t n, const T *x, const T &s, T *out, Execution policy = Execution::Sequential) {
+      parallelFor(policy, 0, n, [=, &s](std::size_t first, std::size_t last) {
+        detail::div(last - first, x + first, s, out + first);
+      });
+    }
+
+    template<typename T>
+    void fma(std::size_t n, const T *x, const T *y, const T *z, T *out, Execution policy = Execution::Sequential) {
+      parallelFor(policy, 0, n, [=](std::size_t first, std::size_t last) {
+        detail::fma(last - first, x + first, y + first, z + first, out + first);
+      });
+    }
+
+    template<typename T>
+    void fms(std::size_t n, const T *x, const T *y, const T *z, T *out, Execution policy = Execution::Sequential) {
+      parallelFor(policy, 0, n, [=](std::size_t first, std::size_t last) {
+        detail::fms(last - first, x + first, y + first, z + first, out + first);
+      });
+    }
+
+    template<typename T>
+    void axpy(std::size_t n, const T &a, const T *x, const T *y, T *out, Execution policy = Execution::Sequential) {
+      parallelFor(policy, 0, n, [=, &a](std::size_t first, std::size_t last) {
+        detail::axpy(last - first, a, x + first, y + first, out + first);
+      });
+    }
+
+    template<typename T>
+    void quot(std::size_t n, const T *x, const T *y, T *out, Execution policy = Execution::Sequential) {
+      parallelFor(policy, 0, n, [=](std::size_t first, std::size_t last) {
+        detail::quot(last - first, x + first, y + first, out + first);
+      });
+    }
+
+    template<typename T>
+    void sqrt(std::size_t n, const T *x, T *out, Execution policy = Execution::Sequential) {
+      parallelFor(policy, 0, n, [=](std::size_t first, std::size_t last) {
+        detail::sqrt(last - first, x + first, out + first);
+      });
+    }
+
+    template<typename T>
+    void exp(std::size_t n, const T *x, T *out, Execution policy = Execution::Sequential) {
+      parallelFor(policy, 0, n, [=](std::size_t first, std::size_t last) {
+        detail::exp(last - first, x + first, out + first);
+      });
+    }
+
+    template<typename T>
+    void sigmoid(std::size_t n, const T *x, T *out, Execution policy = Execution::Sequential) {
+      parallelFor(policy, 0, n, [=](std::size_t first, std::size_t last) {
+        detail::sigmoid(last - first, x + first, out + first);
+      });
+    }
+
+    template<typename T>
+    void lamp(std::size_t n, const T *x, T *out, Execution policy = Execution::Sequential) {
+      parallelFor(policy, 0, n, [=](std::size_t first, std::size_t last) {
+        detail::lamp(last - first, x + first, out + first);
+      });
+    }
+
+    // 最大値．n > 0 であること
+    template<typename T>
+    T max(const T *x, std::size_t n) {
+      assert(n > 0);
+      return detail::max(x, n);
+    }
+
+    // exp(x - shift) の総和．out が nullptr でなければ各要素の値も書き込む (x と同じ配列でもよい)．
+    // shift に最大値を与えるとオーバーフローしない
+    template<typename T>
+    T expSum(std::size_t n, const T *x, const T &shift, T *out = nullptr) {
+      return detail::expSum(n, x, shift, out);
+    }
+
+    template<typename T>
+    void copy(std::size_t n, const T *x, T *out, Execution policy = Execution::Sequential) {
+      parallelFor(policy, 0, n, [=](std::size_t first, std::size_t last) {
+        std::copy(x + first, x + last, out + first);
+      });
+    }
+
+    template<typename T>
+    void fill(std::size_t n, const T &val, T *out, Execution policy = Execution::Sequential) {
+      parallelFor(policy, 0, n, [=, &val](std::size_t first, std::size_t last) {
+        std::fill(out + first, out + last, val);
+      });
+    }
+  } // namespace kernels
+} // namespace mywheels
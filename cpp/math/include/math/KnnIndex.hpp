@@ -0,0 +1,226 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cassert>
+#include "math/ThreadPool.hpp"
+#include "math/Kernels.hpp"
+#include "math/Vector.hpp"
+#include "math/Matrix.hpp"
+
+namespace mywheels {
+  // 近傍探索の距離．いずれも小さいほど近い
+  enum class Metric {
+    L2,          // ユークリッド距離の二乗 ||q - x||^2
+    Cosine,      // 1 - cos(q, x)
+    InnerProduct // -q.x (内積が大きいほど近い)
+  };
+
+  // 行ごとに 1 つの点を持つ全探索の k 近傍探索．
+  // 距離は ||q||^2 + ||x||^2 - 2 q.x として q.x をタイルごとに gemmNT でまとめて求め，
+  // タイルを読み終えるたびにクエリごとの大きさ k のヒープへ入れるので，距離の行列全体は持たない
+  template<typename Scalar>
+  class KnnIndex {
+  public:
+    struct Neighbor {
+      std::size_t index;
+      Scalar distance;
+
+      friend bool operator<(const Neighbor &l, const Neighbor &r) {
+        return (l.distance < r.distance) || (l.distance == r.distance && l.index < r.index);
+      }
+    };
+
+  private:
+    // 1 つのタスクで扱うクエリの行数
+    static constexpr std::size_t kQueryTile = 64;
+    // データのタイルを L2 に収める大きさ (バイト)
+    static constexpr std::size_t kDataTileBytes = std::size_t(1) << 18;
+
+    Matrix<Scalar> m_data;
+    // L2 では各点のノルムの二乗，Cosine ではノルムの逆数．InnerProduct では使わない
+    std::vector<Scalar> m_norms;
+    Metric m_metric;
+
+    // 行 first 以降の点の m_norms を求める
+    void computeNorms(std::size_t first) {
+      std::size_t n = m_data.dim().first, d = m_data.dim().second;
+      m_norms.resize(n);
+      const Scalar *x = m_data.data();
+      rowNorms(x + first * d, n - first, d, m_metric, m_norms.data() + first);
+    }
+
+    static void rowNorms(const Scalar *x, std::size_t rows, std::size_t d, Metric metric, Scalar *out) {
+      if (metric == Metric::InnerProduct) {
+        return;
+      }
+      std::size_t grain = std::max<std::size_t>(1, kDefaultGrain / std::max<std::size_t>(1, d));
+      parallelFor(resolveExecution(Execution::Auto, rows * d), 0, rows, [=](std::size_t first, std::size_t last) {
+        for (std::size_t i = first; i < last; i++) {
+          Scalar s = kernels::dot(x + i * d, x + i * d, d);
+          out[i] = (metric == Metric::L2) ? s : (s > Scalar(0) ? Scalar(1) / std::sqrt(s) : Scalar(0));
+        }
+      }, grain);
+    }
+
+    std::size_t dataTile() const {
+      std::size_t d = std::max<std::size_t>(1, m_data.dim().second);
+      return std::max<std::size_t>(64, kDataTileBytes / (d * sizeof(Scalar)));
+    }
+
+    // 内積 dot とノルムから距離を求める
+    Scalar distance(Scalar dot, Scalar qn, Scalar xn) const {
+      switch (m_metric) {
+      case Metric::L2:
+        return std::max(Scalar(0), qn + xn - Scalar(2) * dot);
+      case Metric::Cosine:
+        return Scalar(1) - dot * qn * xn;
+      case Metric::InnerProduct:
+        break;
+      }
+      return -dot;
+    }
+
+    // heap (最大ヒープ，大きさ k まで) に候補を入れる．埋まったヒープの最大より遠い候補は比較 1 回で捨てる
+    static void push(std::vector<Neighbor> &heap, std::size_t k, const Neighbor &c) {
+      if (heap.size() < k) {
+        heap.push_back(c);
+        std::push_heap(heap.begin(), heap.end());
+      } else if (c < heap.front()) {
+        std::pop_heap(heap.begin(), heap.end());
+        heap.back() = c;
+        std::push_heap(heap.begin(), heap.end());
+      }
+    }
+
+    // クエリ [q0, q1) とデータ [x0, x1) の距離をタイルごとに求め，heaps[q - q0] に入れる
+    void searchBlock(const Scalar *queries, const Scalar *qnorms, std::size_t q0, std::size_t q1, std::size_t x0,
+      std::size_t x1, std::size_t k, std::vector<Neighbor> *heaps) const {
+      std::size_t d = m_data.dim().second, tile = dataTile();
+      std::vector<Scalar> dots(kQueryTile * std::min(tile, x1 - x0));
+      for (std::size_t t0 = x0; t0 < x1; t0 += tile) {
+        std::size_t t1 = std::min(x1, t0 + tile), w = t1 - t0;
+        std::fill(dots.begin(), dots.begin() + (q1 - q0) * w, Scalar(0));
+        kernels::gemmNT(q1 - q0, w, d, queries + q0 * d, d, m_data.data() + t0 * d, d, dots.data(), w);
+        for (std::size_t q = q0; q < q1; q++) {
+          std::vector<Neighbor> &heap = heaps[q - q0];
+          const Scalar *row = dots.data() + (q - q0) * w;
+          Scalar qn = (m_metric == Metric::InnerProduct) ? Scalar(0) : qnorms[q];
+          for (std::size_t j = 0; j < w; j++) {
+            Scalar xn = (m_metric == Metric::InnerProduct) ? Scalar(0) : m_norms[t0 + j];
+            push(heap, k, Neighbor{t0 + j, distance(row[j], qn, xn)});
+          }
+        }
+      }
+    }
+
+  public:
+    // 初期化
+
+    explicit KnnIndex(Matrix<Scalar> data, Metric metric = Metric::L2) : m_data(std::move(data)), m_metric(metric) {
+      computeNorms(0);
+    }
+
+    // 点を末尾に加える．番号は続きから振られる
+    void add(const Matrix<Scalar> &points) {
+      assert(points.dim().second == dim());
+      std::size_t first = size();
+      m_data = std::move(m_data).concatenateRows(points);
+      computeNorms(first);
+    }
+
+    // 参照
+
+    std::size_t size() const {
+      return m_data.dim().first;
+    }
+
+    std::size_t dim() const {
+      return m_data.dim().second;
+    }
+
+    Metric metric() const {
+      return m_metric;
+    }
+
+    const Matrix<Scalar> &data() const {
+      return m_data;
+    }
+
+    // 探索
+
+    // 各クエリ (queries の行) の近い順に k 個の近傍．クエリのタイルとデータの区間の組を並列に処理し，
+    // クエリが少なくスレッドが余る場合はデータを区間に分けて最後にヒープを併合する
+    std::vector<std::vector<Neighbor>> search(const Matrix<Scalar> &queries, std::size_t k,
+      Execution policy = Execution::Auto) const {
+      std::size_t nq = queries.dim().first, d = queries.dim().second;
+      assert(d == dim());
+      k = std::min(k, size());
+      std::vector<std::vector<Neighbor>> ret(nq);
+      if (nq == 0 || k == 0) {
+        return ret;
+      }
+      std::vector<Scalar> qnorms(nq);
+      rowNorms(queries.data(), nq, d, m_metric, qnorms.data());
+
+      std::size_t qtiles = (nq + kQueryTile - 1) / kQueryTile;
+      Execution resolved = resolveExecution(policy, nq * size() * d);
+      std::size_t threads = (resolved == Execution::Sequential) ? 1 : ThreadPool::global().size();
+      std::size_t parts = std::min((threads + qtiles - 1) / qtiles, (size() + dataTile() - 1) / dataTile());
+      parts = std::max<std::size_t>(1, parts);
+
+      // heaps[part * nq + q] は区間 part の中でのクエリ q の近傍
+      std::vector<std::vector<Neighbor>> heaps(parts * nq);
+      parallelFor(resolved, 0, qtiles * parts, [&](std::size_t first, std::size_t last) {
+        for (std::size_t task = first; task < last; task++) {
+          std::size_t qt = task / parts, part = task % parts;
+          std::size_t q0 = qt * kQueryTile, q1 = std::min(nq, q0 + kQueryTile);
+          std::size_t x0 = size() * part / parts, x1 = size() * (part + 1) / parts;
+          searchBlock(queries.data(), qnorms.data(), q0, q1, x0, x1, k, heaps.data() + part * nq + q0);
+        }
+      }, 1);
+
+      parallelFor(resolveExecution(policy, nq * k * parts), 0, nq, [&](std::size_t first, std::size_t last) {
+        for (std::size_t q = first; q < last; q++) {
+          std::vector<Neighbor> &heap = heaps[q];
+          for (std::size_t part = 1; part < parts; part++) {
+            for (const Neighbor &c : heaps[part * nq + q]) {
+              push(heap, k, c);
+            }
+          }
+          std::sort_heap(heap.begin(), heap.end());
+          ret[q] = std::move(heap);
+        }
+      });
+      return ret;
+    }
+
+    std::vector<Neighbor> search(const Vector<Scalar> &query, std::size_t k) const {
+      Matrix<Scalar> q(std::size_t(1), query.dim());
+      std::copy(query.begin(), query.end(), q.begin());
+      return std::move(search(q, k)[0]);
+    }
+
+    // queries の各行とすべての点の距離 (nq x size())．小さな集合の確認用に全体を作る
+    Matrix<Scalar> distances(const Matrix<Scalar> &queries) const {
+      auto [nq, d] = queries.dim();
+      assert(d == dim());
+      std::vector<Scalar> qnorms(nq);
+      rowNorms(queries.data(), nq, d, m_metric, qnorms.data());
+      Matrix<Scalar> ret = Matrix<Scalar>::zero(nq, size());
+      kernels::gemmNT(nq, size(), d, queries.data(), d, m_data.data(), d, ret.data(), size(), Execution::Auto);
+      for (std::size_t q = 0; q < nq; q++) {
+        for (std::size_t j = 0; j < size(); j++) {
+          Scalar qn = (m_metric == Metric::InnerProduct) ? Scalar(0) : qnorms[q];
+          Scalar xn = (m_metric == Metric::InnerProduct) ? Scalar(0) : m_norms[j];
+          ret(q, j) = distance(ret(q, j), qn, xn);
+        }
+      }
+      return ret;
+    }
+  };
+
+  using KnnIndexf = KnnIndex<float>;
+  using KnnIndexd = KnnIndex<double>;
+} // namespace mywheels
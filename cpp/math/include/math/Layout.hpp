@@ -0,0 +1,69 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <type_traits>
+
+namespace mywheels {
+  // 行列の要素の並べ方．index(i, j, rows, cols) で (i, j) 要素の格納位置を返す
+
+  struct ColMajor;
+
+  // 行優先．(i, j) は i * cols + j
+  struct RowMajor {
+    using Transposed = ColMajor;
+
+    static std::size_t index(std::size_t i, std::size_t j, std::size_t, std::size_t cols) {
+      return i * cols + j;
+    }
+  };
+
+  // 列優先．(i, j) は j * rows + i
+  struct ColMajor {
+    using Transposed = RowMajor;
+
+    static std::size_t index(std::size_t i, std::size_t j, std::size_t rows, std::size_t) {
+      return j * rows + i;
+    }
+  };
+
+  // TileSize x TileSize のタイルを行優先に並べ，タイルの中も行優先に並べる．
+  // 端のタイルは詰めずに小さいまま格納するので，要素数は rows * cols のまま
+  template<std::size_t TileSize = 32>
+  struct Tiled {
+    static_assert(TileSize > 0);
+    static constexpr std::size_t kTileSize = TileSize;
+
+    // ti 番目のタイル行の行数
+    static std::size_t tileRows(std::size_t ti, std::size_t rows) {
+      return std::min(TileSize, rows - ti * TileSize);
+    }
+
+    // tj 番目のタイル列の列数
+    static std::size_t tileCols(std::size_t tj, std::size_t cols) {
+      return std::min(TileSize, cols - tj * TileSize);
+    }
+
+    // タイル (ti, tj) の先頭の格納位置
+    static std::size_t tileOffset(std::size_t ti, std::size_t tj, std::size_t rows, std::size_t cols) {
+      return ti * TileSize * cols + tj * TileSize * tileRows(ti, rows);
+    }
+
+    static std::size_t index(std::size_t i, std::size_t j, std::size_t rows, std::size_t cols) {
+      std::size_t ti = i / TileSize, tj = j / TileSize;
+      return tileOffset(ti, tj, rows, cols) + (i % TileSize) * tileCols(tj, cols) + (j % TileSize);
+    }
+  };
+
+  template<typename Layout>
+  struct IsTiled : std::false_type {};
+
+  template<std::size_t TileSize>
+  struct IsTiled<Tiled<TileSize>> : std::true_type {};
+
+  template<typename Layout>
+  constexpr bool isTiled = IsTiled<Layout>::value;
+
+  template<typename Scalar, typename Layout = RowMajor>
+  class Matrix;
+} // namespace mywheels
@@ -4,33 +4,371 @@
 #include <vector>
 #include <algorithm>
 #include <numeric>
+#include <utility>
 #include <cassert>
 #include "math/Function.hpp"
+#include "math/Allocator.hpp"
+#include "math/Buffer.hpp"
+#include "math/Layout.hpp"
+#include "math/ThreadPool.hpp"
 #include "math/Vector.hpp"
+#include "math/Reduction.hpp"
+#include "math/Kernels.hpp"
 
 namespace mywheels {
-  template<typename Scalar>
+  // 要素の並べ方は Layout (RowMajor, ColMajor, Tiled<T>) で選ぶ．既定は行優先
+  template<typename Scalar, typename Layout>
   class Matrix {
   private:
-    std::vector<Scalar> m_values;
+    template<typename, typename>
+    friend class Matrix;
+    friend class Tensor<Scalar>;
+
+    static constexpr bool kRowMajor = std::is_same_v<Layout, RowMajor>;
+    static constexpr bool kColMajor = std::is_same_v<Layout, ColMajor>;
+
+    Buffer<Scalar> m_values;
     std::size_t m_rows;
     std::size_t m_cols;
 
+    // 要素を初期化せずに確保する．直後にすべての要素へ書き込む場合に使う
+    struct NoInit {};
+
+    Matrix(std::size_t rows, std::size_t cols, NoInit) : m_values(rows * cols), m_rows(rows), m_cols(cols) {};
+
+    Matrix(Buffer<Scalar> values, std::size_t rows, std::size_t cols) :
+      m_values(std::move(values)), m_rows(rows), m_cols(cols) {};
+
+    // 連結元の要素の先頭．右辺値なら書き込めるポインタを返し，ムーブできるようにする．
+    // 共有していればここで 1 回だけ複製するので，並列区間に入る前に呼び出し元のスレッドで取る
+    template<typename M>
+    static auto sourceData(M &&src) {
+      if constexpr (std::is_rvalue_reference_v<M &&>) {
+        return src.data();
+      } else {
+        return std::as_const(src).data();
+      }
+    }
+
+    // src が書き込めるポインタなら要素をムーブし，そうでなければコピーする
+    template<typename P>
+    static void transfer(P src, std::size_t first, std::size_t last, Scalar *out) {
+      if constexpr (std::is_const_v<std::remove_pointer_t<P>>) {
+        std::copy(src + first, src + last, out);
+      } else {
+        std::move(src + first, src + last, out);
+      }
+    }
+
+    // 要素ごとに走査する時のブロックの一辺．Tiled ではタイルに合わせる
+    static constexpr std::size_t blockSize() {
+      if constexpr (isTiled<Layout>) {
+        return Layout::kTileSize;
+      } else {
+        return 32;
+      }
+    }
+
+    // rows x cols の添字をブロックごとに fn(i, j) で走査する．ブロック行ごとに並列化する
+    template<typename F>
+    static void forEachBlocked(std::size_t rows, std::size_t cols, Execution policy, const F &fn) {
+      constexpr std::size_t b = blockSize();
+      std::size_t grain = std::max<std::size_t>(1, kDefaultGrain / std::max<std::size_t>(1, b * cols));
+      parallelFor(resolveExecution(policy, rows * cols), 0, (rows + b - 1) / b,
+        [&](std::size_t first, std::size_t last) {
+          for (std::size_t i0 = first * b; i0 < std::min(rows, last * b); i0 += b) {
+            std::size_t i1 = std::min(rows, i0 + b);
+            for (std::size_t j0 = 0; j0 < cols; j0 += b) {
+              std::size_t j1 = std::min(cols, j0 + b);
+              for (std::size_t i = i0; i < i1; i++) {
+                for (std::size_t j = j0; j < j1; j++) {
+                  fn(i, j);
+                }
+              }
+            }
+          }
+        }, grain);
+    }
+
+    // src が書き込めるポインタなら k 番目の要素をムーブできる参照で返す
+    template<typename P>
+    static decltype(auto) forwardElement(P src, std::size_t k) {
+      if constexpr (std::is_const_v<std::remove_pointer_t<P>>) {
+        return src[k];
+      } else {
+        return std::move(src[k]);
+      }
+    }
+
+    // 格納位置 k の要素の添字
+    std::pair<std::size_t, std::size_t> position(std::size_t k) const {
+      if constexpr (kRowMajor) {
+        return {k / m_cols, k % m_cols};
+      } else if constexpr (kColMajor) {
+        return {k % m_rows, k / m_rows};
+      } else {
+        constexpr std::size_t T = Layout::kTileSize;
+        std::size_t ti = k / (T * m_cols);
+        k -= ti * T * m_cols;
+        std::size_t h = Layout::tileRows(ti, m_rows);
+        std::size_t tj = k / (T * h);
+        k -= tj * T * h;
+        std::size_t w = Layout::tileCols(tj, m_cols);
+        return {ti * T + k / w, tj * T + k % w};
+      }
+    }
+
+    // 格納領域を l, r の順につなげる
+    template<typename L, typename R>
+    static void appendStorage(L &&l, R &&r, Matrix &ret, Execution policy) {
+      std::size_t n = l.size();
+      Scalar *out = ret.data();
+      auto x = sourceData(std::forward<L>(l));
+      auto y = sourceData(std::forward<R>(r));
+      parallelFor(policy, 0, ret.size(), [&](std::size_t first, std::size_t last) {
+        if (first < n) {
+          transfer(x, first, std::min(last, n), out + first);
+        }
+        if (last > n) {
+          std::size_t b = std::max(first, n);
+          transfer(y, b - n, last - n, out + b);
+        }
+      });
+    }
+
+    // 格納領域を outer 個の区間に分け，l の li 要素と r の ri 要素を交互に並べる
+    template<typename L, typename R>
+    static void interleaveStorage(L &&l, R &&r, Matrix &ret, std::size_t outer, std::size_t li, std::size_t ri,
+      Execution policy) {
+      Scalar *out = ret.data();
+      auto x = sourceData(std::forward<L>(l));
+      auto y = sourceData(std::forward<R>(r));
+      std::size_t grain = std::max<std::size_t>(1, kDefaultGrain / std::max<std::size_t>(1, li + ri));
+      parallelFor(resolveExecution(policy, ret.size()), 0, outer, [&](std::size_t first, std::size_t last) {
+        for (std::size_t i = first; i < last; i++) {
+          transfer(x, i * li, (i + 1) * li, out + i * (li + ri));
+          transfer(y, i * ri, (i + 1) * ri, out + i * (li + ri) + li);
+        }
+      }, grain);
+    }
+
+    // 添字を通して要素ごとに連結する．格納順で連結できない配置で使う
+    template<typename L, typename R>
+    static void concatenateElements(L &&l, R &&r, Matrix &ret, bool byRows, Execution policy) {
+      std::size_t lr = l.m_rows, lc = l.m_cols, rr = r.m_rows, rc = r.m_cols, m = ret.m_rows, n = ret.m_cols;
+      Scalar *out = ret.data();
+      auto x = sourceData(std::forward<L>(l));
+      auto y = sourceData(std::forward<R>(r));
+      forEachBlocked(m, n, policy, [&](std::size_t i, std::size_t j) {
+        if (byRows ? i < lr : j < lc) {
+          out[Layout::index(i, j, m, n)] = forwardElement(x, Layout::index(i, j, lr, lc));
+        } else {
+          std::size_t ri = byRows ? i - lr : i, rj = byRows ? j : j - lc;
+          out[Layout::index(i, j, m, n)] = forwardElement(y, Layout::index(ri, rj, rr, rc));
+        }
+      });
+    }
+
+    template<typename L, typename R>
+    static Matrix concatenateRows(L &&l, R &&r, Execution policy) {
+      assert(l.m_cols == r.m_cols);
+      Matrix ret(l.m_rows + r.m_rows, l.m_cols, NoInit{});
+      if constexpr (kRowMajor) {
+        appendStorage(std::forward<L>(l), std::forward<R>(r), ret, policy);
+      } else if constexpr (kColMajor) {
+        interleaveStorage(std::forward<L>(l), std::forward<R>(r), ret, l.m_cols, l.m_rows, r.m_rows, policy);
+      } else if (l.m_rows % Layout::kTileSize == 0) {
+        // l のタイル行が欠けていなければ r のタイルをそのまま後ろに並べられる
+        appendStorage(std::forward<L>(l), std::forward<R>(r), ret, policy);
+      } else {
+        concatenateElements(std::forward<L>(l), std::forward<R>(r), ret, true, policy);
+      }
+      return ret;
+    }
+
+    template<typename L, typename R>
+    static Matrix concatenateCols(L &&l, R &&r, Execution policy) {
+      assert(l.m_rows == r.m_rows);
+      Matrix ret(l.m_rows, l.m_cols + r.m_cols, NoInit{});
+      if constexpr (kRowMajor) {
+        interleaveStorage(std::forward<L>(l), std::forward<R>(r), ret, l.m_rows, l.m_cols, r.m_cols, policy);
+      } else if constexpr (kColMajor) {
+        appendStorage(std::forward<L>(l), std::forward<R>(r), ret, policy);
+      } else {
+        concatenateElements(std::forward<L>(l), std::forward<R>(r), ret, false, policy);
+      }
+      return ret;
+    }
+
+    // l * r を計算する．結果は左辺と同じ配置にする
+    template<typename RLayout>
+    static Matrix product(const Matrix &l, const Matrix<Scalar, RLayout> &r) {
+      assert(l.m_cols == r.m_rows);
+      std::size_t m = l.m_rows, n = r.m_cols, k = l.m_cols;
+      if constexpr (isTiled<Layout> || isTiled<RLayout>) {
+        if constexpr (!std::is_same_v<Layout, RLayout>) {
+          return product(l, Matrix(r));
+        } else {
+          // タイルごとに gemm を呼ぶ．結果のタイル行ごとに並列化する
+          constexpr std::size_t T = Layout::kTileSize;
+          Matrix ret = Matrix::zero(m, n);
+          std::size_t tm = (m + T - 1) / T, tn = (n + T - 1) / T, tk = (k + T - 1) / T;
+          Execution policy = (m * n * k < kernels::kGemmParallelThreshold) ? Execution::Sequential
+                                                                             : Execution::Parallel;
+          Scalar *out = ret.data();
+          parallelFor(policy, 0, tm, [&](std::size_t first, std::size_t last) {
+            for (std::size_t ti = first; ti < last; ti++) {
+              std::size_t h = Layout::tileRows(ti, m);
+              for (std::size_t tj = 0; tj < tn; tj++) {
+                std::size_t w = Layout::tileCols(tj, n);
+                Scalar *c = out + Layout::tileOffset(ti, tj, m, n);
+                for (std::size_t tp = 0; tp < tk; tp++) {
+                  std::size_t d = Layout::tileCols(tp, k);
+                  kernels::gemm(h, w, d, l.data() + Layout::tileOffset(ti, tp, m, k), d,
+                    r.data() + Layout::tileOffset(tp, tj, k, n), w, c, w);
+                }
+              }
+            }
+          }, 1);
+          return ret;
+        }
+      } else {
+        Matrix ret = Matrix::zero(m, n);
+        constexpr bool rRowMajor = std::is_same_v<RLayout, RowMajor>;
+        // ColMajor の格納は転置した行優先の行列として扱う
+        if constexpr (kRowMajor && rRowMajor) {
+          kernels::gemm(m, n, k, l.data(), k, r.data(), n, ret.data(), n, Execution::Auto);
+        } else if constexpr (kRowMajor) {
+          kernels::gemmNT(m, n, k, l.data(), k, r.data(), k, ret.data(), n, Execution::Auto);
+        } else if constexpr (rRowMajor) {
+          // t(ret) = t(r) * t(l)
+          kernels::gemmTN(n, m, k, r.data(), n, l.data(), m, ret.data(), m, Execution::Auto);
+        } else {
+          kernels::gemm(n, m, k, r.data(), k, l.data(), m, ret.data(), m, Execution::Auto);
+        }
+        return ret;
+      }
+    }
+
+    // 行ごと (ByRows) か列ごとの集約を，行優先の格納に対する rowWise か colWise で計算する．
+    // ColMajor の格納は転置した行優先の行列なので行と列を入れ替え，Tiled は行優先に並べ替えてから集約する
+    template<typename Ret, bool ByRows, typename RowWise, typename ColWise>
+    Ret reduceAlong(const RowWise &rowWise, const ColWise &colWise) const {
+      if constexpr (isTiled<Layout>) {
+        return Matrix<Scalar, RowMajor>(*this).template reduceAlong<Ret, ByRows>(rowWise, colWise);
+      } else {
+        Ret ret(ByRows ? m_rows : m_cols);
+        std::size_t rows = kRowMajor ? m_rows : m_cols;
+        std::size_t cols = kRowMajor ? m_cols : m_rows;
+        if (ByRows == kRowMajor) {
+          rowWise(data(), rows, cols, ret.data());
+        } else {
+          colWise(data(), rows, cols, ret.data());
+        }
+        return ret;
+      }
+    }
+
+    template<bool ByRows>
+    Vector<Scalar> sums(Summation method) const {
+      return reduceAlong<Vector<Scalar>, ByRows>(
+        [method](const Scalar *x, std::size_t rows, std::size_t cols, Scalar *out) {
+          reduction::rowSum(x, rows, cols, out, method);
+        },
+        [method](const Scalar *x, std::size_t rows, std::size_t cols, Scalar *out) {
+          reduction::colSum(x, rows, cols, out, method);
+        });
+    }
+
+    template<bool ByRows, typename Compare>
+    Vector<Scalar> extrema(Compare comp) const {
+      return reduceAlong<Vector<Scalar>, ByRows>(
+        [comp](const Scalar *x, std::size_t rows, std::size_t cols, Scalar *out) {
+          reduction::rowExtremum(x, rows, cols, out, nullptr, comp);
+        },
+        [comp](const Scalar *x, std::size_t rows, std::size_t cols, Scalar *out) {
+          reduction::colExtremum(x, rows, cols, out, nullptr, comp);
+        });
+    }
+
+    template<bool ByRows, typename Compare>
+    std::vector<std::size_t> argExtrema(Compare comp) const {
+      return reduceAlong<std::vector<std::size_t>, ByRows>(
+        [comp](const Scalar *x, std::size_t rows, std::size_t cols, std::size_t *out) {
+          reduction::rowExtremum(x, rows, cols, static_cast<Scalar *>(nullptr), out, comp);
+        },
+        [comp](const Scalar *x, std::size_t rows, std::size_t cols, std::size_t *out) {
+          reduction::colExtremum(x, rows, cols, static_cast<Scalar *>(nullptr), out, comp);
+        });
+    }
+
   public:
     // 初期化
-    explicit Matrix(std::size_t dim) : m_values(dim * dim), m_rows(dim), m_cols(dim) {};
+    explicit Matrix(std::size_t dim) : Matrix(dim, dim, Scalar(0)) {};
 
-    Matrix(std::size_t rows, std::size_t cols) : m_values(rows * cols), m_rows(rows), m_cols(cols) {};
+    Matrix(std::size_t rows, std::size_t cols) : Matrix(rows, cols, Scalar(0)) {};
 
-    Matrix(std::size_t dim, Scalar val) : m_values(dim * dim, val), m_rows(dim), m_cols(dim) {};
+    Matrix(std::size_t dim, Scalar val, Execution policy = Execution::Auto) : Matrix(dim, dim, val, policy) {};
 
-    Matrix(std::size_t rows, std::size_t cols, Scalar val) : m_values(rows * cols, val), m_rows(rows), m_cols(cols) {};
+    Matrix(std::size_t rows, std::size_t cols, Scalar val, Execution policy = Execution::Auto) :
+      Matrix(rows, cols, NoInit{}) {
+      kernels::fill(size(), val, data(), policy);
+    };
 
-    Matrix(std::initializer_list<Scalar> list, std::size_t cols = 1) :
-      m_values(list), m_rows(list.size() / cols), m_cols(cols) {
+    // list は行優先に並べて与える
+    Matrix(std::initializer_list<Scalar> list, std::size_t cols = 1) : Matrix(list.size() / cols, cols, NoInit{}) {
       assert(list.size() % cols == 0);
+      auto it = list.begin();
+      for (std::size_t i = 0; i < m_rows; i++) {
+        for (std::size_t j = 0; j < m_cols; j++) {
+          (*this)(i, j) = *it++;
+        }
+      }
     };
 
+    // copyOnWrite() が有効なら格納領域を共有し，どちらかへ最初に書き込む時に複製する
+    Matrix(const Matrix &r) :
+      m_values(copyOnWrite() ? r.m_values : r.m_values.clone()), m_rows(r.m_rows), m_cols(r.m_cols) {};
+
+    Matrix(Matrix &&r) noexcept = default;
+
+    Matrix &operator=(const Matrix &r) {
+      if (this != &r) {
+        if (copyOnWrite()) {
+          m_values = r.m_values;
+        } else {
+          if (size() != r.size()) {
+            m_values = decltype(m_values)(r.size());
+          }
+          kernels::copy(size(), r.data(), data(), Execution::Auto);
+        }
+        m_rows = r.m_rows;
+        m_cols = r.m_cols;
+      }
+      return *this;
+    }
+
+    Matrix &operator=(Matrix &&r) noexcept = default;
+
+    // 配置の変換．ブロックごとに並べ替える
+    template<typename RLayout, typename = std::enable_if_t<!std::is_same_v<RLayout, Layout>>>
+    explicit Matrix(const Matrix<Scalar, RLayout> &r, Execution policy = Execution::Auto) :
+      Matrix(r.m_rows, r.m_cols, NoInit{}) {
+      Scalar *out = data();
+      forEachBlocked(m_rows, m_cols, policy, [&](std::size_t i, std::size_t j) {
+        out[Layout::index(i, j, m_rows, m_cols)] = r(i, j);
+      });
+    }
+
+    template<typename ToLayout>
+    Matrix<Scalar, ToLayout> toLayout(Execution policy = Execution::Auto) const {
+      if constexpr (std::is_same_v<ToLayout, Layout>) {
+        return *this;
+      } else {
+        return Matrix<Scalar, ToLayout>(*this, policy);
+      }
+    }
+
     // 型変換
     operator Vector<Scalar>() const {
       assert(m_cols == 1);
@@ -57,14 +395,74 @@ namespace mywheels {
       return m_values.end();
     }
 
+    Scalar *data() {
+      return m_values.data();
+    }
+
+    const Scalar *data() const {
+      return m_values.data();
+    }
+
+    std::size_t size() const {
+      return m_values.size();
+    }
+
+    // copyOnWrite() によらず格納領域を共有するコピー．読むだけの行列を複数のスレッドへ複製せずに渡す時に使う
+    Matrix share() const {
+      return Matrix(m_values, m_rows, m_cols);
+    }
+
+    bool sharesStorage(const Matrix &r) const {
+      return m_values.sharesStorage(r.m_values);
+    }
+
     // 演算子
 
     Scalar &operator()(std::size_t i, std::size_t j) {
-      return m_values[i * m_cols + j];
+      return m_values[Layout::index(i, j, m_rows, m_cols)];
     }
 
     const Scalar &operator()(std::size_t i, std::size_t j) const {
-      return m_values[i * m_cols + j];
+      return m_values[Layout::index(i, j, m_rows, m_cols)];
+    }
+
+    // 実行方針を指定できる要素ごとの演算．演算子は Execution::Auto で呼び出す
+
+    Matrix &add(const Matrix &r, Execution policy = Execution::Auto) {
+      assert(dim() == r.dim());
+      kernels::add(size(), data(), r.data(), data(), policy);
+      return *this;
+    }
+
+    Matrix &sub(const Matrix &r, Execution policy = Execution::Auto) {
+      assert(dim() == r.dim());
+      kernels::sub(size(), data(), r.data(), data(), policy);
+      return *this;
+    }
+
+    Matrix &scale(const Scalar &r, Execution policy = Execution::Auto) {
+      kernels::scale(size(), data(), r, data(), policy);
+      return *this;
+    }
+
+    Matrix &divide(const Scalar &r, Execution policy = Execution::Auto) {
+      kernels::div(size(), data(), r, data(), policy);
+      return *this;
+    }
+
+    Matrix &mod(const Scalar &r, Execution policy = Execution::Auto) {
+      Scalar *x = data();
+      parallelFor(policy, 0, size(), [x, &r](std::size_t first, std::size_t last) {
+        for (std::size_t i = first; i < last; i++) {
+          x[i] = x[i] % r;
+        }
+      });
+      return *this;
+    }
+
+    Matrix &negate(Execution policy = Execution::Auto) {
+      kernels::scale(size(), data(), Scalar(-1), data(), policy);
+      return *this;
     }
 
     // 単項演算子
@@ -77,69 +475,55 @@ namespace mywheels {
     }
 
     Matrix operator-() const & {
-      Matrix ret(*this);
-      std::transform(ret.begin(), ret.end(), ret.begin(), std::negate());
+      Matrix ret(m_rows, m_cols, NoInit{});
+      kernels::scale(size(), data(), Scalar(-1), ret.data(), Execution::Auto);
       return ret;
     }
 
     Matrix operator-() && {
-      std::transform(begin(), end(), begin(), std::negate());
-      return std::move(*this);
+      return std::move(negate());
     }
 
     // 複合代入演算子
 
     Matrix &operator+=(const Matrix &r) {
-      assert(dim() == r.dim());
-      std::transform(begin(), end(), r.begin(), begin(), std::plus());
-      return *this;
+      return add(r);
     }
 
     Matrix &operator-=(const Matrix &r) {
-      assert(dim() == r.dim());
-      std::transform(begin(), end(), r.begin(), begin(), std::minus());
-      return *this;
+      return sub(r);
     }
 
     Matrix &operator*=(const Scalar &r) {
-      std::transform(begin(), end(), begin(), [&r](Scalar a) {
-        return a * r;
-      });
-      return *this;
+      return scale(r);
     }
 
     Matrix &operator*=(const Matrix &r) {
-      assert(m_cols == r.m_rows);
-      Matrix ret = Matrix::zero(m_rows, r.m_cols);
-      for (std::size_t i = 0; i < m_rows; i++) {
-        for (std::size_t j = 0; j < r.m_cols; j++) {
-          for (std::size_t k = 0; k < m_cols; k++) {
-            ret(i, j) += (*this)(i, k) * r(k, j);
-          }
-        }
-      }
-      *this = std::move(ret);
+      *this = product(*this, r);
       return *this;
     }
 
-    Matrix &operator/=(const Scalar &r) {
-      std::transform(begin(), end(), begin(), [&r](Scalar a) {
-        return a / r;
-      });
+    template<typename RLayout, typename = std::enable_if_t<!std::is_same_v<RLayout, Layout>>>
+    Matrix &operator*=(const Matrix<Scalar, RLayout> &r) {
+      *this = product(*this, r);
       return *this;
     }
 
+    Matrix &operator/=(const Scalar &r) {
+      return divide(r);
+    }
+
     Matrix &operator%=(const Scalar &r) {
-      std::transform(begin(), end(), begin(), [&r](Scalar a) {
-        return a % r;
-      });
-      return *this;
+      return mod(r);
     }
 
     // 二項演算子
 
     friend Matrix operator+(const Matrix &l, const Matrix &r) {
-      return Matrix(l) += r;
+      assert(l.dim() == r.dim());
+      Matrix ret(l.m_rows, l.m_cols, NoInit{});
+      kernels::add(ret.size(), l.data(), r.data(), ret.data(), Execution::Auto);
+      return ret;
     }
 
     friend Matrix operator+(Matrix &&l, const Matrix &r) {
@@ -148,8 +532,8 @@ namespace mywheels {
 
     friend Matrix operator+(const Matrix &l, Matrix &&r) {
       assert(l.dim() == r.dim());
-      std::transform(l.begin(), l.end(), r.begin(), r.begin(), std::plus());
-      return r;
+      kernels::add(r.size(), l.data(), r.data(), r.data(), Execution::Auto);
+      return std::move(r);
     }
 
     friend Matrix operator+(Matrix &&l, Matrix &&r) {
@@ -157,7 +541,10 @@ namespace mywheels {
     }
 
     friend Matrix operator-(const Matrix &l, const Matrix &r) {
-      return Matrix(l) -= r;
+      assert(l.dim() == r.dim());
+      Matrix ret(l.m_rows, l.m_cols, NoInit{});
+      kernels::sub(ret.size(), l.data(), r.data(), ret.data(), Execution::Auto);
+      return ret;
     }
 
     friend Matrix operator-(Matrix &&l, const Matrix &r) {
@@ -166,7 +553,7 @@ namespace mywheels {
 
     friend Matrix operator-(const Matrix &l, Matrix &&r) {
       assert(l.dim() == r.dim());
-      std::transform(l.begin(), l.end(), r.begin(), r.begin(), std::minus());
+      kernels::sub(r.size(), l.data(), r.data(), r.data(), Execution::Auto);
       return std::move(r);
     }
 
@@ -175,7 +562,9 @@ namespace mywheels {
     }
 
     friend Matrix operator*(const Matrix &l, const Scalar &r) {
-      return Matrix(l) *= r;
+      Matrix ret(l.m_rows, l.m_cols, NoInit{});
+      kernels::scale(ret.size(), l.data(), r, ret.data(), Execution::Auto);
+      return ret;
     }
 
     friend Matrix operator*(Matrix &&l, const Scalar &r) {
@@ -183,18 +572,13 @@ namespace mywheels {
     }
 
     friend Matrix operator*(const Scalar &l, const Matrix &r) {
-      Matrix ret(r);
-      for (auto &elm : ret) {
-        elm = l * elm;
-      }
+      Matrix ret(r.m_rows, r.m_cols, NoInit{});
+      kernels::scale(ret.size(), r.data(), l, ret.data(), Execution::Auto);
       return ret;
     }
 
     friend Matrix operator*(const Scalar &l, Matrix &&r) {
-      for (auto &elm : r) {
-        elm = l * elm;
-      }
-      return std::move(r);
+      return std::move(r.scale(l));
     }
 
     friend Matrix operator*(const Matrix &l, const Matrix &r) {
@@ -206,16 +590,7 @@ namespace mywheels {
     }
 
     friend Matrix operator*(const Matrix &l, Matrix &&r) {
-      assert(l.m_cols == r.m_rows);
-      Matrix ret = Matrix::zero(l.m_rows, r.m_cols);
-      for (std::size_t i = 0; i < l.m_rows; i++) {
-        for (std::size_t j = 0; j < r.m_cols; j++) {
-          for (std::size_t k = 0; k < l.m_cols; k++) {
-            ret(i, j) += l(i, k) * r(k, j);
-          }
-        }
-      }
-      r = std::move(ret);
+      r = product(l, r);
       return r;
     }
 
@@ -223,8 +598,16 @@ namespace mywheels {
       return l *= r;
     }
 
+    // 配置の異なる行列の積．結果は左辺と同じ配置
+    template<typename RLayout, typename = std::enable_if_t<!std::is_same_v<RLayout, Layout>>>
+    friend Matrix operator*(const Matrix &l, const Matrix<Scalar, RLayout> &r) {
+      return product(l, r);
+    }
+
     friend Matrix operator/(const Matrix &l, const Scalar &r) {
-      return Matrix(l) /= r;
+      Matrix ret(l.m_rows, l.m_cols, NoInit{});
+      kernels::div(ret.size(), l.data(), r, ret.data(), Execution::Auto);
+      return ret;
     }
 
     friend Matrix operator/(Matrix &&l, const Scalar &r) {
@@ -253,9 +636,12 @@ namespace mywheels {
     }
 
     // 入出力演算子
+    // 配置によらず行優先の順に読む
     friend std::istream &operator>>(std::istream &is, Matrix &v) {
-      for (auto &elm : v) {
-        is >> elm;
+      for (std::size_t i = 0; i < v.m_rows; i++) {
+        for (std::size_t j = 0; j < v.m_cols; j++) {
+          is >> v(i, j);
+        }
       }
       return is;
     }
@@ -274,6 +660,23 @@ namespace mywheels {
       return os;
     }
 
+    // 要素ごとの関数
+
+    friend Matrix exp(Matrix mat) {
+      kernels::exp(mat.size(), mat.data(), mat.data());
+      return mat;
+    }
+
+    friend Matrix sigmoid(Matrix mat) {
+      kernels::sigmoid(mat.size(), mat.data(), mat.data());
+      return mat;
+    }
+
+    friend Matrix lamp(Matrix mat) {
+      kernels::lamp(mat.size(), mat.data(), mat.data());
+      return mat;
+    }
+
     // 関数
 
     std::pair<std::size_t, std::size_t> dim() const {
@@ -294,13 +697,24 @@ namespace mywheels {
       return *this;
     }
 
+    // キャッシュに収まるブロックごとに転置する
     friend Matrix t(const Matrix &mat) {
-      Matrix ret(mat.m_cols, mat.m_rows);
-      for (std::size_t i = 0; i < mat.m_rows; i++) {
-        for (std::size_t j = 0; j < mat.m_cols; j++) {
-          ret(j, i) = mat(i, j);
-        }
-      }
+      Matrix ret(mat.m_cols, mat.m_rows, NoInit{});
+      Scalar *out = ret.data();
+      forEachBlocked(mat.m_rows, mat.m_cols, Execution::Auto, [&](std::size_t i, std::size_t j) {
+        out[Layout::index(j, i, ret.m_rows, ret.m_cols)] = mat(i, j);
+      });
+      return ret;
+    }
+
+    // 格納領域をそのまま使い，逆の配置の転置行列として読み直す．O(1)
+    template<typename L = Layout, typename = std::enable_if_t<!isTiled<L>>>
+    Matrix<Scalar, typename L::Transposed> asTransposed() && {
+      Matrix<Scalar, typename L::Transposed> ret(std::size_t(0), std::size_t(0));
+      ret.m_values = std::move(m_values);
+      ret.m_rows = m_cols;
+      ret.m_cols = m_rows;
+      m_rows = m_cols = 0;
       return ret;
     }
 
@@ -313,6 +727,82 @@ namespace mywheels {
       return ret;
     }
 
+    // 集約
+
+    Scalar sum(Summation method = Summation::Pairwise) const {
+      return kernels::sum(data(), size(), method);
+    }
+
+    friend Scalar sum(const Matrix &mat) {
+      return mat.sum();
+    }
+
+    // フロベニウスノルム
+    Scalar norm(Summation method = Summation::Pairwise) const {
+      return sqrt(kernels::dot(data(), data(), size(), method));
+    }
+
+    friend Scalar norm(const Matrix &mat) {
+      return mat.norm();
+    }
+
+    Scalar min() const {
+      return reduction::min(data(), m_values.size());
+    }
+
+    Scalar max() const {
+      return reduction::max(data(), m_values.size());
+    }
+
+    // 同じ値が複数ある時は格納順で最初の要素を返す
+    std::pair<std::size_t, std::size_t> argmin() const {
+      return position(reduction::argmin(data(), m_values.size()));
+    }
+
+    std::pair<std::size_t, std::size_t> argmax() const {
+      return position(reduction::argmax(data(), m_values.size()));
+    }
+
+    Vector<Scalar> rowSum(Summation method = Summation::Pairwise) const {
+      return sums<true>(method);
+    }
+
+    Vector<Scalar> colSum(Summation method = Summation::Pairwise) const {
+      return sums<false>(method);
+    }
+
+    Vector<Scalar> rowMin() const {
+      return extrema<true>(std::less<Scalar>());
+    }
+
+    Vector<Scalar> rowMax() const {
+      return extrema<true>(std::greater<Scalar>());
+    }
+
+    Vector<Scalar> colMin() const {
+      return extrema<false>(std::less<Scalar>());
+    }
+
+    Vector<Scalar> colMax() const {
+      return extrema<false>(std::greater<Scalar>());
+    }
+
+    std::vector<std::size_t> rowArgmin() const {
+      return argExtrema<true>(std::less<Scalar>());
+    }
+
+    std::vector<std::size_t> rowArgmax() const {
+      return argExtrema<true>(std::greater<Scalar>());
+    }
+
+    std::vector<std::size_t> colArgmin() const {
+      return argExtrema<false>(std::less<Scalar>());
+    }
+
+    std::vector<std::size_t> colArgmax() const {
+      return argExtrema<false>(std::greater<Scalar>());
+    }
+
     Matrix row(std::size_t ix) const {
       assert(ix < m_rows);
       Matrix ret(std::size_t(1), m_cols);
@@ -331,92 +821,36 @@ namespace mywheels {
       return ret;
     }
 
-    Matrix concatenateRows(const Matrix &r) const & {
-      assert(m_cols == r.m_cols);
-      Matrix ret(m_rows + r.m_rows, m_cols);
-      std::copy(begin(), end(), ret.begin());
-      std::copy(r.begin(), r.end(), ret.begin() + m_rows * m_cols);
-      return ret;
+    Matrix concatenateRows(const Matrix &r, Execution policy = Execution::Auto) const & {
+      return concatenateRows(*this, r, policy);
     }
 
-    Matrix concatenateRows(Matrix &&r) const & {
-      assert(m_cols == r.m_cols);
-      Matrix ret(m_rows + r.m_rows, m_cols);
-      std::copy(begin(), end(), ret.begin());
-      std::move(r.begin(), r.end(), ret.begin() + m_rows * m_cols);
-      return ret;
+    Matrix concatenateRows(Matrix &&r, Execution policy = Execution::Auto) const & {
+      return concatenateRows(*this, std::move(r), policy);
     }
 
-    Matrix concatenateRows(const Matrix &r) && {
-      assert(m_cols == r.m_cols);
-      Matrix ret(m_rows + r.m_rows, m_cols);
-      std::move(begin(), end(), ret.begin());
-      std::copy(r.begin(), r.end(), ret.begin() + m_rows * m_cols);
-      return ret;
+    Matrix concatenateRows(const Matrix &r, Execution policy = Execution::Auto) && {
+      return concatenateRows(std::move(*this), r, policy);
     }
 
-    Matrix concatenateRows(Matrix &&r) && {
-      assert(m_cols == r.m_cols);
-      Matrix ret(m_rows + r.m_rows, m_cols);
-      std::move(begin(), end(), ret.begin());
-      std::move(r.begin(), r.end(), ret.begin() + m_rows * m_cols);
-      return ret;
+    Matrix concatenateRows(Matrix &&r, Execution policy = Execution::Auto) && {
+      return concatenateRows(std::move(*this), std::move(r), policy);
     }
 
-    Matrix concatenateCols(const Matrix &r) const & {
-      assert(m_rows == r.m_rows);
-      Matrix ret(m_rows, m_cols + r.m_cols);
-      for (std::size_t i = 0; i < m_rows; i++) {
-        for (std::size_t j = 0; j < m_cols; j++) {
-          ret(i, j) = (*this)(i, j);
-        }
-        for (std::size_t j = 0; j < r.m_cols; j++) {
-          ret(i, m_cols + j) = r(i, j);
-        }
-      }
-      return ret;
+    Matrix concatenateCols(const Matrix &r, Execution policy = Execution::Auto) const & {
+      return concatenateCols(*this, r, policy);
     }
 
-    Matrix concatenateCols(Matrix &&r) const & {
-      assert(m_rows == r.m_rows);
-      Matrix ret(m_rows, m_cols + r.m_cols);
-      for (std::size_t i = 0; i < m_rows; i++) {
-        for (std::size_t j = 0; j < m_cols; j++) {
-          ret(i, j) = (*this)(i, j);
-        }
-        for (std::size_t j = 0; j < r.m_cols; j++) {
-          ret(i, m_cols + j) = std::move(r(i, j));
-        }
-      }
-      return ret;
+    Matrix concatenateCols(Matrix &&r, Execution policy = Execution::Auto) const & {
+      return concatenateCols(*this, std::move(r), policy);
     }
 
-    Matrix concatenateCols(const Matrix &r) && {
-      assert(m_rows == r.m_rows);
-      Matrix ret(m_rows, m_cols + r.m_cols);
-      for (std::size_t i = 0; i < m_rows; i++) {
-        for (std::size_t j = 0; j < m_cols; j++) {
-          ret(i, j) = std::move((*this)(i, j));
-        }
-        for (std::size_t j = 0; j < r.m_cols; j++) {
-          ret(i, m_cols + j) = r(i, j);
-        }
-      }
-      return ret;
+    Matrix concatenateCols(const Matrix &r, Execution policy = Execution::Auto) && {
+      return concatenateCols(std::move(*this), r, policy);
     }
 
-    Matrix concatenateCols(Matrix &&r) && {
-      assert(m_rows == r.m_rows);
-      Matrix ret(m_rows, m_cols + r.m_cols);
-      for (std::size_t i = 0; i < m_rows; i++) {
-        for (std::size_t j = 0; j < m_cols; j++) {
-          ret(i, j) = std::move((*this)(i, j));
-        }
-        for (std::size_t j = 0; j < r.m_cols; j++) {
-          ret(i, m_cols + j) = std::move(r(i, j));
-        }
-      }
-      return ret;
+    Matrix concatenateCols(Matrix &&r, Execution policy = Execution::Auto) && {
+      return concatenateCols(std::move(*this), std::move(r), policy);
     }
 
     // idx=0の時，上からn個，左からm個を取るようにブロックに分ける
@@ -0,0 +1,318 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <cassert>
+#include <cstdint>
+#include <type_traits>
+#include "math/Allocator.hpp"
+#include "math/ThreadPool.hpp"
+#include "math/Kernels.hpp"
+#include "math/Matrix.hpp"
+
+namespace mywheels {
+  // 2^31 以下の法 m の剰余演算．Barrett 法の定数 floor((2^64 - 1) / m) を前もって求めておき，除算を使わずに剰余を求める．
+  // 行列の積では 64 ビットの和に積をそのまま足していき，lazyTerms() 回ごとに上位 32 ビットを 2^32 mod m 倍して
+  // 下位 32 ビットに足し戻す (値は法 m で変わらない)．剰余を完全に求めるのは最後の 1 回だけでよい
+  class Modulus {
+  private:
+    std::uint32_t m_value;
+    std::uint32_t m_fold;
+    std::uint64_t m_barrett;
+    std::size_t m_lazyTerms;
+
+    // 64 ビット同士の積の上位 64 ビット
+    static std::uint64_t mulhi(std::uint64_t a, std::uint64_t b) {
+#if defined(__SIZEOF_INT128__)
+      // __int128 は拡張なので -pedantic でも警告しないよう __extension__ を付ける
+      __extension__ typedef unsigned __int128 u128;
+      return static_cast<std::uint64_t>((static_cast<u128>(a) * b) >> 64);
+#else
+      std::uint64_t al = a & 0xffffffffu, ah = a >> 32, bl = b & 0xffffffffu, bh = b >> 32;
+      std::uint64_t ll = al * bl, lh = al * bh, hl = ah * bl, hh = ah * bh;
+      std::uint64_t mid = (ll >> 32) + (lh & 0xffffffffu) + (hl & 0xffffffffu);
+      return hh + (lh >> 32) + (hl >> 32) + (mid >> 32);
+#endif
+    }
+
+  public:
+    static constexpr std::uint32_t kMax = std::uint32_t(1) << 31;
+
+    explicit Modulus(std::uint32_t m) : m_value(m) {
+      assert(m >= 1 && m <= kMax);
+      m_fold = static_cast<std::uint32_t>((std::uint64_t(1) << 32) % m);
+      m_barrett = std::numeric_limits<std::uint64_t>::max() / m;
+      // 畳み込んだ後の和の上限 (2^32 - 1) (fold + 1) に (m - 1)^2 を何回足してもあふれないか
+      std::uint64_t bound = std::uint64_t(0xffffffffu) * (std::uint64_t(m_fold) + 1);
+      std::uint64_t square = std::uint64_t(m - 1) * (m - 1);
+      std::uint64_t room = std::numeric_limits<std::uint64_t>::max() - bound;
+      m_lazyTerms = (square == 0) ? std::numeric_limits<std::size_t>::max() : static_cast<std::size_t>(room / square);
+    }
+
+    std::uint32_t value() const {
+      return m_value;
+    }
+
+    // 2^32 mod m
+    std::uint32_t fold() const {
+      return m_fold;
+    }
+
+    // 畳み込んだ後の 64 ビットの和に [0, m) 同士の積を足せる回数 (1 以上)
+    std::size_t lazyTerms() const {
+      return m_lazyTerms;
+    }
+
+    // x mod m．商の見積もりは真の値より高々 1 小さいだけなので，引き直しは 1 回で済む
+    std::uint32_t reduce(std::uint64_t x) const {
+      std::uint64_t r = x - mulhi(x, m_barrett) * m_value;
+      return static_cast<std::uint32_t>(r >= m_value ? r - m_value : r);
+    }
+
+    // 任意の整数を [0, m) へ
+    template<typename Int, typename = std::enable_if_t<std::is_integral_v<Int>>>
+    std::uint32_t from(Int x) const {
+      if constexpr (std::is_signed_v<Int>) {
+        if (x < 0) {
+          // -(x + 1) はあふれない
+          std::uint32_t r = reduce(static_cast<std::uint64_t>(-(x + 1)));
+          return m_value - 1 - r;
+        }
+      }
+      return reduce(static_cast<std::uint64_t>(x));
+    }
+
+    std::uint32_t add(std::uint32_t a, std::uint32_t b) const {
+      std::uint32_t s = a + b;
+      return s >= m_value ? s - m_value : s;
+    }
+
+    std::uint32_t sub(std::uint32_t a, std::uint32_t b) const {
+      return a >= b ? a - b : a + (m_value - b);
+    }
+
+    std::uint32_t mul(std::uint32_t a, std::uint32_t b) const {
+      return reduce(std::uint64_t(a) * b);
+    }
+
+    std::uint32_t pow(std::uint32_t a, std::uint64_t e) const {
+      std::uint32_t ret = reduce(1);
+      for (; e > 0; e >>= 1) {
+        if (e & 1) {
+          ret = mul(ret, a);
+        }
+        a = mul(a, a);
+      }
+      return ret;
+    }
+
+    friend bool operator==(const Modulus &l, const Modulus &r) {
+      return l.m_value == r.m_value;
+    }
+
+    friend bool operator!=(const Modulus &l, const Modulus &r) {
+      return !(l == r);
+    }
+  };
+
+  namespace kernels {
+    // c[m x n] = a[m x k] * b[k x n] mod mod．いずれも行優先で要素は [0, mod)．c は上書きする．
+    // 積は 32 ビットのレーン同士で 64 ビットの和へ足し，Modulus::lazyTerms() 回ごとに畳み込む
+    void modGemm(std::size_t m, std::size_t n, std::size_t k, const std::uint32_t *a, std::size_t lda,
+      const std::uint32_t *b, std::size_t ldb, std::uint32_t *c, std::size_t ldc, const Modulus &mod);
+
+    // out = x + y mod mod
+    void modAdd(std::size_t n, const std::uint32_t *x, const std::uint32_t *y, std::uint32_t *out, const Modulus &mod);
+
+    // out = x - y mod mod
+    void modSub(std::size_t n, const std::uint32_t *x, const std::uint32_t *y, std::uint32_t *out, const Modulus &mod);
+
+    // out = s x mod mod．s ごとに floor(s 2^32 / mod) を求めておき (Shoup 法)，要素ごとの剰余を 32 ビットの積で求める
+    void modScale(std::size_t n, const std::uint32_t *x, std::uint32_t s, std::uint32_t *out, const Modulus &mod);
+  } // namespace kernels
+
+  // 要素を [0, m) の 32 ビット整数で持つ法 m の行列．Matrix<int64_t> の積は % を取る前にあふれるが，
+  // こちらは和を 64 ビットのまま遅延して畳み込むので，大きな行列の積や累乗も正しく求まる
+  class ModMatrix {
+  private:
+    std::vector<std::uint32_t, DefaultInitAllocator<std::uint32_t>> m_values;
+    std::size_t m_rows;
+    std::size_t m_cols;
+    Modulus m_mod;
+
+    struct NoInit {};
+
+    ModMatrix(std::size_t rows, std::size_t cols, Modulus mod, NoInit) :
+      m_values(rows * cols), m_rows(rows), m_cols(cols), m_mod(mod) {};
+
+    // 積を並列化する時の 1 つのタスクの最小の行数
+    static constexpr std::size_t kGemmGrain = 16;
+
+  public:
+    // 初期化
+
+    ModMatrix(std::size_t rows, std::size_t cols, Modulus mod) : ModMatrix(rows, cols, mod, NoInit{}) {
+      std::fill(m_values.begin(), m_values.end(), std::uint32_t(0));
+    };
+
+    // 整数の行列の各要素を [0, m) へ
+    template<typename Int, typename Layout>
+    ModMatrix(const Matrix<Int, Layout> &mat, Modulus mod) :
+      ModMatrix(mat.dim().first, mat.dim().second, mod, NoInit{}) {
+      static_assert(std::is_integral_v<Int>);
+      for (std::size_t i = 0; i < m_rows; i++) {
+        for (std::size_t j = 0; j < m_cols; j++) {
+          m_values[i * m_cols + j] = m_mod.from(mat(i, j));
+        }
+      }
+    }
+
+    ModMatrix(std::initializer_list<std::int64_t> list, std::size_t cols, Modulus mod) :
+      ModMatrix(list.size() / cols, cols, mod, NoInit{}) {
+      assert(list.size() % cols == 0);
+      std::transform(list.begin(), list.end(), m_values.begin(), [&](std::int64_t x) {
+        return m_mod.from(x);
+      });
+    }
+
+    static ModMatrix identity(std::size_t dim, Modulus mod) {
+      ModMatrix ret(dim, dim, mod);
+      for (std::size_t i = 0; i < dim; i++) {
+        ret.m_values[i * dim + i] = mod.reduce(1);
+      }
+      return ret;
+    }
+
+    // 要素の参照
+
+    std::pair<std::size_t, std::size_t> dim() const {
+      return {m_rows, m_cols};
+    }
+
+    const Modulus &modulus() const {
+      return m_mod;
+    }
+
+    std::uint32_t *data() {
+      return m_values.data();
+    }
+
+    const std::uint32_t *data() const {
+      return m_values.data();
+    }
+
+    // 書き込む値は [0, m) に収めること
+    std::uint32_t &operator()(std::size_t i, std::size_t j) {
+      assert(i < m_rows && j < m_cols);
+      return m_values[i * m_cols + j];
+    }
+
+    std::uint32_t operator()(std::size_t i, std::size_t j) const {
+      assert(i < m_rows && j < m_cols);
+      return m_values[i * m_cols + j];
+    }
+
+    template<typename Int = std::int64_t>
+    Matrix<Int> toMatrix() const {
+      Matrix<Int> ret(m_rows, m_cols);
+      std::copy(m_values.begin(), m_values.end(), ret.begin());
+      return ret;
+    }
+
+    // 演算子
+
+    ModMatrix &operator+=(const ModMatrix &r) {
+      assert(dim() == r.dim() && m_mod == r.m_mod);
+      kernels::modAdd(m_values.size(), data(), r.data(), data(), m_mod);
+      return *this;
+    }
+
+    ModMatrix &operator-=(const ModMatrix &r) {
+      assert(dim() == r.dim() && m_mod == r.m_mod);
+      kernels::modSub(m_values.size(), data(), r.data(), data(), m_mod);
+      return *this;
+    }
+
+    template<typename Int, typename = std::enable_if_t<std::is_integral_v<Int>>>
+    ModMatrix &operator*=(Int r) {
+      kernels::modScale(m_values.size(), data(), m_mod.from(r), data(), m_mod);
+      return *this;
+    }
+
+    ModMatrix &operator*=(const ModMatrix &r) {
+      return *this = *this * r;
+    }
+
+    friend ModMatrix operator+(ModMatrix l, const ModMatrix &r) {
+      return std::move(l += r);
+    }
+
+    friend ModMatrix operator-(ModMatrix l, const ModMatrix &r) {
+      return std::move(l -= r);
+    }
+
+    template<typename Int, typename = std::enable_if_t<std::is_integral_v<Int>>>
+    friend ModMatrix operator*(ModMatrix l, Int r) {
+      return std::move(l *= r);
+    }
+
+    template<typename Int, typename = std::enable_if_t<std::is_integral_v<Int>>>
+    friend ModMatrix operator*(Int l, ModMatrix r) {
+      return std::move(r *= l);
+    }
+
+    // 行のまとまりごとに並列化する
+    friend ModMatrix operator*(const ModMatrix &l, const ModMatrix &r) {
+      assert(l.m_cols == r.m_rows && l.m_mod == r.m_mod);
+      std::size_t m = l.m_rows, n = r.m_cols, k = l.m_cols;
+      ModMatrix ret(m, n, l.m_mod, NoInit{});
+      Execution policy = (m * n * k < kernels::kGemmParallelThreshold) ? Execution::Sequential : Execution::Parallel;
+      parallelFor(policy, 0, m, [&](std::size_t first, std::size_t last) {
+        kernels::modGemm(last - first, n, k, l.data() + first * k, k, r.data(), n, ret.data() + first * n, n, l.m_mod);
+      }, kGemmGrain);
+      return ret;
+    }
+
+    friend bool operator==(const ModMatrix &l, const ModMatrix &r) {
+      return l.dim() == r.dim() && l.m_mod == r.m_mod && std::equal(l.m_values.begin(), l.m_values.end(),
+        r.m_values.begin());
+    }
+
+    friend bool operator!=(const ModMatrix &l, const ModMatrix &r) {
+      return !(l == r);
+    }
+
+    friend std::ostream &operator<<(std::ostream &os, const ModMatrix &mat) {
+      for (std::size_t i = 0; i < mat.m_rows; i++) {
+        for (std::size_t j = 0; j < mat.m_cols; j++) {
+          os << mat(i, j);
+          if (i != mat.m_rows - 1 && j == mat.m_cols - 1) {
+            os << '\n';
+          } else if (j != mat.m_cols - 1) {
+            os << ' ';
+          }
+        }
+      }
+      return os;
+    }
+
+    // 関数
+
+    // 繰り返し二乗法による累乗．線形漸化式の n 項目は遷移行列の n 乗で求まる
+    ModMatrix pow(std::uint64_t e) const {
+      assert(m_rows == m_cols);
+      ModMatrix ret = identity(m_rows, m_mod), base = *this;
+      for (; e > 0; e >>= 1) {
+        if (e & 1) {
+          ret *= base;
+        }
+        if (e > 1) {
+          base *= base;
+        }
+      }
+      return ret;
+    }
+  };
+} // namespace mywheels
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "math/Cpu.hpp"
+
+// GCC/Clang では同じカーネルを命令セットごとに target 属性付きでコンパイルし，実行時に選ぶ．
+// flatten で内部の呼び出しをすべて展開させ，ベースラインのコードが混ざらないようにする
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#  define MYWHEELS_MULTIVERSION 1
+#  define MYWHEELS_TARGET(isa) __attribute__((target(isa), flatten))
+#else
+#  define MYWHEELS_TARGET(isa)
+#endif
+
+#if defined(_MSC_VER)
+#  define MYWHEELS_RESTRICT __restrict
+#else
+#  define MYWHEELS_RESTRICT __restrict__
+#endif
+
+// Isa の各段階の target 属性．detectedIsa() が確かめる機能と揃える
+#define MYWHEELS_TARGET_SSE42 MYWHEELS_TARGET("sse4.2,popcnt")
+#define MYWHEELS_TARGET_AVX2 MYWHEELS_TARGET("avx2,fma,popcnt")
+#define MYWHEELS_TARGET_AVX512                                                                                     \
+  MYWHEELS_TARGET("avx512f,avx512dq,avx512bw,avx512vl,avx2,fma,popcnt,prefer-vector-width=512")
+
+// DEFINE(NS, ISA, TARGET) を各段階について展開し，名前空間 generic, sse42, avx2, avx512 にカーネルを定義させる．
+// 命令セットごとにコンパイルできなければ generic だけを定義し，他の名前はそれを指す
+#ifdef MYWHEELS_MULTIVERSION
+#  define MYWHEELS_DEFINE_FOR_EACH_ISA(DEFINE)                                                                     \
+    DEFINE(generic, Isa::Generic, )                                                                                  \
+    DEFINE(sse42, Isa::SSE42, MYWHEELS_TARGET_SSE42)                                                                 \
+    DEFINE(avx2, Isa::AVX2, MYWHEELS_TARGET_AVX2)                                                                    \
+    DEFINE(avx512, Isa::AVX512, MYWHEELS_TARGET_AVX512)
+#else
+#  define MYWHEELS_DEFINE_FOR_EACH_ISA(DEFINE)                                                                     \
+    DEFINE(generic, Isa::Generic, )                                                                                  \
+    namespace sse42 = generic;                                                                                       \
+    namespace avx2 = generic;                                                                                        \
+    namespace avx512 = generic;
+#endif
+
+namespace mywheels {
+  // isa の段階向けにコンパイルしたもの
+  template<typename T>
+  const T &selectIsa(Isa isa, const T &generic, const T &sse42, const T &avx2, const T &avx512) {
+    switch (isa) {
+    case Isa::AVX512:
+      return avx512;
+    case Isa::AVX2:
+      return avx2;
+    case Isa::SSE42:
+      return sse42;
+    default:
+      return generic;
+    }
+  }
+} // namespace mywheels
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// NUMA ノードの構成，大きな領域のページの置き場所，スレッドの CPU への固定．
+// Linux 以外ではノードは 1 つとみなし，置き場所の指定と固定は何もしない
+namespace mywheels {
+  namespace numa {
+    // 大きな領域のページの置き場所
+    enum class Placement {
+      FirstTouch, // OS の既定．最初に書き込んだスレッドのノードに置く．Matrix/Vector はカーネルと同じ分割で並列に初期化する
+      Interleave, // 全ノードにページ単位で交互に置く
+      Bind        // 指定したノードに置く
+    };
+
+    // ThreadPool のワーカースレッドを置く CPU の選び方
+    enum class Affinity {
+      None,    // 固定しない
+      Compact, // ノード 0 の CPU から順に詰める
+      Spread   // ノードを順に巡って 1 つずつ置く
+    };
+
+    // これより小さな確保には配置の方針を適用しない
+    constexpr std::size_t kPlacementMinBytes = std::size_t(1) << 21;
+
+    // NUMA ノードの数．取得できなければ 1
+    std::size_t nodeCount();
+
+    // ノード node に属し，このプロセスが使える CPU の番号
+    const std::vector<int> &nodeCpus(std::size_t node);
+
+    // 現在のスレッドが動いている CPU のノード．取得できなければ 0
+    std::size_t currentNode();
+
+    // DefaultInitAllocator が大きな領域に適用する方針．
+    // 初期値は環境変数 MYWHEELS_NUMA (first-touch, interleave, bind:N) で決める
+    Placement placement();
+    std::size_t placementNode();
+    void setPlacement(Placement policy, std::size_t node = 0);
+
+    // [p, p + bytes) に完全に含まれるページに policy を適用する．書き込み済みのページは移動する．成功したら true
+    bool place(void *p, std::size_t bytes, Placement policy, std::size_t node = 0);
+
+    // 現在の方針を適用する．FirstTouch なら何もしない
+    void place(void *p, std::size_t bytes);
+
+    // [p, p + bytes) に完全に含まれるページの方針を OS の既定に戻す．place した領域を解放する前に呼ぶ．
+    // 戻さないと解放したページをヒープが再利用した時に，無関係な確保にも方針が残る
+    void reset(void *p, std::size_t bytes);
+
+    // 現在のスレッドを CPU cpu に固定する．成功したら true
+    bool pinCurrentThread(int cpu);
+
+    // affinity に従って i 番目のスレッドを置く CPU．None なら -1
+    int affinityCpu(Affinity affinity, std::size_t i);
+
+    // 環境変数 MYWHEELS_AFFINITY (none, compact, spread) で決める既定の固定方法
+    Affinity defaultAffinity();
+  } // namespace numa
+} // namespace mywheels
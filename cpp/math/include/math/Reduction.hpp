@@ -0,0 +1,444 @@
+#pragma once
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <functional>
+#include <type_traits>
+#include <cassert>
+#include "math/ThreadPool.hpp"
+
+namespace mywheels {
+  // 総和の計算方法
+  enum class Summation {
+    Naive,    // 複数アキュムレータによる単純な総和
+    Pairwise, // ペアワイズ総和．誤差は O(log n)
+    Kahan     // Kahan-Babuska (Neumaier) の補償付き総和．誤差は O(1)
+  };
+
+  namespace reduction {
+    // 依存チェーンを断ち切るための独立したアキュムレータの数
+    constexpr std::size_t kLanes = 8;
+    // ペアワイズ総和で再帰を打ち切る要素数
+    constexpr std::size_t kPairwiseBlock = 256;
+    // これ以上の要素数の時にスレッドを分割する
+    constexpr std::size_t kParallelThreshold = std::size_t(1) << 18;
+    // 並列化する時の区間の数の上限
+    constexpr std::size_t kMaxChunks = 256;
+
+    namespace detail {
+      template<typename T>
+      T magnitude(T x) {
+        return (x < T(0)) ? -x : x;
+      }
+
+      // Neumaier の補償付き加算 (s, c) += x
+      template<typename T>
+      void compensatedAdd(T &s, T &c, T x) {
+        T t = s + x;
+        if (magnitude(s) >= magnitude(x)) {
+          c += (s - t) + x;
+        } else {
+          c += (x - t) + s;
+        }
+        s = t;
+      }
+
+      template<typename T>
+      T combineLanes(const T (&acc)[kLanes]) {
+        T ret[kLanes / 2];
+        for (std::size_t l = 0; l < kLanes / 2; l++) {
+          ret[l] = acc[l] + acc[l + kLanes / 2];
+        }
+        for (std::size_t w = kLanes / 4; w > 0; w /= 2) {
+          for (std::size_t l = 0; l < w; l++) {
+            ret[l] = ret[l] + ret[l + w];
+          }
+        }
+        return ret[0];
+      }
+
+      // [first, last) の f(i) の総和．kLanes 個のアキュムレータでベクトル化させる
+      template<typename T, typename F>
+      T blockSum(std::size_t first, std::size_t last, const F &f) {
+        T acc[kLanes];
+        std::fill(std::begin(acc), std::end(acc), T(0));
+        std::size_t i = first;
+        for (; i + kLanes <= last; i += kLanes) {
+          for (std::size_t l = 0; l < kLanes; l++) {
+            acc[l] += f(i + l);
+          }
+        }
+        T ret = combineLanes(acc);
+        for (; i < last; i++) {
+          ret += f(i);
+        }
+        return ret;
+      }
+
+      // ブロック和を二進カウンタの要領で同じ段同士併合するペアワイズ総和．
+      // 再帰しないので呼び出し側へ完全にインライン展開できる
+      template<typename T, typename F>
+      T pairwiseSum(std::size_t first, std::size_t last, const F &f) {
+        constexpr std::size_t kLevels = 64;
+        T partial[kLevels];
+        std::size_t top = 0;
+        std::size_t blocks = 0;
+        for (std::size_t i = first; i < last; i += kPairwiseBlock) {
+          T s = blockSum<T>(i, std::min(last, i + kPairwiseBlock), f);
+          blocks++;
+          for (std::size_t b = blocks; (b & 1) == 0; b >>= 1) {
+            s = partial[--top] + s;
+          }
+          partial[top++] = s;
+        }
+        T ret = T(0);
+        while (top > 0) {
+          ret = partial[--top] + ret;
+        }
+        return ret;
+      }
+
+      template<typename T, typename F>
+      T kahanSum(std::size_t first, std::size_t last, const F &f) {
+        T s[kLanes], c[kLanes];
+        std::fill(std::begin(s), std::end(s), T(0));
+        std::fill(std::begin(c), std::end(c), T(0));
+        std::size_t i = first;
+        for (; i + kLanes <= last; i += kLanes) {
+          for (std::size_t l = 0; l < kLanes; l++) {
+            compensatedAdd(s[l], c[l], f(i + l));
+          }
+        }
+        for (std::size_t l = 0; i < last; i++, l++) {
+          compensatedAdd(s[l], c[l], f(i));
+        }
+        T sum = T(0), comp = T(0);
+        for (std::size_t l = 0; l < kLanes; l++) {
+          compensatedAdd(sum, comp, s[l]);
+          comp += c[l];
+        }
+        return sum + comp;
+      }
+
+      template<typename T, typename F>
+      T serialSum(std::size_t first, std::size_t last, const F &f, Summation method) {
+        if constexpr (!std::is_floating_point_v<T>) {
+          return blockSum<T>(first, last, f);
+        } else {
+          switch (method) {
+          case Summation::Naive:
+            return blockSum<T>(first, last, f);
+          case Summation::Kahan:
+            return kahanSum<T>(first, last, f);
+          case Summation::Pairwise:
+          default:
+            return pairwiseSum<T>(first, last, f);
+          }
+        }
+      }
+
+      // 区間の数は結果がスレッドの割り当てに依らないよう要素数だけで決める
+      inline std::size_t chunkCount(std::size_t n) {
+        if (n < kParallelThreshold || ThreadPool::global().size() <= 1) {
+          return 1;
+        }
+        return std::min(kMaxChunks, n / (kParallelThreshold / 4));
+      }
+
+      // [0, n) を count 個の連続区間に分けて fn(chunk, first, last) をスレッドプールで実行する
+      template<typename F>
+      void forEachChunk(std::size_t n, std::size_t count, const F &fn) {
+        if (count <= 1) {
+          fn(std::size_t(0), std::size_t(0), n);
+          return;
+        }
+        ThreadPool::global().parallelFor(0, count, 1, [&](std::size_t c0, std::size_t c1) {
+          for (std::size_t c = c0; c < c1; c++) {
+            fn(c, n * c / count, n * (c + 1) / count);
+          }
+        });
+      }
+
+      template<typename T>
+      T combinePartials(const std::vector<T> &partials) {
+        if constexpr (std::is_floating_point_v<T>) {
+          T sum = T(0), comp = T(0);
+          for (const auto &p : partials) {
+            compensatedAdd(sum, comp, p);
+          }
+          return sum + comp;
+        } else {
+          T sum = T(0);
+          for (const auto &p : partials) {
+            sum += p;
+          }
+          return sum;
+        }
+      }
+
+      // f(i) が cmp で最も優先される値とそのインデックス．同値の場合は小さいインデックスを返す
+      template<typename T, typename F, typename Compare>
+      std::pair<T, std::size_t> serialExtremum(std::size_t first, std::size_t last, const F &f, Compare cmp) {
+        T best[kLanes];
+        std::size_t index[kLanes];
+        std::fill(std::begin(best), std::end(best), f(first));
+        std::fill(std::begin(index), std::end(index), first);
+        std::size_t i = first;
+        for (; i + kLanes <= last; i += kLanes) {
+          for (std::size_t l = 0; l < kLanes; l++) {
+            T v = f(i + l);
+            bool better = cmp(v, best[l]);
+            best[l] = better ? v : best[l];
+            index[l] = better ? i + l : index[l];
+          }
+        }
+        for (; i < last; i++) {
+          T v = f(i);
+          if (cmp(v, best[0])) {
+            best[0] = v;
+            index[0] = i;
+          }
+        }
+        std::pair<T, std::size_t> ret{best[0], index[0]};
+        for (std::size_t l = 1; l < kLanes; l++) {
+          if (cmp(best[l], ret.first) || (!cmp(ret.first, best[l]) && index[l] < ret.second)) {
+            ret = {best[l], index[l]};
+          }
+        }
+        return ret;
+      }
+    } // namespace detail
+
+    // [0, n) を区間に分けて partial(first, last) を並列に計算し，その総和を返す
+    template<typename T, typename P>
+    T chunkedSum(std::size_t n, const P &partial) {
+      std::size_t count = detail::chunkCount(n);
+      if (count <= 1) {
+        return partial(std::size_t(0), n);
+      }
+      std::vector<T> partials(count);
+      detail::forEachChunk(n, count, [&](std::size_t c, std::size_t first, std::size_t last) {
+        partials[c] = partial(first, last);
+      });
+      return detail::combinePartials(partials);
+    }
+
+    // f(0) + f(1) + ... + f(n - 1)
+    template<typename T, typename F>
+    T transformSum(std::size_t n, const F &f, Summation method = Summation::Pairwise) {
+      return chunkedSum<T>(n, [&](std::size_t first, std::size_t last) {
+        return detail::serialSum<T>(first, last, f, method);
+      });
+    }
+
+    template<typename T, typename F, typename Compare>
+    std::pair<T, std::size_t> transformExtremum(std::size_t n, const F &f, Compare cmp) {
+      assert(n > 0);
+      std::size_t count = detail::chunkCount(n);
+      if (count <= 1) {
+        return detail::serialExtremum<T>(0, n, f, cmp);
+      }
+      std::vector<std::pair<T, std::size_t>> partials(count);
+      detail::forEachChunk(n, count, [&](std::size_t c, std::size_t first, std::size_t last) {
+        partials[c] = detail::serialExtremum<T>(first, last, f, cmp);
+      });
+      auto ret = partials[0];
+      for (std::size_t c = 1; c < count; c++) {
+        if (cmp(partials[c].first, ret.first)) {
+          ret = partials[c];
+        }
+      }
+      return ret;
+    }
+
+    template<typename T>
+    T sum(const T *x, std::size_t n, Summation method = Summation::Pairwise) {
+      return transformSum<T>(n, [x](std::size_t i) {
+        return x[i];
+      }, method);
+    }
+
+    template<typename T>
+    T dot(const T *x, const T *y, std::size_t n, Summation method = Summation::Pairwise) {
+      return transformSum<T>(n, [x, y](std::size_t i) {
+        return x[i] * y[i];
+      }, method);
+    }
+
+    template<typename T>
+    T min(const T *x, std::size_t n) {
+      return transformExtremum<T>(n, [x](std::size_t i) {
+        return x[i];
+      }, std::less<T>()).first;
+    }
+
+    template<typename T>
+    T max(const T *x, std::size_t n) {
+      return transformExtremum<T>(n, [x](std::size_t i) {
+        return x[i];
+      }, std::greater<T>()).first;
+    }
+
+    template<typename T>
+    std::size_t argmin(const T *x, std::size_t n) {
+      return transformExtremum<T>(n, [x](std::size_t i) {
+        return x[i];
+      }, std::less<T>()).second;
+    }
+
+    template<typename T>
+    std::size_t argmax(const T *x, std::size_t n) {
+      return transformExtremum<T>(n, [x](std::size_t i) {
+        return x[i];
+      }, std::greater<T>()).second;
+    }
+
+    // 行優先 rows x cols 行列 a の各行の総和を out[rows] に書き込む
+    template<typename T>
+    void rowSum(const T *a, std::size_t rows, std::size_t cols, T *out, Summation method = Summation::Pairwise) {
+      std::size_t count = std::min(std::max<std::size_t>(rows, 1), detail::chunkCount(rows * cols));
+      detail::forEachChunk(rows, count, [&](std::size_t, std::size_t first, std::size_t last) {
+        for (std::size_t i = first; i < last; i++) {
+          const T *r = a + i * cols;
+          out[i] = detail::serialSum<T>(0, cols, [r](std::size_t j) {
+            return r[j];
+          }, method);
+        }
+      });
+    }
+
+    // 行優先 rows x cols 行列 a の各列の総和を out[cols] に書き込む
+    // 行を連続に読みながら列ごとのアキュムレータへ加算する
+    template<typename T>
+    void colSum(const T *a, std::size_t rows, std::size_t cols, T *out, Summation method = Summation::Pairwise) {
+      std::size_t count = std::min(std::max<std::size_t>(rows, 1), detail::chunkCount(rows * cols));
+      std::vector<T> sums(count * cols, T(0));
+      std::vector<T> comps(method == Summation::Kahan ? count * cols : 0, T(0));
+      detail::forEachChunk(rows, count, [&](std::size_t c, std::size_t first, std::size_t last) {
+        T *s = sums.data() + c * cols;
+        if (method == Summation::Kahan) {
+          T *comp = comps.data() + c * cols;
+          for (std::size_t i = first; i < last; i++) {
+            for (std::size_t j = 0; j < cols; j++) {
+              detail::compensatedAdd(s[j], comp[j], a[i * cols + j]);
+            }
+          }
+          for (std::size_t j = 0; j < cols; j++) {
+            s[j] += comp[j];
+          }
+        } else if (method == Summation::Pairwise) {
+          // pairwiseSum と同じく，kPairwiseBlock 行ごとのブロック和を二進カウンタの要領で同じ段同士併合する．
+          // partial には段ごとに cols 個の部分和を積む
+          std::vector<T> partial;
+          std::vector<T> block(cols);
+          std::size_t top = 0;
+          std::size_t blocks = 0;
+          for (std::size_t i0 = first; i0 < last; i0 += kPairwiseBlock) {
+            std::size_t i1 = std::min(last, i0 + kPairwiseBlock);
+            std::fill(block.begin(), block.end(), T(0));
+            for (std::size_t i = i0; i < i1; i++) {
+              for (std::size_t j = 0; j < cols; j++) {
+                block[j] += a[i * cols + j];
+              }
+            }
+            blocks++;
+            for (std::size_t b = blocks; (b & 1) == 0; b >>= 1) {
+              const T *p = partial.data() + --top * cols;
+              for (std::size_t j = 0; j < cols; j++) {
+                block[j] = p[j] + block[j];
+              }
+            }
+            if (partial.size() < (top + 1) * cols) {
+              partial.resize((top + 1) * cols);
+            }
+            std::copy(block.begin(), block.end(), partial.begin() + top++ * cols);
+          }
+          while (top > 0) {
+            const T *p = partial.data() + --top * cols;
+            for (std::size_t j = 0; j < cols; j++) {
+              s[j] = p[j] + s[j];
+            }
+          }
+        } else {
+          for (std::size_t i = first; i < last; i++) {
+            for (std::size_t j = 0; j < cols; j++) {
+              s[j] += a[i * cols + j];
+            }
+          }
+        }
+      });
+      // 区間ごとの部分和も隣同士で併合する
+      for (std::size_t w = 1; w < count; w *= 2) {
+        for (std::size_t c = 0; c + w < count; c += 2 * w) {
+          T *s = sums.data() + c * cols;
+          const T *t = sums.data() + (c + w) * cols;
+          for (std::size_t j = 0; j < cols; j++) {
+            s[j] += t[j];
+          }
+        }
+      }
+      std::copy(sums.begin(), sums.begin() + cols, out);
+    }
+
+    // 行優先 rows x cols 行列 a の各行で cmp が最も優先される値とインデックス
+    template<typename T, typename Compare>
+    void rowExtremum(const T *a, std::size_t rows, std::size_t cols, T *value, std::size_t *index, Compare cmp) {
+      assert(cols > 0);
+      std::size_t count = std::min(std::max<std::size_t>(rows, 1), detail::chunkCount(rows * cols));
+      detail::forEachChunk(rows, count, [&](std::size_t, std::size_t first, std::size_t last) {
+        for (std::size_t i = first; i < last; i++) {
+          const T *r = a + i * cols;
+          auto ret = detail::serialExtremum<T>(0, cols, [r](std::size_t j) {
+            return r[j];
+          }, cmp);
+          if (value) {
+            value[i] = ret.first;
+          }
+          if (index) {
+            index[i] = ret.second;
+          }
+        }
+      });
+    }
+
+    // 行優先 rows x cols 行列 a の各列で cmp が最も優先される値とインデックス
+    template<typename T, typename Compare>
+    void colExtremum(const T *a, std::size_t rows, std::size_t cols, T *value, std::size_t *index, Compare cmp) {
+      assert(rows > 0);
+      // 行を区間に分けて区間ごとに求め，区間の順に併合する．同値の場合は小さいインデックスが残る
+      std::size_t count = std::min(rows, detail::chunkCount(rows * cols));
+      std::vector<T> best(count * cols);
+      std::vector<std::size_t> at(count * cols);
+      detail::forEachChunk(rows, count, [&](std::size_t c, std::size_t first, std::size_t last) {
+        T *b = best.data() + c * cols;
+        std::size_t *k = at.data() + c * cols;
+        std::copy(a + first * cols, a + (first + 1) * cols, b);
+        std::fill(k, k + cols, first);
+        for (std::size_t i = first + 1; i < last; i++) {
+          const T *r = a + i * cols;
+          for (std::size_t j = 0; j < cols; j++) {
+            bool better = cmp(r[j], b[j]);
+            b[j] = better ? r[j] : b[j];
+            k[j] = better ? i : k[j];
+          }
+        }
+      });
+      for (std::size_t c = 1; c < count; c++) {
+        const T *b = best.data() + c * cols;
+        const std::size_t *k = at.data() + c * cols;
+        for (std::size_t j = 0; j < cols; j++) {
+          bool better = cmp(b[j], best[j]);
+          best[j] = better ? b[j] : best[j];
+          at[j] = better ? k[j] : at[j];
+        }
+      }
+      if (value) {
+        std::copy(best.begin(), best.begin() + cols, value);
+      }
+      if (index) {
+        std::copy(at.begin(), at.begin() + cols, index);
+      }
+    }
+  } // namespace reduction
+} // namespace mywheels
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cassert>
+#include "math/ThreadPool.hpp"
+#include "math/Kernels.hpp"
+#include "math/Vector.hpp"
+#include "math/Matrix.hpp"
+
+// 行ごとの softmax, log-softmax と交差エントロピー．
+// 各行は最大値を求める走査と exp(x - max) の総和を求める走査の 2 回で読み，正規化は結果の行の上で行う
+namespace mywheels {
+  namespace detail {
+    // log(sum(exp(x)))．最大値を引いてから exp を取るのでオーバーフローしない
+    template<typename Scalar>
+    Scalar logSumExp(const Scalar *x, std::size_t n) {
+      Scalar m = kernels::max(x, n);
+      if (!std::isfinite(m)) {
+        return m;
+      }
+      return m + std::log(kernels::expSum(n, x, m));
+    }
+
+    template<typename Scalar>
+    void softmax(std::size_t n, const Scalar *x, Scalar *out) {
+      Scalar m = kernels::max(x, n);
+      Scalar s = kernels::expSum(n, x, m, out);
+      kernels::scale(n, out, Scalar(1) / s, out);
+    }
+
+    template<typename Scalar>
+    void logSoftmax(std::size_t n, const Scalar *x, Scalar *out) {
+      Scalar lse = logSumExp(x, n);
+      for (std::size_t j = 0; j < n; j++) {
+        out[j] = x[j] - lse;
+      }
+    }
+  } // namespace detail
+
+  // 各行の log(sum(exp(x)))
+  template<typename Scalar>
+  Vector<Scalar> logSumExp(const Matrix<Scalar> &x, Execution policy = Execution::Auto) {
+    std::size_t rows = x.dim().first, cols = x.dim().second;
+    Vector<Scalar> ret(rows);
+    const Scalar *p = x.data();
+    Scalar *out = ret.data();
+    detail::forEachRow(rows, cols, policy, [&](std::size_t i) {
+      out[i] = detail::logSumExp(p + i * cols, cols);
+    });
+    return ret;
+  }
+
+  template<typename Scalar>
+  Scalar logSumExp(const Vector<Scalar> &x) {
+    return detail::logSumExp(x.data(), x.dim());
+  }
+
+  // 行ごとの softmax．右辺値を渡すとその領域に書き込む
+  template<typename Scalar>
+  Matrix<Scalar> softmax(Matrix<Scalar> x, Execution policy = Execution::Auto) {
+    std::size_t rows = x.dim().first, cols = x.dim().second;
+    Scalar *p = x.data();
+    detail::forEachRow(rows, cols, policy, [&](std::size_t i) {
+      detail::softmax(cols, p + i * cols, p + i * cols);
+    });
+    return x;
+  }
+
+  template<typename Scalar>
+  Vector<Scalar> softmax(Vector<Scalar> x) {
+    detail::softmax(x.dim(), x.data(), x.data());
+    return x;
+  }
+
+  // 行ごとの log(softmax(x)) = x - logSumExp(x)
+  template<typename Scalar>
+  Matrix<Scalar> logSoftmax(Matrix<Scalar> x, Execution policy = Execution::Auto) {
+    std::size_t rows = x.dim().first, cols = x.dim().second;
+    Scalar *p = x.data();
+    detail::forEachRow(rows, cols, policy, [&](std::size_t i) {
+      detail::logSoftmax(cols, p + i * cols, p + i * cols);
+    });
+    return x;
+  }
+
+  template<typename Scalar>
+  Vector<Scalar> logSoftmax(Vector<Scalar> x) {
+    detail::logSoftmax(x.dim(), x.data(), x.data());
+    return x;
+  }
+
+  // 行 i の正解が labels[i] である時の交差エントロピーの平均．
+  // 行ごとに logSumExp(x_i) - x_i[labels[i]] を求めるので確率の行列は作らない
+  template<typename Scalar>
+  Scalar crossEntropy(const Matrix<Scalar> &logits, const std::vector<std::size_t> &labels,
+    Execution policy = Execution::Auto) {
+    std::size_t rows = logits.dim().first, cols = logits.dim().second;
+    assert(labels.size() == rows);
+    Vector<Scalar> loss(rows);
+    const Scalar *p = logits.data();
+    Scalar *lp = loss.data();
+    detail::forEachRow(rows, cols, policy, [&](std::size_t i) {
+      const Scalar *x = p + i * cols;
+      assert(labels[i] < cols);
+      lp[i] = detail::logSumExp(x, cols) - x[labels[i]];
+    });
+    return loss.sum() / static_cast<Scalar>(rows);
+  }
+
+  // softmax と交差エントロピーの順伝播と逆伝播を融合したもの．平均の損失を返し，
+  // logits についての勾配 (softmax(x_i) - onehot(labels[i])) / rows を grad に書き込む．
+  // 最大値 m を求めた後，exp(x - m) を 1 回だけ計算して grad へ書き，その総和 s から損失を求めてから
+  // grad を 1 / (s rows) 倍するので，行ごとに x を 2 回読んで exp は要素数だけで済む
+  template<typename Scalar>
+  Scalar softmaxCrossEntropy(const Matrix<Scalar> &logits, const std::vector<std::size_t> &labels,
+    Matrix<Scalar> &grad, Execution policy = Execution::Auto) {
+    std::size_t rows = logits.dim().first, cols = logits.dim().second;
+    assert(labels.size() == rows);
+    if (grad.dim() != logits.dim()) {
+      grad = Matrix<Scalar>(rows, cols);
+    }
+    Scalar inv = Scalar(1) / static_cast<Scalar>(rows);
+    Vector<Scalar> loss(rows);
+    // grad が共有されていればここで 1 回だけ複製する
+    const Scalar *p = logits.data();
+    Scalar *gp = grad.data();
+    Scalar *lp = loss.data();
+    detail::forEachRow(rows, cols, policy, [&](std::size_t i) {
+      const Scalar *x = p + i * cols;
+      Scalar *g = gp + i * cols;
+      std::size_t y = labels[i];
+      assert(y < cols);
+      Scalar m = kernels::max(x, cols);
+      Scalar s = kernels::expSum(cols, x, m, g);
+      lp[i] = m + std::log(s) - x[y];
+      kernels::scale(cols, g, inv / s, g);
+      g[y] -= inv;
+    });
+    return loss.sum() / static_cast<Scalar>(rows);
+  }
+} // namespace mywheels
@@ -0,0 +1,414 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cassert>
+#include "math/ThreadPool.hpp"
+#include "math/Reduction.hpp"
+#include "math/Vector.hpp"
+#include "math/Matrix.hpp"
+#include "math/SymmetricMatrix.hpp"
+
+// 行のチャンクを順に与えて列ごとの平均，分散，共分散を 1 回の走査で求める累積器と，それを使う batch normalization．
+// チャンクの中は Welford の更新，チャンク同士やスレッドごとの部分結果は Chan の併合でまとめるので，
+// 全体を一度に持たなくても 2 パスの計算と同程度の精度が出る
+namespace mywheels {
+  namespace detail {
+    // 列ごとの (個数, 平均, 偏差平方和) の併合．(na, ma, m2a) に (nb, mb, m2b) を併合する
+    template<typename Scalar>
+    void chanMerge(std::size_t cols, std::size_t na, Scalar *ma, Scalar *m2a, std::size_t nb, const Scalar *mb,
+      const Scalar *m2b) {
+      if (nb == 0) {
+        return;
+      }
+      Scalar n = static_cast<Scalar>(na + nb);
+      Scalar wb = static_cast<Scalar>(nb) / n;
+      Scalar w = static_cast<Scalar>(na) * wb;
+      for (std::size_t j = 0; j < cols; j++) {
+        Scalar delta = mb[j] - ma[j];
+        ma[j] += delta * wb;
+        m2a[j] += m2b[j] + delta * delta * w;
+      }
+    }
+
+    // 行優先 rows x cols 行列 x の行 [first, last) を Welford の方法で mean, m2 に加える．mean, m2 は 0 で始める
+    template<typename Scalar>
+    void welfordRows(const Scalar *x, std::size_t cols, std::size_t first, std::size_t last, Scalar *mean, Scalar *m2) {
+      for (std::size_t i = first; i < last; i++) {
+        const Scalar *r = x + i * cols;
+        Scalar inv = Scalar(1) / static_cast<Scalar>(i - first + 1);
+        for (std::size_t j = 0; j < cols; j++) {
+          Scalar delta = r[j] - mean[j];
+          mean[j] += delta * inv;
+          m2[j] += delta * (r[j] - mean[j]);
+        }
+      }
+    }
+
+    // 行を分ける区間の数．結果がスレッドの割り当てに依らないよう要素数だけで決める
+    inline std::size_t rowChunkCount(std::size_t rows, std::size_t cols, Execution policy) {
+      if (resolveExecution(policy, rows * cols) == Execution::Sequential) {
+        return 1;
+      }
+      return std::min(std::max<std::size_t>(rows, 1), reduction::detail::chunkCount(rows * cols));
+    }
+
+    // 行優先 rows x cols 行列 x の列ごとの平均と偏差平方和．行の区間ごとに Welford で求め，区間の順に併合する
+    template<typename Scalar>
+    void columnMoments(const Scalar *x, std::size_t rows, std::size_t cols, Execution policy, Scalar *mean,
+      Scalar *m2) {
+      std::size_t count = rowChunkCount(rows, cols, policy);
+      std::fill(mean, mean + cols, Scalar(0));
+      std::fill(m2, m2 + cols, Scalar(0));
+      if (count <= 1) {
+        welfordRows(x, cols, 0, rows, mean, m2);
+        return;
+      }
+      std::vector<Scalar> partial(2 * count * cols, Scalar(0));
+      reduction::detail::forEachChunk(rows, count, [&](std::size_t c, std::size_t first, std::size_t last) {
+        welfordRows(x, cols, first, last, partial.data() + 2 * c * cols, partial.data() + (2 * c + 1) * cols);
+      });
+      std::size_t n = 0;
+      for (std::size_t c = 0; c < count; c++) {
+        std::size_t first = rows * c / count, last = rows * (c + 1) / count;
+        chanMerge(cols, n, mean, m2, last - first, partial.data() + 2 * c * cols, partial.data() + (2 * c + 1) * cols);
+        n += last - first;
+      }
+    }
+  } // namespace detail
+
+  // 列ごとの平均と分散の累積器．update で行のチャンクを加え，merge で別の累積器 (別スレッドや別シャードの結果) を併合する
+  template<typename Scalar>
+  class ColumnStats {
+  private:
+    std::size_t m_count;
+    Vector<Scalar> m_mean;
+    // 平均からの偏差の平方和
+    Vector<Scalar> m_m2;
+
+  public:
+    // 初期化
+
+    explicit ColumnStats(std::size_t cols) : m_count(0), m_mean(cols), m_m2(cols) {};
+
+    // 行列 x の全ての行を加えたもの
+    explicit ColumnStats(const Matrix<Scalar> &x, Execution policy = Execution::Auto) : ColumnStats(x.dim().second) {
+      update(x, policy);
+    }
+
+    // 更新
+
+    // チャンク x の行を加える
+    ColumnStats &update(const Matrix<Scalar> &x, Execution policy = Execution::Auto) {
+      auto [rows, cols] = x.dim();
+      assert(cols == this->cols());
+      if (rows == 0) {
+        return *this;
+      }
+      Vector<Scalar> mean(cols), m2(cols);
+      detail::columnMoments(x.data(), rows, cols, policy, mean.data(), m2.data());
+      detail::chanMerge(cols, m_count, m_mean.data(), m_m2.data(), rows, mean.data(), m2.data());
+      m_count += rows;
+      return *this;
+    }
+
+    // 1 行を加える
+    ColumnStats &update(const Vector<Scalar> &x) {
+      assert(x.dim() == cols());
+      m_count++;
+      Scalar inv = Scalar(1) / static_cast<Scalar>(m_count);
+      for (std::size_t j = 0; j < cols(); j++) {
+        Scalar delta = x(j) - m_mean(j);
+        m_mean(j) += delta * inv;
+        m_m2(j) += delta * (x(j) - m_mean(j));
+      }
+      return *this;
+    }
+
+    ColumnStats &merge(const ColumnStats &r) {
+      assert(cols() == r.cols());
+      detail::chanMerge(cols(), m_count, m_mean.data(), m_m2.data(), r.m_count, r.m_mean.data(), r.m_m2.data());
+      m_count += r.m_count;
+      return *this;
+    }
+
+    // 要素の参照
+
+    std::size_t count() const {
+      return m_count;
+    }
+
+    std::size_t cols() const {
+      return m_mean.dim();
+    }
+
+    const Vector<Scalar> &mean() const {
+      return m_mean;
+    }
+
+    // 偏差平方和を count - ddof で割ったもの．標本分散なら ddof = 1
+    Vector<Scalar> variance(std::size_t ddof = 0) const {
+      assert(m_count > ddof);
+      return m_m2 / static_cast<Scalar>(m_count - ddof);
+    }
+
+    Vector<Scalar> stddev(std::size_t ddof = 0) const {
+      Vector<Scalar> ret = variance(ddof);
+      for (std::size_t j = 0; j < cols(); j++) {
+        ret(j) = std::sqrt(ret(j));
+      }
+      return ret;
+    }
+
+    // 演算子
+
+    friend ColumnStats operator+(ColumnStats l, const ColumnStats &r) {
+      return std::move(l.merge(r));
+    }
+
+    friend std::ostream &operator<<(std::ostream &os, const ColumnStats &s) {
+      return os << "count: " << s.m_count << "\nmean: " << s.m_mean << "\nvariance: " << s.m_m2 / Scalar(s.m_count);
+    }
+  };
+
+  // 列同士の共分散の累積器．チャンクごとに平均を引いた行列の SYRK で共偏差積和を求め，Chan の方法で併合する
+  template<typename Scalar>
+  class CovarianceStats {
+  private:
+    std::size_t m_count;
+    Vector<Scalar> m_mean;
+    // 平均からの偏差の積和 sum (x - mean) t(x - mean)
+    SymmetricMatrix<Scalar> m_comoment;
+
+    // 個数 n, 平均 mean, 共偏差積和 comoment の部分結果を併合する
+    void mergeMoments(std::size_t n, const Vector<Scalar> &mean, const SymmetricMatrix<Scalar> &comoment) {
+      if (n == 0) {
+        return;
+      }
+      std::size_t d = cols();
+      Vector<Scalar> delta = mean - m_mean;
+      Scalar w = static_cast<Scalar>(m_count) * static_cast<Scalar>(n) / static_cast<Scalar>(m_count + n);
+      m_comoment += comoment;
+      // 平均の差による rank-1 の補正 w * delta t(delta)
+      for (std::size_t i = 0; i < d; i++) {
+        Scalar di = w * delta(i);
+        for (std::size_t j = 0; j <= i; j++) {
+          m_comoment(i, j) += di * delta(j);
+        }
+      }
+      m_mean += delta * (static_cast<Scalar>(n) / static_cast<Scalar>(m_count + n));
+      m_count += n;
+    }
+
+  public:
+    // 初期化
+
+    explicit CovarianceStats(std::size_t cols) : m_count(0), m_mean(cols), m_comoment(cols) {};
+
+    explicit CovarianceStats(Matrix<Scalar> x, Execution policy = Execution::Auto) :
+      CovarianceStats(x.dim().second) {
+      update(std::move(x), policy);
+    }
+
+    // 更新
+
+    // チャンク x の行を加える．右辺値を渡すとその領域で平均を引く
+    CovarianceStats &update(Matrix<Scalar> x, Execution policy = Execution::Auto) {
+      std::size_t rows = x.dim().first, cols = x.dim().second;
+      assert(cols == this->cols());
+      if (rows == 0) {
+        return *this;
+      }
+      Vector<Scalar> mean(cols), m2(cols);
+      detail::columnMoments(x.data(), rows, cols, policy, mean.data(), m2.data());
+      Scalar *p = x.data();
+      const Scalar *mu = mean.data();
+      detail::forEachRow(rows, cols, policy, [&](std::size_t i) {
+        kernels::sub(cols, p + i * cols, mu, p + i * cols);
+      });
+      mergeMoments(rows, mean, SymmetricMatrix<Scalar>::syrk(x, true));
+      return *this;
+    }
+
+    CovarianceStats &merge(const CovarianceStats &r) {
+      assert(cols() == r.cols());
+      mergeMoments(r.m_count, r.m_mean, r.m_comoment);
+      return *this;
+    }
+
+    // 要素の参照
+
+    std::size_t count() const {
+      return m_count;
+    }
+
+    std::size_t cols() const {
+      return m_mean.dim();
+    }
+
+    const Vector<Scalar> &mean() const {
+      return m_mean;
+    }
+
+    // 共偏差積和を count - ddof で割ったもの．標本共分散なら ddof = 1
+    SymmetricMatrix<Scalar> covariance(std::size_t ddof = 0) const {
+      assert(m_count > ddof);
+      SymmetricMatrix<Scalar> ret = m_comoment;
+      ret *= Scalar(1) / static_cast<Scalar>(m_count - ddof);
+      return ret;
+    }
+
+    Vector<Scalar> variance(std::size_t ddof = 0) const {
+      assert(m_count > ddof);
+      Vector<Scalar> ret(cols());
+      for (std::size_t j = 0; j < cols(); j++) {
+        ret(j) = m_comoment(j, j) / static_cast<Scalar>(m_count - ddof);
+      }
+      return ret;
+    }
+
+    // 相関係数行列．分散が 0 の列との相関は 0 とする
+    SymmetricMatrix<Scalar> correlation() const {
+      std::size_t d = cols();
+      Vector<Scalar> inv(d);
+      for (std::size_t j = 0; j < d; j++) {
+        Scalar s = std::sqrt(m_comoment(j, j));
+        inv(j) = (s > Scalar(0)) ? Scalar(1) / s : Scalar(0);
+      }
+      SymmetricMatrix<Scalar> ret = m_comoment;
+      for (std::size_t i = 0; i < d; i++) {
+        for (std::size_t j = 0; j <= i; j++) {
+          ret(i, j) *= inv(i) * inv(j);
+        }
+      }
+      return ret;
+    }
+
+    // 演算子
+
+    friend CovarianceStats operator+(CovarianceStats l, const CovarianceStats &r) {
+      return std::move(l.merge(r));
+    }
+  };
+
+  // batch normalization の順伝播で求めた，逆伝播に使う列ごとの値
+  template<typename Scalar>
+  struct BatchNormCache {
+    // バッチの統計量．running.merge(cache.stats) でデータ全体の統計量に加えられる
+    ColumnStats<Scalar> stats{0};
+    // 1 / sqrt(var + eps)．var はバッチの (標本でない) 分散
+    Vector<Scalar> invStd{0};
+  };
+
+  // 与えた統計量で列ごとに正規化する (推論用)．y = gamma * (x - mean) / sqrt(var + eps) + beta．
+  // 右辺値を渡すとその領域に書き込む
+  template<typename Scalar>
+  Matrix<Scalar> batchNorm(Matrix<Scalar> x, const ColumnStats<Scalar> &stats, const Vector<Scalar> &gamma,
+    const Vector<Scalar> &beta, Scalar eps = Scalar(1e-5), Execution policy = Execution::Auto) {
+    std::size_t rows = x.dim().first, cols = x.dim().second;
+    assert(stats.cols() == cols && gamma.dim() == cols && beta.dim() == cols);
+    Vector<Scalar> var = stats.variance();
+    Vector<Scalar> scale(cols), shift(cols);
+    for (std::size_t j = 0; j < cols; j++) {
+      scale(j) = gamma(j) / std::sqrt(var(j) + eps);
+      shift(j) = beta(j) - stats.mean()(j) * scale(j);
+    }
+    Scalar *p = x.data();
+    const Scalar *sc = scale.data(), *sh = shift.data();
+    detail::forEachRow(rows, cols, policy, [&](std::size_t i) {
+      Scalar *r = p + i * cols;
+      for (std::size_t j = 0; j < cols; j++) {
+        r[j] = r[j] * sc[j] + sh[j];
+      }
+    });
+    return x;
+  }
+
+  // 学習時の順伝播．バッチ x の統計量を 1 回の走査で求め，もう 1 回の走査で y = x * scale + shift を書き込む
+  template<typename Scalar>
+  Matrix<Scalar> batchNormForward(const Matrix<Scalar> &x, const Vector<Scalar> &gamma, const Vector<Scalar> &beta,
+    BatchNormCache<Scalar> &cache, Scalar eps = Scalar(1e-5), Execution policy = Execution::Auto) {
+    std::size_t rows = x.dim().first, cols = x.dim().second;
+    assert(rows > 0 && gamma.dim() == cols && beta.dim() == cols);
+    cache.stats = ColumnStats<Scalar>(x, policy);
+    cache.invStd = cache.stats.variance();
+    for (std::size_t j = 0; j < cols; j++) {
+      cache.invStd(j) = Scalar(1) / std::sqrt(cache.invStd(j) + eps);
+    }
+    Vector<Scalar> scale(cols), shift(cols);
+    for (std::size_t j = 0; j < cols; j++) {
+      scale(j) = gamma(j) * cache.invStd(j);
+      shift(j) = beta(j) - cache.stats.mean()(j) * scale(j);
+    }
+    Matrix<Scalar> y(rows, cols);
+    const Scalar *in = x.data();
+    Scalar *out = y.data();
+    const Scalar *sc = scale.data(), *sh = shift.data();
+    detail::forEachRow(rows, cols, policy, [&](std::size_t i) {
+      for (std::size_t j = 0; j < cols; j++) {
+        out[i * cols + j] = in[i * cols + j] * sc[j] + sh[j];
+      }
+    });
+    return y;
+  }
+
+  // 逆伝播．dgamma = sum dy * xhat, dbeta = sum dy を 1 回の走査で求め，
+  // dx = gamma * invStd * (dy - mean(dy) - xhat * mean(dy * xhat)) を列ごとの係数で dx = a dy + b x + c とまとめて
+  // もう 1 回の走査で書き込む．xhat は x と cache から計算し直すので保存しない
+  template<typename Scalar>
+  Matrix<Scalar> batchNormBackward(const Matrix<Scalar> &dy, const Matrix<Scalar> &x, const Vector<Scalar> &gamma,
+    const BatchNormCache<Scalar> &cache, Vector<Scalar> &dgamma, Vector<Scalar> &dbeta,
+    Execution policy = Execution::Auto) {
+    std::size_t rows = x.dim().first, cols = x.dim().second;
+    assert(dy.dim() == x.dim() && gamma.dim() == cols && cache.stats.cols() == cols && rows > 0);
+    const Scalar *g = dy.data();
+    const Scalar *in = x.data();
+    const Scalar *mean = cache.stats.mean().data();
+    // 行の区間ごとに sum dy と sum dy * (x - mean) を求めて区間の順に足す
+    std::size_t count = detail::rowChunkCount(rows, cols, policy);
+    std::vector<Scalar> partial(2 * count * cols, Scalar(0));
+    reduction::detail::forEachChunk(rows, count, [&](std::size_t c, std::size_t first, std::size_t last) {
+      Scalar *sdy = partial.data() + 2 * c * cols;
+      Scalar *sdyx = sdy + cols;
+      for (std::size_t i = first; i < last; i++) {
+        for (std::size_t j = 0; j < cols; j++) {
+          sdy[j] += g[i * cols + j];
+          sdyx[j] += g[i * cols + j] * (in[i * cols + j] - mean[j]);
+        }
+      }
+    });
+    dgamma = Vector<Scalar>(cols);
+    dbeta = Vector<Scalar>(cols);
+    for (std::size_t c = 0; c < count; c++) {
+      for (std::size_t j = 0; j < cols; j++) {
+        dbeta(j) += partial[2 * c * cols + j];
+        dgamma(j) += partial[(2 * c + 1) * cols + j];
+      }
+    }
+    Vector<Scalar> a(cols), b(cols), k(cols);
+    Scalar inv = Scalar(1) / static_cast<Scalar>(rows);
+    for (std::size_t j = 0; j < cols; j++) {
+      Scalar s = cache.invStd(j);
+      dgamma(j) *= s;
+      a(j) = gamma(j) * s;
+      b(j) = -a(j) * s * dgamma(j) * inv;
+      k(j) = -a(j) * dbeta(j) * inv - b(j) * mean[j];
+    }
+    Matrix<Scalar> dx(rows, cols);
+    Scalar *out = dx.data();
+    const Scalar *ca = a.data(), *cb = b.data(), *ck = k.data();
+    detail::forEachRow(rows, cols, policy, [&](std::size_t i) {
+      for (std::size_t j = 0; j < cols; j++) {
+        out[i * cols + j] = ca[j] * g[i * cols + j] + cb[j] * in[i * cols + j] + ck[j];
+      }
+    });
+    return dx;
+  }
+
+  using ColStatsf = ColumnStats<float>;
+  using ColStatsd = ColumnStats<double>;
+  using CovStatsf = CovarianceStats<float>;
+  using CovStatsd = CovarianceStats<double>;
+} // namespace mywheels
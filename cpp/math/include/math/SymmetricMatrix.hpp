@@ -0,0 +1,205 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <cassert>
+#include "math/Allocator.hpp"
+#include "math/ThreadPool.hpp"
+#include "math/Kernels.hpp"
+#include "math/Vector.hpp"
+#include "math/Matrix.hpp"
+
+namespace mywheels {
+  // 対称行列．下三角 (対角を含む) だけを行ごとに詰めて持つ (n (n + 1) / 2 要素)
+  template<typename Scalar>
+  class SymmetricMatrix {
+  private:
+    std::vector<Scalar, DefaultInitAllocator<Scalar>> m_values;
+    std::size_t m_dim;
+
+    // SYRK で一度に計算する行の数
+    static constexpr std::size_t kSyrkBlock = 64;
+
+    static std::size_t offset(std::size_t i, std::size_t j) {
+      if (i < j) {
+        std::swap(i, j);
+      }
+      return i * (i + 1) / 2 + j;
+    }
+
+    // 行 i を out[0, n) に展開する
+    void unpackRow(std::size_t i, Scalar *out) const {
+      std::copy(m_values.data() + offset(i, 0), m_values.data() + offset(i, 0) + i + 1, out);
+      for (std::size_t j = i + 1; j < m_dim; j++) {
+        out[j] = m_values[offset(j, i)];
+      }
+    }
+
+    // tmp[bi x i1] の下三角部分を行 i0 から詰めて書き込む
+    void storeLowerBlock(std::size_t i0, std::size_t i1, const Scalar *tmp) {
+      for (std::size_t i = i0; i < i1; i++) {
+        std::copy(tmp + (i - i0) * i1, tmp + (i - i0) * i1 + i + 1, m_values.data() + offset(i, 0));
+      }
+    }
+
+    // 行ブロックごとに kernel(i0, i1, tmp) で tmp に [i0, i1) 行 x [0, i1) 列を計算させ，下三角部分を取り出す
+    template<typename F>
+    void fillLowerByBlocks(std::size_t work, const F &kernel) {
+      std::size_t blocks = (m_dim + kSyrkBlock - 1) / kSyrkBlock;
+      Execution policy = (work < kernels::kGemmParallelThreshold) ? Execution::Sequential : Execution::Parallel;
+      parallelFor(policy, 0, blocks, [&](std::size_t first, std::size_t last) {
+        std::vector<Scalar> tmp;
+        for (std::size_t block = first; block < last; block++) {
+          std::size_t i0 = block * kSyrkBlock, i1 = std::min(m_dim, i0 + kSyrkBlock);
+          tmp.assign((i1 - i0) * i1, Scalar(0));
+          kernel(i0, i1, tmp.data());
+          storeLowerBlock(i0, i1, tmp.data());
+        }
+      }, 1);
+    }
+
+  public:
+    // 初期化
+
+    explicit SymmetricMatrix(std::size_t dim, Scalar val = Scalar(0)) : m_values(dim * (dim + 1) / 2), m_dim(dim) {
+      kernels::fill(m_values.size(), val, m_values.data(), Execution::Auto);
+    };
+
+    // 密行列の下三角部分を取り出す
+    explicit SymmetricMatrix(const Matrix<Scalar> &dense) : SymmetricMatrix(dense.dim().first) {
+      assert(dense.dim().first == dense.dim().second);
+      for (std::size_t i = 0; i < m_dim; i++) {
+        std::copy(dense.data() + i * m_dim, dense.data() + i * m_dim + i + 1, m_values.data() + offset(i, 0));
+      }
+    }
+
+    // SYRK．a * t(a) (transpose なら t(a) * a) の下三角だけを計算する
+    static SymmetricMatrix syrk(const Matrix<Scalar> &a, bool transpose = false) {
+      std::size_t rows = a.dim().first, cols = a.dim().second;
+      std::size_t n = transpose ? cols : rows, k = transpose ? rows : cols;
+      SymmetricMatrix ret(n);
+      const Scalar *x = a.data();
+      ret.fillLowerByBlocks(n * n * k / 2, [&](std::size_t i0, std::size_t i1, Scalar *tmp) {
+        if (transpose) {
+          kernels::gemmTN(i1 - i0, i1, k, x + i0, cols, x, cols, tmp, i1);
+        } else {
+          kernels::gemmNT(i1 - i0, i1, k, x + i0 * cols, cols, x, cols, tmp, i1);
+        }
+      });
+      return ret;
+    }
+
+    // 要素の参照
+
+    std::size_t dim() const {
+      return m_dim;
+    }
+
+    // (i, j) と (j, i) は同じ要素を指す
+    Scalar &operator()(std::size_t i, std::size_t j) {
+      assert(i < m_dim && j < m_dim);
+      return m_values[offset(i, j)];
+    }
+
+    const Scalar &operator()(std::size_t i, std::size_t j) const {
+      assert(i < m_dim && j < m_dim);
+      return m_values[offset(i, j)];
+    }
+
+    Matrix<Scalar> toDense() const {
+      Matrix<Scalar> ret(m_dim, m_dim);
+      for (std::size_t i = 0; i < m_dim; i++) {
+        unpackRow(i, ret.data() + i * m_dim);
+      }
+      return ret;
+    }
+
+    // 演算子
+
+    SymmetricMatrix &operator+=(const SymmetricMatrix &r) {
+      assert(m_dim == r.m_dim);
+      kernels::add(m_values.size(), m_values.data(), r.m_values.data(), m_values.data(), Execution::Auto);
+      return *this;
+    }
+
+    SymmetricMatrix &operator-=(const SymmetricMatrix &r) {
+      assert(m_dim == r.m_dim);
+      kernels::sub(m_values.size(), m_values.data(), r.m_values.data(), m_values.data(), Execution::Auto);
+      return *this;
+    }
+
+    SymmetricMatrix &operator*=(const Scalar &r) {
+      kernels::scale(m_values.size(), m_values.data(), r, m_values.data(), Execution::Auto);
+      return *this;
+    }
+
+    friend SymmetricMatrix operator+(SymmetricMatrix l, const SymmetricMatrix &r) {
+      return std::move(l += r);
+    }
+
+    friend SymmetricMatrix operator-(SymmetricMatrix l, const SymmetricMatrix &r) {
+      return std::move(l -= r);
+    }
+
+    friend Vector<Scalar> operator*(const SymmetricMatrix &l, const Vector<Scalar> &r) {
+      assert(l.m_dim == r.dim());
+      Vector<Scalar> ret(l.m_dim);
+      std::vector<Scalar> s(l.m_dim);
+      for (std::size_t i = 0; i < l.m_dim; i++) {
+        l.unpackRow(i, s.data());
+        ret(i) = kernels::dot(s.data(), r.data(), l.m_dim);
+      }
+      return ret;
+    }
+
+    // SYMM．行ごとに展開して r と掛ける
+    friend Matrix<Scalar> operator*(const SymmetricMatrix &l, const Matrix<Scalar> &r) {
+      std::size_t n = r.dim().first, k = r.dim().second;
+      assert(l.m_dim == n);
+      Matrix<Scalar> ret = Matrix<Scalar>::zero(n, k);
+      Scalar *c = ret.data();
+      std::size_t grain = std::max<std::size_t>(1, kDefaultGrain / std::max<std::size_t>(1, n * k));
+      parallelFor(resolveExecution(Execution::Auto, n * n * k), 0, n, [&](std::size_t first, std::size_t last) {
+        std::vector<Scalar> s(n);
+        for (std::size_t i = first; i < last; i++) {
+          l.unpackRow(i, s.data());
+          kernels::gemm(1, k, n, s.data(), n, r.data(), k, c + i * k, k);
+        }
+      }, grain);
+      return ret;
+    }
+
+    // l * s = t(s * t(l))
+    friend Matrix<Scalar> operator*(const Matrix<Scalar> &l, const SymmetricMatrix &r) {
+      return t(r * t(l));
+    }
+
+    friend std::ostream &operator<<(std::ostream &os, const SymmetricMatrix &s) {
+      return os << s.toDense();
+    }
+
+    // 関数
+
+    friend Scalar tr(const SymmetricMatrix &mat) {
+      Scalar ret = Scalar(0);
+      for (std::size_t i = 0; i < mat.m_dim; i++) {
+        ret += mat(i, i);
+      }
+      return ret;
+    }
+
+    // 定数
+
+    static SymmetricMatrix identity(std::size_t dim) {
+      SymmetricMatrix ret(dim);
+      for (std::size_t i = 0; i < dim; i++) {
+        ret(i, i) = Scalar(1);
+      }
+      return ret;
+    }
+  };
+
+  using Symf = SymmetricMatrix<float>;
+  using Symd = SymmetricMatrix<double>;
+} // namespace mywheels
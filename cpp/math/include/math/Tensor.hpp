@@ -0,0 +1,765 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <array>
+#include <memory>
+#include <algorithm>
+#include <numeric>
+#include <cstddef>
+#include <cassert>
+#include "math/Allocator.hpp"
+#include "math/Buffer.hpp"
+#include "math/Layout.hpp"
+#include "math/ThreadPool.hpp"
+#include "math/Kernels.hpp"
+#include "math/Vector.hpp"
+#include "math/Matrix.hpp"
+
+namespace mywheels {
+  // N 次元のテンソル．共有する格納領域の上に形 (shape)，刻み幅 (strides) と先頭位置 (offset) を持つ．
+  // reshape, permute, slice などは格納領域を共有する新しいテンソルを O(1) で返し，
+  // コピーも格納領域を共有する．独立した複製が必要なら clone() を使う
+  template<typename Scalar>
+  class Tensor {
+  public:
+    using Shape = std::vector<std::size_t>;
+    using Strides = std::vector<std::ptrdiff_t>;
+
+  private:
+    using Storage = typename Buffer<Scalar>::Storage;
+
+    std::shared_ptr<Storage> m_storage;
+    Shape m_shape;
+    Strides m_strides;
+    std::ptrdiff_t m_offset = 0;
+
+    // 要素を初期化せずに確保する．直後にすべての要素へ書き込む場合に使う
+    struct NoInit {};
+
+    Tensor(Shape shape, NoInit) :
+      m_storage(std::make_shared<Storage>(count(shape))), m_shape(std::move(shape)),
+      m_strides(rowMajorStrides(m_shape)) {};
+
+    Tensor(std::shared_ptr<Storage> storage, Shape shape, Strides strides, std::ptrdiff_t offset) :
+      m_storage(std::move(storage)), m_shape(std::move(shape)), m_strides(std::move(strides)), m_offset(offset) {};
+
+    static std::size_t count(const Shape &shape) {
+      return std::accumulate(shape.begin(), shape.end(), std::size_t(1), std::multiplies<std::size_t>());
+    }
+
+    static Strides rowMajorStrides(const Shape &shape) {
+      Strides ret(shape.size());
+      std::ptrdiff_t s = 1;
+      for (std::size_t d = shape.size(); d-- > 0;) {
+        ret[d] = s;
+        s *= static_cast<std::ptrdiff_t>(shape[d]);
+      }
+      return ret;
+    }
+
+    // 要素が 1 つで刻み幅がすべて 0 のテンソル．スカラーとの演算で放送して使う
+    static Tensor scalar(const Scalar &val) {
+      Tensor ret(Shape{}, NoInit{});
+      (*ret.m_storage)[0] = val;
+      return ret;
+    }
+
+    // 2 つの形を後ろの次元から揃えて放送した形
+    static Shape broadcastShape(const Shape &l, const Shape &r) {
+      Shape ret(std::max(l.size(), r.size()));
+      for (std::size_t d = 0; d < ret.size(); d++) {
+        std::size_t a = (d < l.size()) ? l[l.size() - 1 - d] : 1;
+        std::size_t b = (d < r.size()) ? r[r.size() - 1 - d] : 1;
+        assert(a == b || a == 1 || b == 1);
+        ret[ret.size() - 1 - d] = (a == 1) ? b : a;
+      }
+      return ret;
+    }
+
+    // from の形と strides の刻み幅を to に放送した時の刻み幅．大きさ 1 の次元と足りない先頭の次元は 0 にする
+    static Strides broadcastStrides(const Shape &from, const Strides &strides, const Shape &to) {
+      assert(from.size() <= to.size());
+      Strides ret(to.size(), 0);
+      std::size_t lead = to.size() - from.size();
+      for (std::size_t d = 0; d < from.size(); d++) {
+        assert(from[d] == to[lead + d] || from[d] == 1);
+        ret[lead + d] = (from[d] == 1) ? 0 : strides[d];
+      }
+      return ret;
+    }
+
+    Strides broadcastStrides(const Shape &shape) const {
+      return broadcastStrides(m_shape, m_strides, shape);
+    }
+
+    // shape の上を N 個のオペランドの刻み幅で走査し，最内の次元を 1 行として
+    // fn(offsets, innerStrides, n) を呼ぶ．offsets は各オペランドの行の先頭の相対位置．
+    // 大きさ 1 の次元は除き，すべてのオペランドで続けて並ぶ隣の次元はまとめて行を長くする
+    template<std::size_t N, typename F>
+    static void forEachRow(const Shape &shape, const std::array<Strides, N> &strides, Execution policy,
+      const F &fn) {
+      Shape dims;
+      std::array<Strides, N> steps;
+      for (std::size_t d = 0; d < shape.size(); d++) {
+        if (shape[d] == 0) {
+          return;
+        }
+        if (shape[d] == 1) {
+          continue;
+        }
+        bool merge = !dims.empty();
+        for (std::size_t o = 0; o < N && merge; o++) {
+          merge = steps[o].back() == strides[o][d] * static_cast<std::ptrdiff_t>(shape[d]);
+        }
+        if (merge) {
+          dims.back() *= shape[d];
+          for (std::size_t o = 0; o < N; o++) {
+            steps[o].back() = strides[o][d];
+          }
+        } else {
+          dims.push_back(shape[d]);
+          for (std::size_t o = 0; o < N; o++) {
+            steps[o].push_back(strides[o][d]);
+          }
+        }
+      }
+      if (dims.empty()) {
+        dims.push_back(1);
+        for (std::size_t o = 0; o < N; o++) {
+          steps[o].push_back(0);
+        }
+      }
+
+      std::size_t outer = dims.size() - 1, n = dims.back();
+      std::array<std::ptrdiff_t, N> inner;
+      for (std::size_t o = 0; o < N; o++) {
+        inner[o] = steps[o].back();
+      }
+      std::size_t rows = count(dims) / n;
+      std::size_t grain = std::max<std::size_t>(1, kDefaultGrain / n);
+      parallelFor(resolveExecution(policy, rows * n), 0, rows, [&](std::size_t first, std::size_t last) {
+        // first 行目の添字と位置を求め，以降は桁上がりしながら進める
+        Shape index(outer);
+        std::array<std::ptrdiff_t, N> offsets{};
+        for (std::size_t d = outer, rest = first; d-- > 0;) {
+          index[d] = rest % dims[d];
+          rest /= dims[d];
+          for (std::size_t o = 0; o < N; o++) {
+            offsets[o] += static_cast<std::ptrdiff_t>(index[d]) * steps[o][d];
+          }
+        }
+        for (std::size_t row = first; row < last; row++) {
+          fn(offsets, inner, n);
+          for (std::size_t d = outer; d-- > 0;) {
+            for (std::size_t o = 0; o < N; o++) {
+              offsets[o] += steps[o][d];
+            }
+            if (++index[d] < dims[d]) {
+              break;
+            }
+            index[d] = 0;
+            for (std::size_t o = 0; o < N; o++) {
+              offsets[o] -= static_cast<std::ptrdiff_t>(dims[d]) * steps[o][d];
+            }
+          }
+        }
+      }, grain);
+    }
+
+    // 要素ごとの二項演算．行がすべて連続なら kernels を使い，片方が放送される行はその値を固定したループにする
+    struct AddOp {
+      static Scalar apply(const Scalar &x, const Scalar &y) {
+        return x + y;
+      }
+      static void row(std::size_t n, const Scalar *x, const Scalar *y, Scalar *out) {
+        kernels::add(n, x, y, out);
+      }
+    };
+
+    struct SubOp {
+      static Scalar apply(const Scalar &x, const Scalar &y) {
+        return x - y;
+      }
+      static void row(std::size_t n, const Scalar *x, const Scalar *y, Scalar *out) {
+        kernels::sub(n, x, y, out);
+      }
+    };
+
+    struct MulOp {
+      static Scalar apply(const Scalar &x, const Scalar &y) {
+        return x * y;
+      }
+      static void row(std::size_t n, const Scalar *x, const Scalar *y, Scalar *out) {
+        kernels::mul(n, x, y, out);
+      }
+    };
+
+    struct DivOp {
+      static Scalar apply(const Scalar &x, const Scalar &y) {
+        return x / y;
+      }
+      static void row(std::size_t n, const Scalar *x, const Scalar *y, Scalar *out) {
+        kernels::quot(n, x, y, out);
+      }
+    };
+
+    template<typename Op>
+    static void applyRow(std::size_t n, const Scalar *x, std::ptrdiff_t sx, const Scalar *y, std::ptrdiff_t sy,
+      Scalar *out, std::ptrdiff_t so) {
+      if (so == 1 && sx == 1 && sy == 1) {
+        Op::row(n, x, y, out);
+      } else if (so == 1 && sx == 1 && sy == 0) {
+        Scalar b = *y;
+        for (std::size_t i = 0; i < n; i++) {
+          out[i] = Op::apply(x[i], b);
+        }
+      } else if (so == 1 && sx == 0 && sy == 1) {
+        Scalar a = *x;
+        for (std::size_t i = 0; i < n; i++) {
+          out[i] = Op::apply(a, y[i]);
+        }
+      } else {
+        for (std::size_t i = 0; i < n; i++) {
+          std::ptrdiff_t k = static_cast<std::ptrdiff_t>(i);
+          out[k * so] = Op::apply(x[k * sx], y[k * sy]);
+        }
+      }
+    }
+
+    // out の形の上で out = Op(l, r) を計算する．l と r は out の形に放送する
+    template<typename Op>
+    static void binary(const Tensor &l, const Tensor &r, Tensor &out, Execution policy) {
+      const Scalar *x = l.data();
+      const Scalar *y = r.data();
+      Scalar *z = out.data();
+      std::array<Strides, 3> strides = {
+        l.broadcastStrides(out.m_shape), r.broadcastStrides(out.m_shape), out.m_strides};
+      forEachRow<3>(out.m_shape, strides, policy, [=](const std::array<std::ptrdiff_t, 3> &offsets,
+        const std::array<std::ptrdiff_t, 3> &inner, std::size_t n) {
+        applyRow<Op>(n, x + offsets[0], inner[0], y + offsets[1], inner[1], z + offsets[2], inner[2]);
+      });
+    }
+
+    template<typename Op>
+    static Tensor binary(const Tensor &l, const Tensor &r, Execution policy) {
+      Tensor ret(broadcastShape(l.m_shape, r.m_shape), NoInit{});
+      binary<Op>(l, r, ret, policy);
+      return ret;
+    }
+
+    // 刻み幅 0 で大きさ 2 以上の次元 (expand した次元) がある．複数の要素が同じ位置を指すので書き込み先にできない
+    bool hasAliasedElements() const {
+      for (std::size_t d = 0; d < rank(); d++) {
+        if (m_shape[d] > 1 && m_strides[d] == 0) {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    // このテンソルへ書き込みながら読む右辺．同じ格納領域を別の並びで参照していると，
+    // 並列に書き込んだ要素を後から読んでしまうので複製する．同じ並びなら各要素は自分の位置だけを読むのでそのまま使う
+    Tensor source(const Tensor &r) const {
+      if (!sharesStorage(r)) {
+        return r;
+      }
+      bool same = r.m_offset == m_offset;
+      Strides strides = r.broadcastStrides(m_shape);
+      for (std::size_t d = 0; d < rank() && same; d++) {
+        same = m_shape[d] == 1 || strides[d] == m_strides[d];
+      }
+      return same ? r : r.clone();
+    }
+
+    // 右辺をこのテンソルの形に放送して *this = Op(*this, r) を計算する
+    template<typename Op>
+    Tensor &update(const Tensor &r, Execution policy) {
+      assert(!hasAliasedElements());
+      binary<Op>(*this, source(r), *this, policy);
+      return *this;
+    }
+
+    // 最後の 2 次元を行列として gemm に渡せる形．列の刻み幅が 1 ならそのまま，
+    // 行の刻み幅が 1 なら転置として読み，どちらでもなければ (放送した行列など) false
+    static bool gemmOperand(const Tensor &t, bool &transposed, std::size_t &ld) {
+      std::size_t r = t.rank(), rows = t.m_shape[r - 2], cols = t.m_shape[r - 1];
+      std::ptrdiff_t rs = (rows == 1) ? static_cast<std::ptrdiff_t>(cols) : t.m_strides[r - 2];
+      std::ptrdiff_t cs = (cols == 1) ? 1 : t.m_strides[r - 1];
+      if (cs == 1 && rs >= static_cast<std::ptrdiff_t>(cols)) {
+        transposed = false;
+        ld = static_cast<std::size_t>(rs);
+        return true;
+      }
+      rs = (rows == 1) ? 1 : t.m_strides[r - 2];
+      cs = (cols == 1) ? static_cast<std::ptrdiff_t>(rows) : t.m_strides[r - 1];
+      if (rs == 1 && cs >= static_cast<std::ptrdiff_t>(rows)) {
+        transposed = true;
+        ld = static_cast<std::size_t>(cs);
+        return true;
+      }
+      return false;
+    }
+
+  public:
+    // 初期化
+
+    explicit Tensor(Shape shape, Scalar val = Scalar(0), Execution policy = Execution::Auto) :
+      Tensor(std::move(shape), NoInit{}) {
+      kernels::fill(size(), val, data(), policy);
+    };
+
+    // list は行優先に並べて与える
+    Tensor(Shape shape, std::initializer_list<Scalar> list) : Tensor(std::move(shape), NoInit{}) {
+      assert(list.size() == size());
+      std::copy(list.begin(), list.end(), data());
+    };
+
+    // 行列やベクトルの格納領域をコピーせずに引き継ぐ．他と共有している領域は複製してから引き継ぐ
+    template<typename Layout, typename = std::enable_if_t<!isTiled<Layout>>>
+    explicit Tensor(Matrix<Scalar, Layout> &&mat) :
+      Tensor(mat.m_values.release(), Shape{mat.m_rows, mat.m_cols}, Strides(2), 0) {
+      bool rowMajor = std::is_same_v<Layout, RowMajor>;
+      m_strides[0] = rowMajor ? static_cast<std::ptrdiff_t>(mat.m_cols) : 1;
+      m_strides[1] = rowMajor ? 1 : static_cast<std::ptrdiff_t>(mat.m_rows);
+      mat.m_rows = mat.m_cols = 0;
+    }
+
+    template<typename Layout>
+    explicit Tensor(const Matrix<Scalar, Layout> &mat) : Tensor(Matrix<Scalar>(mat.template toLayout<RowMajor>())) {};
+
+    // 右辺値のベクトルなら格納領域を引き継ぎ，左辺値ならコピーする．
+    // 波括弧の形が Vector の初期化子リストと曖昧にならないようにテンプレートにする
+    template<typename V, typename = std::enable_if_t<std::is_same_v<std::decay_t<V>, Vector<Scalar>>>>
+    explicit Tensor(V &&vec) :
+      Tensor(Vector<Scalar>(std::forward<V>(vec)).m_values.release(), Shape{0}, Strides{1}, 0) {
+      m_shape[0] = m_storage->size();
+    }
+
+    static Tensor zero(Shape shape) {
+      return Tensor(std::move(shape), Scalar(0));
+    }
+
+    // 格納領域を共有しない複製．要素は行優先に詰める
+    Tensor clone(Execution policy = Execution::Auto) const {
+      Tensor ret(m_shape, NoInit{});
+      ret.assign(*this, policy);
+      return ret;
+    }
+
+    // 行優先に詰まっていればそのまま，そうでなければ詰めた複製を返す
+    Tensor contiguous(Execution policy = Execution::Auto) const {
+      return isContiguous() ? *this : clone(policy);
+    }
+
+    // 型変換．行優先に詰まっていて格納領域を他と共有していなければ，コピーせずに引き渡す
+
+    Matrix<Scalar> toMatrix() && {
+      assert(rank() == 2);
+      if (!ownsStorage()) {
+        return static_cast<const Tensor &>(*this).toMatrix();
+      }
+      Matrix<Scalar> ret(std::size_t(0), std::size_t(0));
+      ret.m_values = Buffer<Scalar>(std::move(m_storage));
+      ret.m_rows = m_shape[0];
+      ret.m_cols = m_shape[1];
+      *this = Tensor(Shape{0});
+      return ret;
+    }
+
+    Matrix<Scalar> toMatrix() const & {
+      assert(rank() == 2);
+      return clone().toMatrix();
+    }
+
+    Vector<Scalar> toVector() && {
+      assert(rank() == 1);
+      if (!ownsStorage()) {
+        return static_cast<const Tensor &>(*this).toVector();
+      }
+      Vector<Scalar> ret(std::size_t(0));
+      ret.m_values = Buffer<Scalar>(std::move(m_storage));
+      *this = Tensor(Shape{0});
+      return ret;
+    }
+
+    Vector<Scalar> toVector() const & {
+      assert(rank() == 1);
+      return clone().toVector();
+    }
+
+    // 形と格納
+
+    std::size_t rank() const {
+      return m_shape.size();
+    }
+
+    const Shape &shape() const {
+      return m_shape;
+    }
+
+    std::size_t shape(std::size_t axis) const {
+      return m_shape[axis];
+    }
+
+    const Strides &strides() const {
+      return m_strides;
+    }
+
+    std::size_t size() const {
+      return count(m_shape);
+    }
+
+    // 先頭の要素．刻み幅は strides() に従う
+    Scalar *data() {
+      return m_storage->data() + m_offset;
+    }
+
+    const Scalar *data() const {
+      return m_storage->data() + m_offset;
+    }
+
+    // 行優先に隙間なく並んでいる
+    bool isContiguous() const {
+      std::ptrdiff_t s = 1;
+      for (std::size_t d = m_shape.size(); d-- > 0;) {
+        if (m_shape[d] != 1 && m_strides[d] != s) {
+          return false;
+        }
+        s *= static_cast<std::ptrdiff_t>(m_shape[d]);
+      }
+      return true;
+    }
+
+    // 格納領域全体をこのテンソルだけが隙間なく使っている
+    bool ownsStorage() const {
+      return m_storage.use_count() == 1 && m_offset == 0 && m_storage->size() == size() && isContiguous();
+    }
+
+    bool sharesStorage(const Tensor &r) const {
+      return m_storage == r.m_storage;
+    }
+
+    // 要素の参照
+
+    template<typename... Index>
+    Scalar &operator()(Index... index) {
+      return data()[position({static_cast<std::size_t>(index)...})];
+    }
+
+    template<typename... Index>
+    const Scalar &operator()(Index... index) const {
+      return data()[position({static_cast<std::size_t>(index)...})];
+    }
+
+    std::ptrdiff_t position(std::initializer_list<std::size_t> index) const {
+      assert(index.size() == rank());
+      std::ptrdiff_t ret = 0;
+      std::size_t d = 0;
+      for (std::size_t i : index) {
+        assert(i < m_shape[d]);
+        ret += static_cast<std::ptrdiff_t>(i) * m_strides[d++];
+      }
+      return ret;
+    }
+
+    // 形の変更．いずれも格納領域を共有する
+
+    // 要素数を変えずに形を変える．行優先に詰まっていなければ詰めた複製から作る
+    Tensor reshape(Shape shape) const {
+      assert(count(shape) == size());
+      if (!isContiguous()) {
+        return clone().reshape(std::move(shape));
+      }
+      Strides strides = rowMajorStrides(shape);
+      return Tensor(m_storage, std::move(shape), std::move(strides), m_offset);
+    }
+
+    // d 次元目を axes[d] 次元目から取る
+    Tensor permute(const std::vector<std::size_t> &axes) const {
+      assert(axes.size() == rank());
+      Shape shape(rank());
+      Strides strides(rank());
+      std::vector<bool> used(rank(), false);
+      for (std::size_t d = 0; d < rank(); d++) {
+        assert(axes[d] < rank() && !used[axes[d]]);
+        used[axes[d]] = true;
+        shape[d] = m_shape[axes[d]];
+        strides[d] = m_strides[axes[d]];
+      }
+      return Tensor(m_storage, std::move(shape), std::move(strides), m_offset);
+    }
+
+    Tensor transpose(std::size_t a, std::size_t b) const {
+      std::vector<std::size_t> axes(rank());
+      std::iota(axes.begin(), axes.end(), std::size_t(0));
+      std::swap(axes[a], axes[b]);
+      return permute(axes);
+    }
+
+    // axis 次元目の [first, last) を step おきに取り出す
+    Tensor slice(std::size_t axis, std::size_t first, std::size_t last, std::size_t step = 1) const {
+      assert(axis < rank() && first <= last && last <= m_shape[axis] && step > 0);
+      Tensor ret = *this;
+      ret.m_offset += static_cast<std::ptrdiff_t>(first) * m_strides[axis];
+      ret.m_shape[axis] = (last - first + step - 1) / step;
+      ret.m_strides[axis] *= static_cast<std::ptrdiff_t>(step);
+      return ret;
+    }
+
+    // axis 次元目を index に固定し，その次元を除く
+    Tensor select(std::size_t axis, std::size_t index) const {
+      assert(axis < rank() && index < m_shape[axis]);
+      Tensor ret = *this;
+      ret.m_offset += static_cast<std::ptrdiff_t>(index) * m_strides[axis];
+      ret.m_shape.erase(ret.m_shape.begin() + axis);
+      ret.m_strides.erase(ret.m_strides.begin() + axis);
+      return ret;
+    }
+
+    // axis 次元目に大きさ 1 の次元を挿む
+    Tensor unsqueeze(std::size_t axis) const {
+      assert(axis <= rank());
+      Tensor ret = *this;
+      ret.m_shape.insert(ret.m_shape.begin() + axis, 1);
+      ret.m_strides.insert(ret.m_strides.begin() + axis, 0);
+      return ret;
+    }
+
+    // 大きさ 1 の axis 次元目を除く
+    Tensor squeeze(std::size_t axis) const {
+      assert(axis < rank() && m_shape[axis] == 1);
+      return select(axis, 0);
+    }
+
+    // shape に放送したテンソル．放送する次元の刻み幅を 0 にするので要素は複製しない
+    Tensor expand(Shape shape) const {
+      Strides strides = broadcastStrides(shape);
+      return Tensor(m_storage, std::move(shape), std::move(strides), m_offset);
+    }
+
+    // 書き込み
+
+    Tensor &fill(const Scalar &val, Execution policy = Execution::Auto) {
+      return assign(scalar(val), policy);
+    }
+
+    // r をこのテンソルの形に放送して書き込む．expand したテンソルには書き込めない
+    Tensor &assign(const Tensor &r, Execution policy = Execution::Auto) {
+      assert(!hasAliasedElements());
+      Tensor src = source(r);
+      const Scalar *x = src.data();
+      Scalar *z = data();
+      std::array<Strides, 2> strides = {src.broadcastStrides(m_shape), m_strides};
+      forEachRow<2>(m_shape, strides, policy, [=](const std::array<std::ptrdiff_t, 2> &offsets,
+        const std::array<std::ptrdiff_t, 2> &inner, std::size_t n) {
+        const Scalar *src = x + offsets[0];
+        Scalar *dst = z + offsets[1];
+        if (inner[0] == 1 && inner[1] == 1) {
+          std::copy(src, src + n, dst);
+        } else {
+          for (std::size_t i = 0; i < n; i++) {
+            std::ptrdiff_t k = static_cast<std::ptrdiff_t>(i);
+            dst[k * inner[1]] = src[k * inner[0]];
+          }
+        }
+      });
+      return *this;
+    }
+
+    // 演算子．右辺はこのテンソルの形に放送する．格納領域を共有する他のテンソルからも変更が見える．
+    // 右辺が同じ格納領域を別の並びで参照していれば (s += s.transpose(0, 1) など) 変更前の値を読む
+
+    Tensor &add(const Tensor &r, Execution policy = Execution::Auto) {
+      return update<AddOp>(r, policy);
+    }
+
+    Tensor &sub(const Tensor &r, Execution policy = Execution::Auto) {
+      return update<SubOp>(r, policy);
+    }
+
+    Tensor &mul(const Tensor &r, Execution policy = Execution::Auto) {
+      return update<MulOp>(r, policy);
+    }
+
+    Tensor &divide(const Tensor &r, Execution policy = Execution::Auto) {
+      return update<DivOp>(r, policy);
+    }
+
+    Tensor &operator+=(const Tensor &r) {
+      return add(r);
+    }
+
+    Tensor &operator-=(const Tensor &r) {
+      return sub(r);
+    }
+
+    Tensor &operator*=(const Tensor &r) {
+      return mul(r);
+    }
+
+    Tensor &operator/=(const Tensor &r) {
+      return divide(r);
+    }
+
+    Tensor &operator+=(const Scalar &r) {
+      return add(scalar(r));
+    }
+
+    Tensor &operator-=(const Scalar &r) {
+      return sub(scalar(r));
+    }
+
+    Tensor &operator*=(const Scalar &r) {
+      return mul(scalar(r));
+    }
+
+    Tensor &operator/=(const Scalar &r) {
+      return divide(scalar(r));
+    }
+
+    // 二項演算は両辺を放送した形の新しいテンソルを返す
+
+    friend Tensor operator+(const Tensor &l, const Tensor &r) {
+      return binary<AddOp>(l, r, Execution::Auto);
+    }
+
+    friend Tensor operator-(const Tensor &l, const Tensor &r) {
+      return binary<SubOp>(l, r, Execution::Auto);
+    }
+
+    friend Tensor operator*(const Tensor &l, const Tensor &r) {
+      return binary<MulOp>(l, r, Execution::Auto);
+    }
+
+    friend Tensor operator/(const Tensor &l, const Tensor &r) {
+      return binary<DivOp>(l, r, Execution::Auto);
+    }
+
+    friend Tensor operator+(const Tensor &l, const Scalar &r) {
+      return l + scalar(r);
+    }
+
+    friend Tensor operator+(const Scalar &l, const Tensor &r) {
+      return scalar(l) + r;
+    }
+
+    friend Tensor operator-(const Tensor &l, const Scalar &r) {
+      return l - scalar(r);
+    }
+
+    friend Tensor operator-(const Scalar &l, const Tensor &r) {
+      return scalar(l) - r;
+    }
+
+    friend Tensor operator*(const Tensor &l, const Scalar &r) {
+      return l * scalar(r);
+    }
+
+    friend Tensor operator*(const Scalar &l, const Tensor &r) {
+      return scalar(l) * r;
+    }
+
+    friend Tensor operator/(const Tensor &l, const Scalar &r) {
+      return l / scalar(r);
+    }
+
+    friend Tensor operator-(const Tensor &t) {
+      return scalar(Scalar(0)) - t;
+    }
+
+    // 最後の 2 次元を行列とみなした積．先頭の次元は放送し，バッチごとに Matrix の積と同じ gemm を呼ぶ．
+    // 転置したビューは gemmTN, gemmNT でそのまま読む
+    friend Tensor matmul(const Tensor &l, const Tensor &r) {
+      assert(l.rank() >= 2 && r.rank() >= 2);
+      bool lt, rt;
+      std::size_t lda, ldb;
+      // 両方とも転置なら左辺を詰め直して a * t(b) にする
+      if (!gemmOperand(l, lt, lda) || (lt && gemmOperand(r, rt, ldb) && rt)) {
+        return matmul(l.clone(), r);
+      }
+      if (!gemmOperand(r, rt, ldb)) {
+        return matmul(l, r.clone());
+      }
+
+      std::size_t m = l.m_shape[l.rank() - 2], k = l.m_shape[l.rank() - 1], n = r.m_shape[r.rank() - 1];
+      assert(r.m_shape[r.rank() - 2] == k);
+      Shape lb(l.m_shape.begin(), l.m_shape.end() - 2), rb(r.m_shape.begin(), r.m_shape.end() - 2);
+      Shape batch = broadcastShape(lb, rb);
+      Strides ls = broadcastStrides(lb, Strides(l.m_strides.begin(), l.m_strides.end() - 2), batch);
+      Strides rs = broadcastStrides(rb, Strides(r.m_strides.begin(), r.m_strides.end() - 2), batch);
+
+      Shape shape = batch;
+      shape.push_back(m);
+      shape.push_back(n);
+      Tensor ret(shape, Scalar(0));
+      std::size_t batches = count(batch);
+      const Scalar *a = l.data();
+      const Scalar *b = r.data();
+      Scalar *c = ret.data();
+
+      // バッチが複数あればバッチごとに並列化し，1 つなら gemm の中で並列化する
+      std::size_t work = batches * m * n * k;
+      Execution inner = (batches == 1) ? Execution::Auto : Execution::Sequential;
+      Execution outer = (batches > 1 && work >= kernels::kGemmParallelThreshold) ? Execution::Parallel
+                                                                                  : Execution::Sequential;
+      parallelFor(outer, 0, batches, [&](std::size_t first, std::size_t last) {
+        for (std::size_t i = first; i < last; i++) {
+          std::ptrdiff_t lo = 0, ro = 0;
+          for (std::size_t d = batch.size(), rest = i; d-- > 0;) {
+            std::ptrdiff_t idx = static_cast<std::ptrdiff_t>(rest % batch[d]);
+            rest /= batch[d];
+            lo += idx * ls[d];
+            ro += idx * rs[d];
+          }
+          Scalar *ci = c + i * m * n;
+          if (lt) {
+            kernels::gemmTN(m, n, k, a + lo, lda, b + ro, ldb, ci, n, inner);
+          } else if (rt) {
+            kernels::gemmNT(m, n, k, a + lo, lda, b + ro, ldb, ci, n, inner);
+          } else {
+            kernels::gemm(m, n, k, a + lo, lda, b + ro, ldb, ci, n, inner);
+          }
+        }
+      }, 1);
+      return ret;
+    }
+
+    // 集約
+
+    Scalar sum(Summation method = Summation::Pairwise) const {
+      Tensor t = contiguous();
+      return kernels::sum(t.data(), t.size(), method);
+    }
+
+    // 最後の次元を 1 行とし，それより上の次元の区切りには空行を入れる
+    friend std::ostream &operator<<(std::ostream &os, const Tensor &t) {
+      Tensor c = t.contiguous();
+      std::size_t n = t.m_shape.empty() ? 1 : t.m_shape.back();
+      const Scalar *x = c.data();
+      for (std::size_t i = 0; i < c.size(); i++) {
+        os << x[i];
+        if (i + 1 == c.size()) {
+          break;
+        }
+        if ((i + 1) % n != 0) {
+          os << ' ';
+          continue;
+        }
+        os << '\n';
+        std::size_t block = n;
+        for (std::size_t d = t.rank() - 1; d-- > 0;) {
+          block *= t.m_shape[d];
+          if ((i + 1) % block == 0) {
+            os << '\n';
+            break;
+          }
+        }
+      }
+      return os;
+    }
+  };
+
+  using Tensorf = Tensor<float>;
+  using Tensord = Tensor<double>;
+} // namespace mywheels
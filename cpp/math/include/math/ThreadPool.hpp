@@ -0,0 +1,152 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "math/Numa.hpp"
+
+namespace mywheels {
+  // 実行方針
+  enum class Execution {
+    Sequential, // 呼び出したスレッドだけで実行する
+    Parallel,   // スレッドプールで並列に実行する
+    Auto        // 要素数が kAutoParallelThreshold 以上の時だけ並列に実行する
+  };
+
+  // Execution::Auto で並列化する最小の要素数
+  constexpr std::size_t kAutoParallelThreshold = std::size_t(1) << 16;
+  // 1 タスクが受け持つ既定の要素数
+  constexpr std::size_t kDefaultGrain = std::size_t(1) << 14;
+
+  // ワークスティーリング方式のスレッドプール．
+  // 各ワーカーは自分の両端キューの先頭からタスクを取り，空になると他のワーカーの末尾から盗む
+  class ThreadPool {
+  private:
+    struct Job {
+      const void *context;
+      void (*invoke)(const void *context, std::size_t first, std::size_t last);
+      std::atomic<std::size_t> pending;
+      std::exception_ptr error;
+      std::mutex errorMutex;
+    };
+
+    struct Task {
+      Job *job;
+      std::size_t first;
+      std::size_t last;
+    };
+
+    struct Queue {
+      std::mutex mutex;
+      std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> m_queues;
+    std::vector<std::thread> m_workers;
+    std::atomic<std::size_t> m_queued{0};
+    numa::Affinity m_affinity;
+    std::mutex m_sleepMutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+    bool m_stop = false;
+
+    void workerLoop(std::size_t index);
+    bool tryPop(std::size_t index, Task &task);
+    bool trySteal(std::size_t thief, Task &task);
+    void run(const Task &task);
+    void submit(Job &job, std::size_t first, std::size_t last, std::size_t grain);
+
+  public:
+    // 呼び出し元のスレッドも計算に加わるので，threads - 1 個のワーカースレッドを作る．
+    // affinity が None でなければワーカー i を numa::affinityCpu(affinity, i) に固定する．
+    // 呼び出し元のスレッドは固定しない (必要なら numa::pinCurrentThread(numa::affinityCpu(affinity, 0)) で固定する)
+    explicit ThreadPool(std::size_t threads, numa::Affinity affinity = numa::Affinity::None);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    // 計算に加わるスレッドの数 (呼び出し元を含む)
+    std::size_t size() const {
+      return m_queues.size();
+    }
+
+    numa::Affinity affinity() const {
+      return m_affinity;
+    }
+
+    // 現在のスレッドがいずれかのプールのワーカーなら true
+    static bool inWorker();
+
+    // プロセス全体で共有するプール．スレッド数は環境変数 MYWHEELS_NUM_THREADS，
+    // 未設定なら std::thread::hardware_concurrency() で決める．固定の方法は numa::defaultAffinity() に従う
+    static ThreadPool &global();
+
+    // [first, last) を grain 要素ずつのタスクに分けて fn(begin, end) を並列に実行し，完了を待つ．
+    // ワーカーの中から呼ばれた場合は入れ子の並列化をせずにその場で実行する
+    template<typename F>
+    void parallelFor(std::size_t first, std::size_t last, std::size_t grain, const F &fn) {
+      if (first >= last) {
+        return;
+      }
+      if (grain == 0) {
+        grain = 1;
+      }
+      if (size() <= 1 || last - first <= grain || inWorker()) {
+        fn(first, last);
+        return;
+      }
+      Job job;
+      job.context = &fn;
+      job.invoke = [](const void *context, std::size_t b, std::size_t e) {
+        (*static_cast<const F *>(context))(b, e);
+      };
+      submit(job, first, last, grain);
+    }
+  };
+
+  // Execution::Auto を作業量 work (要素数) に応じて Sequential か Parallel に決める
+  inline Execution resolveExecution(Execution policy, std::size_t work) {
+    if (policy == Execution::Auto) {
+      return (work >= kAutoParallelThreshold) ? Execution::Parallel : Execution::Sequential;
+    }
+    return policy;
+  }
+
+  template<typename F>
+  void parallelFor(std::size_t first, std::size_t last, const F &fn, std::size_t grain = kDefaultGrain) {
+    ThreadPool::global().parallelFor(first, last, grain, fn);
+  }
+
+  template<typename F>
+  void parallelFor(Execution policy, std::size_t first, std::size_t last, const F &fn,
+    std::size_t grain = kDefaultGrain) {
+    if (resolveExecution(policy, last - first) == Execution::Sequential) {
+      if (first < last) {
+        fn(first, last);
+      }
+      return;
+    }
+    parallelFor(first, last, fn, grain);
+  }
+
+  namespace detail {
+    // 行優先 rows x cols 行列の各行 i について fn(i) を呼ぶ．行ごとに並列化する
+    template<typename F>
+    void forEachRow(std::size_t rows, std::size_t cols, Execution policy, const F &fn) {
+      std::size_t grain = std::max<std::size_t>(1, kDefaultGrain / std::max<std::size_t>(1, cols));
+      parallelFor(resolveExecution(policy, rows * cols), 0, rows, [&](std::size_t first, std::size_t last) {
+        for (std::size_t i = first; i < last; i++) {
+          fn(i);
+        }
+      }, grain);
+    }
+  } // namespace detail
+} // namespace mywheels
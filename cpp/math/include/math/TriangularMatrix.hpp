@@ -0,0 +1,245 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <cassert>
+#include "math/Allocator.hpp"
+#include "math/ThreadPool.hpp"
+#include "math/Kernels.hpp"
+#include "math/Vector.hpp"
+#include "math/Matrix.hpp"
+
+namespace mywheels {
+  enum class Triangle {
+    Lower, // 対角より上が 0
+    Upper  // 対角より下が 0
+  };
+
+  // 三角行列．0 でない側だけを行ごとに詰めて持つ (n (n + 1) / 2 要素)．
+  // 行 i は [rowBegin(i), rowEnd(i)) 列を連続に持つので，積や前進・後退代入は行単位で kernels に渡せる
+  template<typename Scalar, Triangle Uplo>
+  class TriangularMatrix {
+  private:
+    static constexpr bool kLower = (Uplo == Triangle::Lower);
+
+    std::vector<Scalar, DefaultInitAllocator<Scalar>> m_values;
+    std::size_t m_dim;
+
+    // 行ごとの並列化に使う 1 タスクの行数
+    static std::size_t rowGrain(std::size_t cols) {
+      return std::max<std::size_t>(1, kDefaultGrain / std::max<std::size_t>(1, cols));
+    }
+
+  public:
+    using Transposed = TriangularMatrix<Scalar, kLower ? Triangle::Upper : Triangle::Lower>;
+
+    // 初期化
+
+    explicit TriangularMatrix(std::size_t dim, Scalar val = Scalar(0)) :
+      m_values(dim * (dim + 1) / 2), m_dim(dim) {
+      kernels::fill(m_values.size(), val, m_values.data(), Execution::Auto);
+    };
+
+    // 密行列の三角部分を取り出す
+    explicit TriangularMatrix(const Matrix<Scalar> &dense) : TriangularMatrix(dense.dim().first) {
+      assert(dense.dim().first == dense.dim().second);
+      for (std::size_t i = 0; i < m_dim; i++) {
+        std::copy(dense.data() + i * m_dim + rowBegin(i), dense.data() + i * m_dim + rowEnd(i), row(i));
+      }
+    }
+
+    // 要素の参照
+
+    std::size_t dim() const {
+      return m_dim;
+    }
+
+    std::size_t rowBegin(std::size_t i) const {
+      return kLower ? 0 : i;
+    }
+
+    std::size_t rowEnd(std::size_t i) const {
+      return kLower ? i + 1 : m_dim;
+    }
+
+    // 行 i の rowBegin(i) 列目の要素
+    Scalar *row(std::size_t i) {
+      return m_values.data() + rowOffset(i);
+    }
+
+    const Scalar *row(std::size_t i) const {
+      return m_values.data() + rowOffset(i);
+    }
+
+    std::size_t rowOffset(std::size_t i) const {
+      return kLower ? i * (i + 1) / 2 : i * m_dim - i * (i - 1) / 2;
+    }
+
+    static bool inTriangle(std::size_t i, std::size_t j) {
+      return kLower ? (j <= i) : (i <= j);
+    }
+
+    // 三角部分の要素だけ書き換えられる
+    Scalar &operator()(std::size_t i, std::size_t j) {
+      assert(i < m_dim && j < m_dim && inTriangle(i, j));
+      return row(i)[j - rowBegin(i)];
+    }
+
+    Scalar operator()(std::size_t i, std::size_t j) const {
+      assert(i < m_dim && j < m_dim);
+      return inTriangle(i, j) ? row(i)[j - rowBegin(i)] : Scalar(0);
+    }
+
+    Matrix<Scalar> toDense() const {
+      Matrix<Scalar> ret = Matrix<Scalar>::zero(m_dim, m_dim);
+      for (std::size_t i = 0; i < m_dim; i++) {
+        std::copy(row(i), row(i) + (rowEnd(i) - rowBegin(i)), ret.data() + i * m_dim + rowBegin(i));
+      }
+      return ret;
+    }
+
+    // 演算子
+
+    TriangularMatrix &operator*=(const Scalar &r) {
+      kernels::scale(m_values.size(), m_values.data(), r, m_values.data(), Execution::Auto);
+      return *this;
+    }
+
+    friend Vector<Scalar> operator*(const TriangularMatrix &l, const Vector<Scalar> &r) {
+      assert(l.m_dim == r.dim());
+      Vector<Scalar> ret(l.m_dim);
+      for (std::size_t i = 0; i < l.m_dim; i++) {
+        std::size_t b = l.rowBegin(i);
+        ret(i) = kernels::dot(l.row(i), r.data() + b, l.rowEnd(i) - b);
+      }
+      return ret;
+    }
+
+    // TRMM．l の行 i と r の [rowBegin(i), rowEnd(i)) 行の積で，密行列の半分の演算量
+    friend Matrix<Scalar> operator*(const TriangularMatrix &l, const Matrix<Scalar> &r) {
+      std::size_t n = r.dim().first, k = r.dim().second;
+      assert(l.m_dim == n);
+      Matrix<Scalar> ret = Matrix<Scalar>::zero(n, k);
+      const Scalar *b = r.data();
+      Scalar *c = ret.data();
+      parallelFor(resolveExecution(Execution::Auto, n * n * k / 2), 0, n, [&](std::size_t first, std::size_t last) {
+        for (std::size_t i = first; i < last; i++) {
+          std::size_t p0 = l.rowBegin(i), len = l.rowEnd(i) - p0;
+          kernels::gemm(1, k, len, l.row(i), len, b + p0 * k, k, c + i * k, k);
+        }
+      }, rowGrain(n * k / 2));
+      return ret;
+    }
+
+    // l の行 i は r の各行 p を l(i, p) 倍して [rowBegin(p), rowEnd(p)) 列に足したもの
+    friend Matrix<Scalar> operator*(const Matrix<Scalar> &l, const TriangularMatrix &r) {
+      std::size_t m = l.dim().first, n = l.dim().second;
+      assert(r.m_dim == n);
+      Matrix<Scalar> ret = Matrix<Scalar>::zero(m, n);
+      const Scalar *a = l.data();
+      Scalar *c = ret.data();
+      parallelFor(resolveExecution(Execution::Auto, m * n * n / 2), 0, m, [&](std::size_t first, std::size_t last) {
+        for (std::size_t i = first; i < last; i++) {
+          Scalar *ci = c + i * n;
+          for (std::size_t p = 0; p < n; p++) {
+            std::size_t q0 = r.rowBegin(p);
+            kernels::axpy(r.rowEnd(p) - q0, a[i * n + p], r.row(p), ci + q0, ci + q0);
+          }
+        }
+      }, rowGrain(n * n / 2));
+      return ret;
+    }
+
+    friend std::ostream &operator<<(std::ostream &os, const TriangularMatrix &t) {
+      return os << t.toDense();
+    }
+
+    // 関数
+
+    friend Transposed t(const TriangularMatrix &mat) {
+      Transposed ret(mat.m_dim);
+      for (std::size_t i = 0; i < mat.m_dim; i++) {
+        for (std::size_t j = mat.rowBegin(i); j < mat.rowEnd(i); j++) {
+          ret(j, i) = mat(i, j);
+        }
+      }
+      return ret;
+    }
+
+    // TRSM．this * x = b を前進 (下三角) または後退 (上三角) 代入で解く．対角成分は 0 でないこと．
+    // 行の間には依存があるので，b の列を分けて並列化する
+    Matrix<Scalar> solve(Matrix<Scalar> b) const {
+      std::size_t n = b.dim().first, k = b.dim().second;
+      assert(n == m_dim);
+      constexpr std::size_t kPanel = 256;
+      Scalar *x = b.data();
+      std::size_t panels = (k + kPanel - 1) / kPanel;
+      Execution policy = resolveExecution(Execution::Auto, n * n * k / 2);
+      parallelFor(policy, 0, panels, [&](std::size_t first, std::size_t last) {
+        std::vector<Scalar> acc(kPanel);
+        for (std::size_t panel = first; panel < last; panel++) {
+          std::size_t c0 = panel * kPanel, w = std::min(k, c0 + kPanel) - c0;
+          for (std::size_t s = 0; s < n; s++) {
+            std::size_t i = kLower ? s : n - 1 - s;
+            // 対角以外の既知の行の寄与を引き，対角成分で割る
+            std::size_t p0 = kLower ? 0 : i + 1, len = kLower ? i : n - i - 1;
+            const Scalar *ri = row(i);
+            const Scalar *offDiag = kLower ? ri : ri + 1;
+            Scalar diag = kLower ? ri[i] : ri[0];
+            assert(diag != Scalar(0));
+            Scalar *xi = x + i * k + c0;
+            if (len > 0) {
+              std::fill(acc.begin(), acc.begin() + w, Scalar(0));
+              kernels::gemm(1, w, len, offDiag, len, x + p0 * k + c0, k, acc.data(), w);
+              kernels::sub(w, xi, acc.data(), xi);
+            }
+            kernels::div(w, xi, diag, xi);
+          }
+        }
+      }, 1);
+      return b;
+    }
+
+    Vector<Scalar> solve(const Vector<Scalar> &b) const {
+      return Vector<Scalar>(solve(Matrix<Scalar>(b)));
+    }
+
+    friend Scalar tr(const TriangularMatrix &mat) {
+      Scalar ret = Scalar(0);
+      for (std::size_t i = 0; i < mat.m_dim; i++) {
+        ret += mat(i, i);
+      }
+      return ret;
+    }
+
+    // 行列式は対角成分の積
+    Scalar det() const {
+      Scalar ret = Scalar(1);
+      for (std::size_t i = 0; i < m_dim; i++) {
+        ret *= (*this)(i, i);
+      }
+      return ret;
+    }
+
+    // 定数
+
+    static TriangularMatrix identity(std::size_t dim) {
+      TriangularMatrix ret(dim);
+      for (std::size_t i = 0; i < dim; i++) {
+        ret(i, i) = Scalar(1);
+      }
+      return ret;
+    }
+  };
+
+  template<typename Scalar>
+  using LowerTriangularMatrix = TriangularMatrix<Scalar, Triangle::Lower>;
+  template<typename Scalar>
+  using UpperTriangularMatrix = TriangularMatrix<Scalar, Triangle::Upper>;
+
+  using Lowerf = LowerTriangularMatrix<float>;
+  using Lowerd = LowerTriangularMatrix<double>;
+  using Upperf = UpperTriangularMatrix<float>;
+  using Upperd = UpperTriangularMatrix<double>;
+} // namespace mywheels
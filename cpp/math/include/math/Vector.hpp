@@ -4,27 +4,106 @@
 #include <vector>
 #include <algorithm>
 #include <numeric>
+#include <utility>
 #include <cassert>
 #include "math/Function.hpp"
+#include "math/Allocator.hpp"
+#include "math/Buffer.hpp"
+#include "math/Layout.hpp"
+#include "math/ThreadPool.hpp"
+#include "math/Reduction.hpp"
+#include "math/Kernels.hpp"
 
 namespace mywheels {
   template<typename Scalar>
-  class Matrix;
+  class Tensor;
 
   template<typename Scalar>
   class Vector {
   private:
-    std::vector<Scalar> m_values;
+    friend class Tensor<Scalar>;
+
+    Buffer<Scalar> m_values;
+
+    // 要素を初期化せずに確保する．直後にすべての要素へ書き込む場合に使う
+    struct NoInit {};
+
+    Vector(std::size_t dim, NoInit) : m_values(dim) {};
+
+    explicit Vector(Buffer<Scalar> values) : m_values(std::move(values)) {};
+
+    // 連結元の要素の先頭．右辺値なら書き込めるポインタを返し，ムーブできるようにする．
+    // 共有していればここで 1 回だけ複製するので，並列区間に入る前に呼び出し元のスレッドで取る
+    template<typename V>
+    static auto sourceData(V &&src) {
+      if constexpr (std::is_rvalue_reference_v<V &&>) {
+        return src.data();
+      } else {
+        return std::as_const(src).data();
+      }
+    }
+
+    // src が書き込めるポインタなら要素をムーブし，そうでなければコピーする
+    template<typename P>
+    static void transfer(P src, std::size_t first, std::size_t last, Scalar *out) {
+      if constexpr (std::is_const_v<std::remove_pointer_t<P>>) {
+        std::copy(src + first, src + last, out);
+      } else {
+        std::move(src + first, src + last, out);
+      }
+    }
+
+    template<typename L, typename R>
+    static Vector concatenate(L &&l, R &&r, Execution policy) {
+      Vector ret(l.dim() + r.dim(), NoInit{});
+      std::size_t n = l.dim();
+      Scalar *out = ret.data();
+      auto x = sourceData(std::forward<L>(l));
+      auto y = sourceData(std::forward<R>(r));
+      parallelFor(policy, 0, ret.dim(), [&](std::size_t first, std::size_t last) {
+        if (first < n) {
+          transfer(x, first, std::min(last, n), out + first);
+        }
+        if (last > n) {
+          std::size_t b = std::max(first, n);
+          transfer(y, b - n, last - n, out + b);
+        }
+      });
+      return ret;
+    }
 
   public:
     // 初期化
 
-    explicit Vector(std::size_t dim) : m_values(dim) {};
+    explicit Vector(std::size_t dim) : Vector(dim, Scalar(0)) {};
 
-    Vector(std::size_t dim, Scalar val) : m_values(dim, val) {};
+    Vector(std::size_t dim, Scalar val, Execution policy = Execution::Auto) : Vector(dim, NoInit{}) {
+      kernels::fill(size(), val, data(), policy);
+    };
 
     Vector(std::initializer_list<Scalar> list) : m_values(list) {};
 
+    // copyOnWrite() が有効なら格納領域を共有し，どちらかへ最初に書き込む時に複製する
+    Vector(const Vector &r) : m_values(copyOnWrite() ? r.m_values : r.m_values.clone()) {};
+
+    Vector(Vector &&r) noexcept = default;
+
+    Vector &operator=(const Vector &r) {
+      if (this != &r) {
+        if (copyOnWrite()) {
+          m_values = r.m_values;
+        } else {
+          if (size() != r.size()) {
+            m_values = decltype(m_values)(r.size());
+          }
+          kernels::copy(size(), r.data(), data(), Execution::Auto);
+        }
+      }
+      return *this;
+    }
+
+    Vector &operator=(Vector &&r) noexcept = default;
+
     // 型変換
     operator Matrix<Scalar>() const {
       Matrix<Scalar> ret(dim(), static_cast<std::size_t>(1));
@@ -50,6 +129,27 @@ namespace mywheels {
       return m_values.end();
     }
 
+    Scalar *data() {
+      return m_values.data();
+    }
+
+    const Scalar *data() const {
+      return m_values.data();
+    }
+
+    std::size_t size() const {
+      return m_values.size();
+    }
+
+    // copyOnWrite() によらず格納領域を共有するコピー
+    Vector share() const {
+      return Vector(m_values);
+    }
+
+    bool sharesStorage(const Vector &r) const {
+      return m_values.sharesStorage(r.m_values);
+    }
+
     // 演算子
 
     Scalar &operator()(std::size_t i) {
@@ -60,6 +160,45 @@ namespace mywheels {
       return m_values[i];
     }
 
+    // 実行方針を指定できる要素ごとの演算．演算子は Execution::Auto で呼び出す
+
+    Vector &add(const Vector &r, Execution policy = Execution::Auto) {
+      assert(dim() == r.dim());
+      kernels::add(size(), data(), r.data(), data(), policy);
+      return *this;
+    }
+
+    Vector &sub(const Vector &r, Execution policy = Execution::Auto) {
+      assert(dim() == r.dim());
+      kernels::sub(size(), data(), r.data(), data(), policy);
+      return *this;
+    }
+
+    Vector &scale(const Scalar &r, Execution policy = Execution::Auto) {
+      kernels::scale(size(), data(), r, data(), policy);
+      return *this;
+    }
+
+    Vector &divide(const Scalar &r, Execution policy = Execution::Auto) {
+      kernels::div(size(), data(), r, data(), policy);
+      return *this;
+    }
+
+    Vector &mod(const Scalar &r, Execution policy = Execution::Auto) {
+      Scalar *x = data();
+      parallelFor(policy, 0, size(), [x, &r](std::size_t first, std::size_t last) {
+        for (std::size_t i = first; i < last; i++) {
+          x[i] = x[i] % r;
+        }
+      });
+      return *this;
+    }
+
+    Vector &negate(Execution policy = Execution::Auto) {
+      kernels::scale(size(), data(), Scalar(-1), data(), policy);
+      return *this;
+    }
+
     // 単項演算子
     Vector operator+() const & {
       return Vector(*this);
@@ -70,55 +209,44 @@ namespace mywheels {
     }
 
     Vector operator-() const & {
-      Vector ret(*this);
-      std::transform(ret.begin(), ret.end(), ret.begin(), std::negate<Scalar>());
+      Vector ret(dim(), NoInit{});
+      kernels::scale(size(), data(), Scalar(-1), ret.data(), Execution::Auto);
       return ret;
     }
 
     Vector operator-() && {
-      std::transform(begin(), end(), begin(), std::negate<Scalar>());
-      return std::move(*this);
+      return std::move(negate());
     }
 
     // 複合代入演算子
 
     Vector &operator+=(const Vector &r) {
-      assert(dim() == r.dim());
-      std::transform(begin(), end(), r.begin(), begin(), std::plus<Scalar>());
-      return *this;
+      return add(r);
     }
 
     Vector &operator-=(const Vector &r) {
-      assert(dim() == r.dim());
-      std::transform(begin(), end(), r.begin(), begin(), std::minus<Scalar>());
-      return *this;
+      return sub(r);
     }
 
     Vector &operator*=(const Scalar &r) {
-      std::transform(begin(), end(), begin(), [&r](Scalar a) {
-        return a * r;
-      });
-      return *this;
+      return scale(r);
     }
 
     Vector &operator/=(const Scalar &r) {
-      std::transform(begin(), end(), begin(), [&r](Scalar a) {
-        return a / r;
-      });
-      return *this;
+      return divide(r);
     }
 
     Vector &operator%=(const Scalar &r) {
-      std::transform(begin(), end(), begin(), [&r](Scalar a) {
-        return a % r;
-      });
-      return *this;
+      return mod(r);
     }
 
     // 二項演算子
 
     friend Vector operator+(const Vector &l, const Vector &r) {
-      return Vector(l) += r;
+      assert(l.dim() == r.dim());
+      Vector ret(l.dim(), NoInit{});
+      kernels::add(ret.size(), l.data(), r.data(), ret.data(), Execution::Auto);
+      return ret;
     }
 
     friend Vector operator+(Vector &&l, const Vector &r) {
@@ -127,8 +255,8 @@ namespace mywheels {
 
     friend Vector operator+(const Vector &l, Vector &&r) {
       assert(l.dim() == r.dim());
-      std::transform(l.begin(), l.end(), r.begin(), r.begin(), std::plus<Scalar>());
-      return r;
+      kernels::add(r.size(), l.data(), r.data(), r.data(), Execution::Auto);
+      return std::move(r);
     }
 
     friend Vector operator+(Vector &&l, Vector &&r) {
@@ -136,7 +264,10 @@ namespace mywheels {
     }
 
     friend Vector operator-(const Vector &l, const Vector &r) {
-      return Vector(l) -= r;
+      assert(l.dim() == r.dim());
+      Vector ret(l.dim(), NoInit{});
+      kernels::sub(ret.size(), l.data(), r.data(), ret.data(), Execution::Auto);
+      return ret;
     }
 
     friend Vector operator-(Vector &&l, const Vector &r) {
@@ -145,7 +276,7 @@ namespace mywheels {
 
     friend Vector operator-(const Vector &l, Vector &&r) {
       assert(l.dim() == r.dim());
-      std::transform(l.begin(), l.end(), r.begin(), r.begin(), std::minus<Scalar>());
+      kernels::sub(r.size(), l.data(), r.data(), r.data(), Execution::Auto);
       return std::move(r);
     }
 
@@ -154,7 +285,9 @@ namespace mywheels {
     }
 
     friend Vector operator*(const Vector &l, const Scalar &r) {
-      return Vector(l) *= r;
+      Vector ret(l.dim(), NoInit{});
+      kernels::scale(ret.size(), l.data(), r, ret.data(), Execution::Auto);
+      return ret;
     }
 
     friend Vector operator*(Vector &&l, const Scalar &r) {
@@ -162,22 +295,19 @@ namespace mywheels {
     }
 
     friend Vector operator*(const Scalar &l, const Vector &r) {
-      Vector ret(r);
-      for (auto &elm : ret) {
-        elm = l * elm;
-      }
+      Vector ret(r.dim(), NoInit{});
+      kernels::scale(ret.size(), r.data(), l, ret.data(), Execution::Auto);
       return ret;
     }
 
     friend Vector operator*(const Scalar &l, Vector &&r) {
-      for (auto &elm : r) {
-        elm = l * elm;
-      }
-      return std::move(r);
+      return std::move(r.scale(l));
     }
 
     friend Vector operator/(const Vector &l, const Scalar &r) {
-      return Vector(l) /= r;
+      Vector ret(l.dim(), NoInit{});
+      kernels::div(ret.size(), l.data(), r, ret.data(), Execution::Auto);
+      return ret;
     }
 
     friend Vector operator/(Vector &&l, const Scalar &r) {
@@ -220,6 +350,23 @@ namespace mywheels {
       return os;
     }
 
+    // 要素ごとの関数
+
+    friend Vector exp(Vector v) {
+      kernels::exp(v.size(), v.data(), v.data());
+      return v;
+    }
+
+    friend Vector sigmoid(Vector v) {
+      kernels::sigmoid(v.size(), v.data(), v.data());
+      return v;
+    }
+
+    friend Vector lamp(Vector v) {
+      kernels::lamp(v.size(), v.data(), v.data());
+      return v;
+    }
+
     // 関数
 
     std::size_t dim() const {
@@ -230,9 +377,9 @@ namespace mywheels {
       return v.dim();
     }
 
-    Scalar dot(const Vector &r) const {
+    Scalar dot(const Vector &r, Summation method = Summation::Pairwise) const {
       assert(dim() == r.dim());
-      return std::inner_product(begin(), end(), r.begin(), Scalar(0));
+      return kernels::dot(data(), r.data(), dim(), method);
     }
 
     friend Scalar dot(const Vector &l, const Vector &r) {
@@ -271,12 +418,45 @@ namespace mywheels {
     }
 
     template<unsigned int P>
-    Scalar lpnorm() const {
-      assert(P >= 1);
-      Scalar ret = std::accumulate(begin(), end(), Scalar(0), [](Scalar sum, Scalar val) {
-        return sum + pow(abs(val), P);
-      });
-      return pow(ret, Scalar(1) / static_cast<Scalar>(P));
+    Scalar lpnorm(Summation method = Summation::Pairwise) const {
+      static_assert(P >= 1);
+      const Scalar *x = data();
+      if constexpr (P == 1) {
+        return reduction::transformSum<Scalar>(dim(), [x](std::size_t i) {
+          return abs(x[i]);
+        }, method);
+      } else if constexpr (P == 2) {
+        return sqrt(kernels::dot(x, x, dim(), method));
+      } else {
+        Scalar ret = reduction::transformSum<Scalar>(dim(), [x](std::size_t i) {
+          return ipow<P>(abs(x[i]));
+        }, method);
+        return pow(ret, Scalar(1) / static_cast<Scalar>(P));
+      }
+    }
+
+    Scalar sum(Summation method = Summation::Pairwise) const {
+      return kernels::sum(data(), dim(), method);
+    }
+
+    friend Scalar sum(const Vector &v) {
+      return v.sum();
+    }
+
+    Scalar min() const {
+      return reduction::min(data(), dim());
+    }
+
+    Scalar max() const {
+      return reduction::max(data(), dim());
+    }
+
+    std::size_t argmin() const {
+      return reduction::argmin(data(), dim());
+    }
+
+    std::size_t argmax() const {
+      return reduction::argmax(data(), dim());
     }
 
     friend Matrix<Scalar> t(const Vector &v) {
@@ -285,32 +465,20 @@ namespace mywheels {
       return ret;
     }
 
-    Vector concatenate(const Vector &r) const & {
-      Vector ret(dim() + r.dim());
-      std::copy(begin(), end(), ret.begin());
-      std::copy(r.begin(), r.end(), ret.begin() + dim());
-      return ret;
+    Vector concatenate(const Vector &r, Execution policy = Execution::Auto) const & {
+      return concatenate(*this, r, policy);
     }
 
-    Vector concatenate(const Vector &r) && {
-      Vector ret(dim() + r.dim());
-      std::move(begin(), end(), ret.begin());
-      std::copy(r.begin(), r.end(), ret.begin() + dim());
-      return ret;
+    Vector concatenate(const Vector &r, Execution policy = Execution::Auto) && {
+      return concatenate(std::move(*this), r, policy);
     }
 
-    Vector concatenate(Vector &&r) const & {
-      Vector ret(dim() + r.dim());
-      std::copy(begin(), end(), ret.begin());
-      std::move(r.begin(), r.end(), ret.begin() + dim());
-      return ret;
+    Vector concatenate(Vector &&r, Execution policy = Execution::Auto) const & {
+      return concatenate(*this, std::move(r), policy);
     }
 
-    Vector concatenate(Vector &&r) && {
-      Vector ret(dim() + r.dim());
-      std::move(begin(), end(), ret.begin());
-      std::move(r.begin(), r.end(), ret.begin() + dim());
-      return ret;
+    Vector concatenate(Vector &&r, Execution policy = Execution::Auto) && {
+      return concatenate(std::move(*this), std::move(r), policy);
     }
 
     // idx=0の時，上からn個を取る
@@ -0,0 +1,477 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <cassert>
+#include "math/Allocator.hpp"
+#include "math/ThreadPool.hpp"
+#include "math/Kernels.hpp"
+#include "math/Vector.hpp"
+#include "math/Matrix.hpp"
+
+namespace mywheels {
+  // N 次元ベクトルを成分ごとに連続に並べて (SoA) 多数保持する．
+  // 演算は点の方向に kernels を呼ぶので，点をまたいで SIMD 化される
+  template<typename Scalar, std::size_t N>
+  class VectorBatch {
+    static_assert(N >= 1);
+
+  private:
+    // 成分 c は [c * m_count, (c + 1) * m_count) に並ぶ
+    std::vector<Scalar, DefaultInitAllocator<Scalar>> m_values;
+    std::size_t m_count;
+
+    // 作業配列が L1 に収まるように，点を kChunk 個ずつ処理する
+    static constexpr std::size_t kChunk = 1024;
+
+    // 要素を初期化せずに確保する．直後にすべての要素へ書き込む場合に使う
+    struct NoInit {};
+
+    VectorBatch(std::size_t count, NoInit) : m_values(N * count), m_count(count) {};
+
+    // 点を kChunk 個以下の区間 [first, last) に分けて fn(first, last) を呼ぶ．区間のまとまりごとに並列化する
+    template<typename F>
+    static void forEachChunk(std::size_t count, Execution policy, const F &fn) {
+      parallelFor(resolveExecution(policy, N * count), 0, count, [&](std::size_t first, std::size_t last) {
+        for (std::size_t b = first; b < last; b += kChunk) {
+          fn(b, std::min(last, b + kChunk));
+        }
+      }, std::max(kChunk, kDefaultGrain / N));
+    }
+
+  public:
+    // 初期化
+
+    explicit VectorBatch(std::size_t count = 0) : VectorBatch(count, NoInit{}) {
+      kernels::fill(size(), Scalar(0), data(), Execution::Auto);
+    };
+
+    VectorBatch(std::size_t count, const Vector<Scalar> &val, Execution policy = Execution::Auto) :
+      VectorBatch(count, NoInit{}) {
+      assert(val.dim() == N);
+      for (std::size_t c = 0; c < N; c++) {
+        kernels::fill(count, val(c), component(c), policy);
+      }
+    };
+
+    VectorBatch(const VectorBatch &r) : VectorBatch(r.m_count, NoInit{}) {
+      kernels::copy(size(), r.data(), data(), Execution::Auto);
+    }
+
+    VectorBatch(VectorBatch &&r) noexcept = default;
+
+    VectorBatch &operator=(const VectorBatch &r) {
+      if (this != &r) {
+        if (size() != r.size()) {
+          m_values = decltype(m_values)(r.size());
+        }
+        m_count = r.m_count;
+        kernels::copy(size(), r.data(), data(), Execution::Auto);
+      }
+      return *this;
+    }
+
+    VectorBatch &operator=(VectorBatch &&r) noexcept = default;
+
+    // AoS との変換
+
+    static VectorBatch fromAoS(const std::vector<Vector<Scalar>> &points, Execution policy = Execution::Auto) {
+      VectorBatch ret(points.size(), NoInit{});
+      forEachChunk(ret.m_count, policy, [&](std::size_t first, std::size_t last) {
+        for (std::size_t i = first; i < last; i++) {
+          assert(points[i].dim() == N);
+          for (std::size_t c = 0; c < N; c++) {
+            ret.component(c)[i] = points[i](c);
+          }
+        }
+      });
+      return ret;
+    }
+
+    std::vector<Vector<Scalar>> toAoS() const {
+      std::vector<Vector<Scalar>> ret(m_count, Vector<Scalar>(N));
+      forEachChunk(m_count, Execution::Auto, [&](std::size_t first, std::size_t last) {
+        for (std::size_t i = first; i < last; i++) {
+          for (std::size_t c = 0; c < N; c++) {
+            ret[i](c) = component(c)[i];
+          }
+        }
+      });
+      return ret;
+    }
+
+    // 点ごとに N 成分を並べた配列 (x0 y0 z0 x1 y1 z1 ...) との変換
+    static VectorBatch fromInterleaved(const Scalar *values, std::size_t count, Execution policy = Execution::Auto) {
+      VectorBatch ret(count, NoInit{});
+      forEachChunk(count, policy, [&](std::size_t first, std::size_t last) {
+        for (std::size_t c = 0; c < N; c++) {
+          Scalar *out = ret.component(c);
+          for (std::size_t i = first; i < last; i++) {
+            out[i] = values[i * N + c];
+          }
+        }
+      });
+      return ret;
+    }
+
+    void toInterleaved(Scalar *values, Execution policy = Execution::Auto) const {
+      forEachChunk(m_count, policy, [&](std::size_t first, std::size_t last) {
+        for (std::size_t c = 0; c < N; c++) {
+          const Scalar *in = component(c);
+          for (std::size_t i = first; i < last; i++) {
+            values[i * N + c] = in[i];
+          }
+        }
+      });
+    }
+
+    // 添字で選んだ点を集める．ret の k 番目の点は index[k] 番目の点
+    VectorBatch gather(const std::vector<std::size_t> &index, Execution policy = Execution::Auto) const {
+      VectorBatch ret(index.size(), NoInit{});
+      forEachChunk(ret.m_count, policy, [&](std::size_t first, std::size_t last) {
+        for (std::size_t c = 0; c < N; c++) {
+          const Scalar *in = component(c);
+          Scalar *out = ret.component(c);
+          for (std::size_t k = first; k < last; k++) {
+            assert(index[k] < m_count);
+            out[k] = in[index[k]];
+          }
+        }
+      });
+      return ret;
+    }
+
+    // src の k 番目の点を index[k] 番目に書き込む．index に重複があると並列実行時の結果は不定
+    VectorBatch &scatter(const VectorBatch &src, const std::vector<std::size_t> &index,
+      Execution policy = Execution::Auto) {
+      assert(src.m_count == index.size());
+      forEachChunk(src.m_count, policy, [&](std::size_t first, std::size_t last) {
+        for (std::size_t c = 0; c < N; c++) {
+          const Scalar *in = src.component(c);
+          Scalar *out = component(c);
+          for (std::size_t k = first; k < last; k++) {
+            assert(index[k] < m_count);
+            out[index[k]] = in[k];
+          }
+        }
+      });
+      return *this;
+    }
+
+    // 要素の参照
+
+    Scalar *data() {
+      return m_values.data();
+    }
+
+    const Scalar *data() const {
+      return m_values.data();
+    }
+
+    // 全成分の要素数 N * count()
+    std::size_t size() const {
+      return m_values.size();
+    }
+
+    // 点の数
+    std::size_t count() const {
+      return m_count;
+    }
+
+    static constexpr std::size_t dim() {
+      return N;
+    }
+
+    Scalar *component(std::size_t c) {
+      assert(c < N);
+      return data() + c * m_count;
+    }
+
+    const Scalar *component(std::size_t c) const {
+      assert(c < N);
+      return data() + c * m_count;
+    }
+
+    // i 番目の点の成分 c
+    Scalar &operator()(std::size_t i, std::size_t c) {
+      return m_values[c * m_count + i];
+    }
+
+    const Scalar &operator()(std::size_t i, std::size_t c) const {
+      return m_values[c * m_count + i];
+    }
+
+    Vector<Scalar> get(std::size_t i) const {
+      assert(i < m_count);
+      Vector<Scalar> ret(N);
+      for (std::size_t c = 0; c < N; c++) {
+        ret(c) = (*this)(i, c);
+      }
+      return ret;
+    }
+
+    void set(std::size_t i, const Vector<Scalar> &v) {
+      assert(i < m_count && v.dim() == N);
+      for (std::size_t c = 0; c < N; c++) {
+        (*this)(i, c) = v(c);
+      }
+    }
+
+    // 実行方針を指定できる要素ごとの演算．演算子は Execution::Auto で呼び出す
+
+    VectorBatch &add(const VectorBatch &r, Execution policy = Execution::Auto) {
+      assert(m_count == r.m_count);
+      kernels::add(size(), data(), r.data(), data(), policy);
+      return *this;
+    }
+
+    VectorBatch &sub(const VectorBatch &r, Execution policy = Execution::Auto) {
+      assert(m_count == r.m_count);
+      kernels::sub(size(), data(), r.data(), data(), policy);
+      return *this;
+    }
+
+    // 成分ごとの積
+    VectorBatch &mul(const VectorBatch &r, Execution policy = Execution::Auto) {
+      assert(m_count == r.m_count);
+      kernels::mul(size(), data(), r.data(), data(), policy);
+      return *this;
+    }
+
+    VectorBatch &scale(const Scalar &r, Execution policy = Execution::Auto) {
+      kernels::scale(size(), data(), r, data(), policy);
+      return *this;
+    }
+
+    VectorBatch &divide(const Scalar &r, Execution policy = Execution::Auto) {
+      kernels::div(size(), data(), r, data(), policy);
+      return *this;
+    }
+
+    VectorBatch &negate(Execution policy = Execution::Auto) {
+      kernels::scale(size(), data(), Scalar(-1), data(), policy);
+      return *this;
+    }
+
+    // 単項演算子
+
+    VectorBatch operator+() const & {
+      return VectorBatch(*this);
+    }
+
+    VectorBatch operator+() && {
+      return std::move(*this);
+    }
+
+    VectorBatch operator-() const & {
+      VectorBatch ret(m_count, NoInit{});
+      kernels::scale(size(), data(), Scalar(-1), ret.data(), Execution::Auto);
+      return ret;
+    }
+
+    VectorBatch operator-() && {
+      return std::move(negate());
+    }
+
+    // 複合代入演算子
+
+    VectorBatch &operator+=(const VectorBatch &r) {
+      return add(r);
+    }
+
+    VectorBatch &operator-=(const VectorBatch &r) {
+      return sub(r);
+    }
+
+    VectorBatch &operator*=(const Scalar &r) {
+      return scale(r);
+    }
+
+    VectorBatch &operator/=(const Scalar &r) {
+      return divide(r);
+    }
+
+    // 二項演算子
+
+    friend VectorBatch operator+(const VectorBatch &l, const VectorBatch &r) {
+      assert(l.m_count == r.m_count);
+      VectorBatch ret(l.m_count, NoInit{});
+      kernels::add(ret.size(), l.data(), r.data(), ret.data(), Execution::Auto);
+      return ret;
+    }
+
+    friend VectorBatch operator+(VectorBatch &&l, const VectorBatch &r) {
+      return std::move(l += r);
+    }
+
+    friend VectorBatch operator-(const VectorBatch &l, const VectorBatch &r) {
+      assert(l.m_count == r.m_count);
+      VectorBatch ret(l.m_count, NoInit{});
+      kernels::sub(ret.size(), l.data(), r.data(), ret.data(), Execution::Auto);
+      return ret;
+    }
+
+    friend VectorBatch operator-(VectorBatch &&l, const VectorBatch &r) {
+      return std::move(l -= r);
+    }
+
+    friend VectorBatch operator*(const VectorBatch &l, const Scalar &r) {
+      VectorBatch ret(l.m_count, NoInit{});
+      kernels::scale(ret.size(), l.data(), r, ret.data(), Execution::Auto);
+      return ret;
+    }
+
+    friend VectorBatch operator*(VectorBatch &&l, const Scalar &r) {
+      return std::move(l *= r);
+    }
+
+    friend VectorBatch operator*(const Scalar &l, const VectorBatch &r) {
+      return r * l;
+    }
+
+    friend VectorBatch operator*(const Scalar &l, VectorBatch &&r) {
+      return std::move(r *= l);
+    }
+
+    friend VectorBatch operator/(const VectorBatch &l, const Scalar &r) {
+      VectorBatch ret(l.m_count, NoInit{});
+      kernels::div(ret.size(), l.data(), r, ret.data(), Execution::Auto);
+      return ret;
+    }
+
+    friend VectorBatch operator/(VectorBatch &&l, const Scalar &r) {
+      return std::move(l /= r);
+    }
+
+    // 比較演算子
+
+    friend bool operator==(const VectorBatch &l, const VectorBatch &r) {
+      return l.m_count == r.m_count && std::equal(l.m_values.begin(), l.m_values.end(), r.m_values.begin());
+    }
+
+    friend bool operator!=(const VectorBatch &l, const VectorBatch &r) {
+      return !(l == r);
+    }
+
+    // 点ごとの関数
+
+    // 点ごとの内積
+    Vector<Scalar> dot(const VectorBatch &r, Execution policy = Execution::Auto) const {
+      assert(m_count == r.m_count);
+      Vector<Scalar> ret(m_count);
+      Scalar *out = ret.data();
+      forEachChunk(m_count, policy, [&](std::size_t first, std::size_t last) {
+        std::size_t n = last - first;
+        kernels::mul(n, component(0) + first, r.component(0) + first, out + first);
+        for (std::size_t c = 1; c < N; c++) {
+          kernels::fma(n, component(c) + first, r.component(c) + first, out + first, out + first);
+        }
+      });
+      return ret;
+    }
+
+    friend Vector<Scalar> dot(const VectorBatch &l, const VectorBatch &r) {
+      return l.dot(r);
+    }
+
+    VectorBatch cross(const VectorBatch &r, Execution policy = Execution::Auto) const {
+      static_assert(N == 3);
+      assert(m_count == r.m_count);
+      VectorBatch ret(m_count, NoInit{});
+      forEachChunk(m_count, policy, [&](std::size_t first, std::size_t last) {
+        std::size_t n = last - first;
+        // ret[c] = l[c + 1] * r[c + 2] - l[c + 2] * r[c + 1]
+        for (std::size_t c = 0; c < 3; c++) {
+          std::size_t c1 = (c + 1) % 3, c2 = (c + 2) % 3;
+          Scalar *out = ret.component(c) + first;
+          kernels::mul(n, component(c2) + first, r.component(c1) + first, out);
+          kernels::fms(n, component(c1) + first, r.component(c2) + first, out, out);
+        }
+      });
+      return ret;
+    }
+
+    friend VectorBatch cross(const VectorBatch &l, const VectorBatch &r) {
+      return l.cross(r);
+    }
+
+    // 点ごとのユークリッドノルム
+    Vector<Scalar> norm(Execution policy = Execution::Auto) const {
+      Vector<Scalar> ret(m_count);
+      Scalar *out = ret.data();
+      forEachChunk(m_count, policy, [&](std::size_t first, std::size_t last) {
+        normChunk(first, last, out + first);
+      });
+      return ret;
+    }
+
+    friend Vector<Scalar> norm(const VectorBatch &b) {
+      return b.norm();
+    }
+
+    // 各点を単位ベクトルにする．長さ 0 の点は NaN になる
+    VectorBatch &normalize(Execution policy = Execution::Auto) {
+      forEachChunk(m_count, policy, [&](std::size_t first, std::size_t last) {
+        Scalar length[kChunk];
+        std::size_t n = last - first;
+        normChunk(first, last, length);
+        for (std::size_t c = 0; c < N; c++) {
+          kernels::quot(n, component(c) + first, length, component(c) + first);
+        }
+      });
+      return *this;
+    }
+
+    friend VectorBatch normalized(const VectorBatch &b) {
+      return VectorBatch(b).normalize();
+    }
+
+    // 各点 x を a x (+ b) に写す．a は N x N の線形変換か，最後の列に平行移動 b を持つ N x (N + 1)
+    template<typename Layout>
+    VectorBatch transform(const Matrix<Scalar, Layout> &a, Execution policy = Execution::Auto) const {
+      std::size_t rows = a.dim().first, cols = a.dim().second;
+      assert(rows == N && (cols == N || cols == N + 1));
+      bool affine = (cols == N + 1);
+      VectorBatch ret(m_count, NoInit{});
+      forEachChunk(m_count, policy, [&](std::size_t first, std::size_t last) {
+        std::size_t n = last - first;
+        for (std::size_t r = 0; r < N; r++) {
+          Scalar *out = ret.component(r) + first;
+          if (affine) {
+            kernels::fill(n, a(r, N), out);
+            kernels::axpy(n, a(r, 0), component(0) + first, out, out);
+          } else {
+            kernels::scale(n, component(0) + first, a(r, 0), out);
+          }
+          for (std::size_t c = 1; c < N; c++) {
+            kernels::axpy(n, a(r, c), component(c) + first, out, out);
+          }
+        }
+      });
+      return ret;
+    }
+
+    // 定数
+
+    static VectorBatch zero(std::size_t count) {
+      return VectorBatch(count);
+    }
+
+  private:
+    // [first, last) の点のノルムを out に書く
+    void normChunk(std::size_t first, std::size_t last, Scalar *out) const {
+      std::size_t n = last - first;
+      kernels::mul(n, component(0) + first, component(0) + first, out);
+      for (std::size_t c = 1; c < N; c++) {
+        kernels::fma(n, component(c) + first, component(c) + first, out, out);
+      }
+      kernels::sqrt(n, out, out);
+    }
+  };
+
+  template<std::size_t N>
+  using VecBatchf = VectorBatch<float, N>;
+  template<std::size_t N>
+  using VecBatchd = VectorBatch<double, N>;
+} // namespace mywheels
@@ -0,0 +1,40 @@
+#include "math/Buffer.hpp"
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+
+namespace mywheels {
+  namespace {
+    std::atomic<bool> &copyOnWriteState() {
+      static std::atomic<bool> state([]() {
+        const char *env = std::getenv("MYWHEELS_COPY_ON_WRITE");
+        if (env == nullptr || *env == '\0' || std::strcmp(env, "0") == 0) {
+          return false;
+        }
+        if (std::strcmp(env, "1") == 0) {
+          return true;
+        }
+        std::cerr << "mywheels: unknown MYWHEELS_COPY_ON_WRITE=" << env << ", using 0\n";
+        return false;
+      }());
+      return state;
+    }
+  } // namespace
+
+  bool copyOnWrite() {
+    return copyOnWriteState().load(std::memory_order_relaxed);
+  }
+
+  void setCopyOnWrite(bool enable) {
+    copyOnWriteState().store(enable, std::memory_order_relaxed);
+  }
+
+  namespace detail {
+    std::mutex &bufferShareMutex() {
+      static std::mutex mutex;
+      return mutex;
+    }
+  } // namespace detail
+} // namespace mywheels
@@ -0,0 +1,160 @@
+#include "math/Cpu.hpp"
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#  define MYWHEELS_X86 1
+#  if defined(_MSC_VER)
+#    include <intrin.h>
+#    include <immintrin.h>
+#  else
+#    include <cpuid.h>
+#  endif
+#endif
+
+namespace mywheels {
+  namespace {
+#ifdef MYWHEELS_X86
+    void cpuid(unsigned int leaf, unsigned int subleaf, unsigned int (&regs)[4]) {
+#  if defined(_MSC_VER)
+      int r[4];
+      __cpuidex(r, static_cast<int>(leaf), static_cast<int>(subleaf));
+      for (int i = 0; i < 4; i++) {
+        regs[i] = static_cast<unsigned int>(r[i]);
+      }
+#  else
+      __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#  endif
+    }
+
+    // OS が保存するレジスタ状態 (XCR0)
+    unsigned long long xgetbv0() {
+#  if defined(_MSC_VER)
+      return _xgetbv(0);
+#  else
+      unsigned int lo, hi;
+      __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+      return (static_cast<unsigned long long>(hi) << 32) | lo;
+#  endif
+    }
+#endif
+
+    CpuFeatures detect() {
+      CpuFeatures f;
+#ifdef MYWHEELS_X86
+      unsigned int regs[4];
+      cpuid(0, 0, regs);
+      unsigned int maxLeaf = regs[0];
+      if (maxLeaf < 1) {
+        return f;
+      }
+
+      cpuid(1, 0, regs);
+      unsigned int ecx1 = regs[2];
+      f.sse42 = (ecx1 >> 20) & 1;
+      f.popcnt = (ecx1 >> 23) & 1;
+      bool osxsave = (ecx1 >> 27) & 1;
+      unsigned long long xcr0 = osxsave ? xgetbv0() : 0;
+      // XMM と YMM の状態を OS が保存しているか
+      bool osAvx = (xcr0 & 0x6) == 0x6;
+      // さらに opmask と ZMM の状態を保存しているか
+      bool osAvx512 = (xcr0 & 0xe6) == 0xe6;
+
+      f.avx = osAvx && ((ecx1 >> 28) & 1);
+      f.fma = f.avx && ((ecx1 >> 12) & 1);
+      if (maxLeaf >= 7) {
+        cpuid(7, 0, regs);
+        unsigned int ebx7 = regs[1];
+        unsigned int ecx7 = regs[2];
+        f.avx2 = f.avx && ((ebx7 >> 5) & 1);
+        f.avx512f = osAvx512 && ((ebx7 >> 16) & 1);
+        f.avx512dq = f.avx512f && ((ebx7 >> 17) & 1);
+        f.avx512bw = f.avx512f && ((ebx7 >> 30) & 1);
+        f.avx512vl = f.avx512f && ((ebx7 >> 31) & 1);
+        f.avx512vpopcntdq = f.avx512f && ((ecx7 >> 14) & 1);
+      }
+#endif
+      return f;
+    }
+
+    bool parseIsa(const char *name, Isa &isa) {
+      struct Entry {
+        const char *name;
+        Isa isa;
+      };
+      static const Entry entries[] = {
+        {"generic", Isa::Generic},
+        {"scalar", Isa::Generic},
+        {"sse4.2", Isa::SSE42},
+        {"sse42", Isa::SSE42},
+        {"avx2", Isa::AVX2},
+        {"avx512", Isa::AVX512},
+      };
+      for (const auto &e : entries) {
+        if (std::strcmp(name, e.name) == 0) {
+          isa = e.isa;
+          return true;
+        }
+      }
+      return false;
+    }
+  } // namespace
+
+  const CpuFeatures &cpuFeatures() {
+    static const CpuFeatures features = detect();
+    return features;
+  }
+
+  Isa detectedIsa() {
+    const CpuFeatures &f = cpuFeatures();
+    // 上の段階は下の段階の機能 (SSE4.2 と POPCNT) も含む
+    bool sse42 = f.sse42 && f.popcnt;
+    if (sse42 && f.avx512f && f.avx512dq && f.avx512bw && f.avx512vl && f.avx2 && f.fma) {
+      return Isa::AVX512;
+    }
+    if (sse42 && f.avx2 && f.fma) {
+      return Isa::AVX2;
+    }
+    if (sse42) {
+      return Isa::SSE42;
+    }
+    return Isa::Generic;
+  }
+
+  Isa activeIsa() {
+    static const Isa isa = []() {
+      Isa best = detectedIsa();
+      const char *env = std::getenv("MYWHEELS_ISA");
+      if (env == nullptr || *env == '\0') {
+        return best;
+      }
+      Isa requested;
+      if (!parseIsa(env, requested)) {
+        std::cerr << "mywheels: unknown MYWHEELS_ISA=" << env << ", using " << isaName(best) << '\n';
+        return best;
+      }
+      if (requested > best) {
+        std::cerr << "mywheels: MYWHEELS_ISA=" << env << " is not supported by this CPU, using " << isaName(best)
+                  << '\n';
+        return best;
+      }
+      return requested;
+    }();
+    return isa;
+  }
+
+  const char *isaName(Isa isa) {
+    switch (isa) {
+    case Isa::SSE42:
+      return "sse4.2";
+    case Isa::AVX2:
+      return "avx2";
+    case Isa::AVX512:
+      return "avx512";
+    case Isa::Generic:
+    default:
+      return "generic";
+    }
+  }
+} // namespace mywheels
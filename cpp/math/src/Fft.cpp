@@ -0,0 +1,509 @@
+#include "math/Fft.hpp"
+#include <cmath>
+#include <mutex>
+#include <unordered_map>
+#include <algorithm>
+#include "math/Multiversion.hpp"
+
+namespace mywheels {
+  namespace {
+    constexpr double kPi = 3.14159265358979323846;
+
+    // Stockham 法で直接扱う最大の基数
+    constexpr std::size_t kMaxRadix = 13;
+
+    // 列の本数 (stride) がこれ以上の段は列の方向を内側のループにする
+    constexpr std::size_t kVectorStride = 8;
+
+    // n を基数に分ける．kMaxRadix より大きな素因数を持つなら空
+    std::vector<std::size_t> factorize(std::size_t n) {
+      std::vector<std::size_t> ret;
+      while (n % 4 == 0) {
+        ret.push_back(4);
+        n /= 4;
+      }
+      for (std::size_t p : {2, 3, 5, 7, 11, 13}) {
+        while (n % p == 0) {
+          ret.push_back(p);
+          n /= p;
+        }
+      }
+      if (n > 1) {
+        ret.clear();
+      }
+      return ret;
+    }
+
+    // 長さ p (P が 0 でなければ P) の DFT．a から b へ．c, s は cos(2πk / p), sin(2πk / p)
+    template<typename T, std::size_t P>
+    inline void butterfly(std::size_t p, const T *ar, const T *ai, T *br, T *bi, const T *c, const T *s) {
+      if constexpr (P == 2) {
+        br[0] = ar[0] + ar[1];
+        bi[0] = ai[0] + ai[1];
+        br[1] = ar[0] - ar[1];
+        bi[1] = ai[0] - ai[1];
+      } else if constexpr (P == 4) {
+        T t0r = ar[0] + ar[2], t0i = ai[0] + ai[2];
+        T t1r = ar[0] - ar[2], t1i = ai[0] - ai[2];
+        T t2r = ar[1] + ar[3], t2i = ai[1] + ai[3];
+        // -i (a1 - a3)
+        T t3r = ai[1] - ai[3], t3i = ar[3] - ar[1];
+        br[0] = t0r + t2r;
+        bi[0] = t0i + t2i;
+        br[1] = t1r + t3r;
+        bi[1] = t1i + t3i;
+        br[2] = t0r - t2r;
+        bi[2] = t0i - t2i;
+        br[3] = t1r - t3r;
+        bi[3] = t1i - t3i;
+      } else {
+        // 奇数の基数．a_r と a_{p-r} の和と差にまとめると b_t = a_0 + sum_r (sum_r cos - i diff_r sin) になる
+        if constexpr (P != 0) {
+          p = P;
+        }
+        std::size_t h = p / 2;
+        T sr[kMaxRadix / 2], si[kMaxRadix / 2], dr[kMaxRadix / 2], di[kMaxRadix / 2];
+        T b0r = ar[0], b0i = ai[0];
+        for (std::size_t r = 1; r <= h; r++) {
+          sr[r - 1] = ar[r] + ar[p - r];
+          si[r - 1] = ai[r] + ai[p - r];
+          dr[r - 1] = ar[r] - ar[p - r];
+          di[r - 1] = ai[r] - ai[p - r];
+          b0r += sr[r - 1];
+          b0i += si[r - 1];
+        }
+        br[0] = b0r;
+        bi[0] = b0i;
+        for (std::size_t t = 1; t < p; t++) {
+          T xr = ar[0], xi = ai[0];
+          for (std::size_t r = 1; r <= h; r++) {
+            std::size_t k = (r * t) % p;
+            xr += sr[r - 1] * c[k] + di[r - 1] * s[k];
+            xi += si[r - 1] * c[k] - dr[r - 1] * s[k];
+          }
+          br[t] = xr;
+          bi[t] = xi;
+        }
+      }
+    }
+
+    // Stockham 法の 1 段．x の列 q (stride 本) の要素 j + r m を基数 p の DFT でまとめ，
+    // 回転因子を掛けて y の q + stride (p j + t) へ書く．S が 0 でなければ stride は S
+    template<typename T, std::size_t P, std::size_t S>
+    inline void pass(std::size_t p, std::size_t length, std::size_t stride, const T *twRe, const T *twIm,
+      const T *c, const T *s, const T *MYWHEELS_RESTRICT xr, const T *MYWHEELS_RESTRICT xi,
+      T *MYWHEELS_RESTRICT yr, T *MYWHEELS_RESTRICT yi) {
+      if constexpr (P != 0) {
+        p = P;
+      }
+      if constexpr (S != 0) {
+        stride = S;
+      }
+      std::size_t m = length / p;
+      auto step = [&](std::size_t j, std::size_t q) {
+        T ar[kMaxRadix]{}, ai[kMaxRadix]{}, br[kMaxRadix], bi[kMaxRadix];
+        for (std::size_t r = 0; r < p; r++) {
+          ar[r] = xr[q + stride * (j + r * m)];
+          ai[r] = xi[q + stride * (j + r * m)];
+        }
+        butterfly<T, P>(p, ar, ai, br, bi, c, s);
+        std::size_t o = q + stride * p * j;
+        yr[o] = br[0];
+        yi[o] = bi[0];
+        for (std::size_t t = 1; t < p; t++) {
+          T wr = twRe[(t - 1) * m + j], wi = twIm[(t - 1) * m + j];
+          yr[o + stride * t] = br[t] * wr - bi[t] * wi;
+          yi[o + stride * t] = br[t] * wi + bi[t] * wr;
+        }
+      };
+      if (stride >= kVectorStride) {
+        for (std::size_t j = 0; j < m; j++) {
+          for (std::size_t q = 0; q < stride; q++) {
+            step(j, q);
+          }
+        }
+      } else {
+        for (std::size_t q = 0; q < stride; q++) {
+          for (std::size_t j = 0; j < m; j++) {
+            step(j, q);
+          }
+        }
+      }
+    }
+
+    template<typename T, std::size_t P>
+    inline void radixPass(std::size_t p, std::size_t length, std::size_t stride, const T *twRe, const T *twIm,
+      const T *c, const T *s, const T *xr, const T *xi, T *yr, T *yi) {
+      if (stride == 1) {
+        pass<T, P, 1>(p, length, stride, twRe, twIm, c, s, xr, xi, yr, yi);
+      } else {
+        pass<T, P, 0>(p, length, stride, twRe, twIm, c, s, xr, xi, yr, yi);
+      }
+    }
+
+    template<typename T>
+    inline void anyPass(std::size_t p, std::size_t length, std::size_t stride, const T *twRe, const T *twIm,
+      const T *c, const T *s, const T *xr, const T *xi, T *yr, T *yi) {
+      switch (p) {
+      case 2:
+        radixPass<T, 2>(p, length, stride, twRe, twIm, c, s, xr, xi, yr, yi);
+        break;
+      case 3:
+        radixPass<T, 3>(p, length, stride, twRe, twIm, c, s, xr, xi, yr, yi);
+        break;
+      case 4:
+        radixPass<T, 4>(p, length, stride, twRe, twIm, c, s, xr, xi, yr, yi);
+        break;
+      case 5:
+        radixPass<T, 5>(p, length, stride, twRe, twIm, c, s, xr, xi, yr, yi);
+        break;
+      default:
+        radixPass<T, 0>(p, length, stride, twRe, twIm, c, s, xr, xi, yr, yi);
+        break;
+      }
+    }
+
+    // 命令セットごとにコンパイルされた FFT のカーネル
+    template<typename T>
+    struct FftKernels {
+      void (*pass)(std::size_t p, std::size_t length, std::size_t stride, const T *twRe, const T *twIm,
+        const T *c, const T *s, const T *xr, const T *xi, T *yr, T *yi);
+      // 要素ごとの複素数の積 out = a * b．out は a, b と同じでもよい
+      void (*multiply)(std::size_t n, const T *ar, const T *ai, const T *br, const T *bi, T *outRe, T *outIm);
+    };
+  } // namespace
+
+// 命令セット ISA 向けの FftKernels<T> を NS::table<T> として定義する
+#define MYWHEELS_DEFINE_FFT_KERNELS(NS, ISA, TARGET)                                                               \
+  namespace NS {                                                                                                     \
+    namespace {                                                                                                      \
+      template<typename T>                                                                                           \
+      TARGET void pass(std::size_t p, std::size_t length, std::size_t stride, const T *twRe, const T *twIm,          \
+        const T *c, const T *s, const T *xr, const T *xi, T *yr, T *yi) {                                            \
+        anyPass<T>(p, length, stride, twRe, twIm, c, s, xr, xi, yr, yi);                                             \
+      }                                                                                                              \
+      template<typename T>                                                                                           \
+      TARGET void multiply(std::size_t n, const T *ar, const T *ai, const T *br, const T *bi, T *outRe, T *outIm) {  \
+        for (std::size_t i = 0; i < n; i++) {                                                                        \
+          T r = ar[i] * br[i] - ai[i] * bi[i], im = ar[i] * bi[i] + ai[i] * br[i];                                   \
+          outRe[i] = r;                                                                                              \
+          outIm[i] = im;                                                                                             \
+        }                                                                                                            \
+      }                                                                                                              \
+      template<typename T>                                                                                           \
+      const FftKernels<T> table = {pass<T>, multiply<T>};                                                            \
+    }                                                                                                                \
+  }
+
+  MYWHEELS_DEFINE_FOR_EACH_ISA(MYWHEELS_DEFINE_FFT_KERNELS)
+
+#undef MYWHEELS_DEFINE_FFT_KERNELS
+
+  namespace {
+    // カーネルの関数表と同じ命令セットのもの (kernels::useIsa に従う)
+    template<typename T>
+    const FftKernels<T> &fftKernels() {
+      return selectIsa(kernels::table<T>().isa, generic::table<T>, sse42::table<T>, avx2::table<T>, avx512::table<T>);
+    }
+
+    // 計画のキャッシュ．計画の構築は他の長さの計画を使うことがあるのでロックの外で行う
+    template<typename Plan>
+    std::shared_ptr<const Plan> cachedPlan(std::size_t n) {
+      static std::mutex mutex;
+      static std::unordered_map<std::size_t, std::shared_ptr<const Plan>> cache;
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = cache.find(n);
+        if (it != cache.end()) {
+          return it->second;
+        }
+      }
+      auto plan = std::make_shared<const Plan>(n);
+      std::lock_guard<std::mutex> lock(mutex);
+      return cache.emplace(n, std::move(plan)).first->second;
+    }
+  } // namespace
+
+  // FftPlan
+
+  template<typename T>
+  FftPlan<T>::FftPlan(std::size_t n) : m_n(n) {
+    std::vector<std::size_t> radices = factorize(n);
+    if (n > 1 && radices.empty()) {
+      // X[k] = c[k] sum_j (x[j] c[j]) conj(c[k - j])，c[k] = exp(-πi k^2 / n) として長さ m >= 2n - 1 の巡回畳み込みにする
+      std::size_t m = 1;
+      while (m < 2 * n - 1) {
+        m <<= 1;
+      }
+      m_inner = get(m);
+      m_chirpRe.resize(n);
+      m_chirpIm.resize(n);
+      // k^2 を 2n で割った余りを差分 2k - 1 で更新する
+      std::size_t sq = 0;
+      for (std::size_t k = 0; k < n; k++) {
+        if (k > 0) {
+          sq += 2 * k - 1;
+          sq %= 2 * n;
+        }
+        double angle = kPi * static_cast<double>(sq) / static_cast<double>(n);
+        m_chirpRe[k] = static_cast<T>(std::cos(angle));
+        m_chirpIm[k] = static_cast<T>(-std::sin(angle));
+      }
+      m_filterRe.assign(m, T(0));
+      m_filterIm.assign(m, T(0));
+      for (std::size_t k = 0; k < n; k++) {
+        m_filterRe[k] = m_chirpRe[k];
+        m_filterIm[k] = -m_chirpIm[k];
+        if (k > 0) {
+          m_filterRe[m - k] = m_chirpRe[k];
+          m_filterIm[m - k] = -m_chirpIm[k];
+        }
+      }
+      std::vector<T> scratch(m_inner->scratchSize());
+      m_inner->transform(m_filterRe.data(), m_filterIm.data(), scratch.data());
+      T inv = T(1) / static_cast<T>(m);
+      for (std::size_t k = 0; k < m; k++) {
+        m_filterRe[k] *= inv;
+        m_filterIm[k] *= inv;
+      }
+      return;
+    }
+
+    std::size_t length = n, stride = 1;
+    for (std::size_t p : radices) {
+      std::size_t m = length / p;
+      m_passes.push_back(Pass{p, length, stride, m_twiddleRe.size(), m_rootCos.size()});
+      for (std::size_t t = 1; t < p; t++) {
+        for (std::size_t j = 0; j < m; j++) {
+          double angle = 2 * kPi * static_cast<double>((j * t) % length) / static_cast<double>(length);
+          m_twiddleRe.push_back(static_cast<T>(std::cos(angle)));
+          m_twiddleIm.push_back(static_cast<T>(-std::sin(angle)));
+        }
+      }
+      if (p % 2 == 1) {
+        for (std::size_t k = 0; k < p; k++) {
+          double angle = 2 * kPi * static_cast<double>(k) / static_cast<double>(p);
+          m_rootCos.push_back(static_cast<T>(std::cos(angle)));
+          m_rootSin.push_back(static_cast<T>(std::sin(angle)));
+        }
+      }
+      length = m;
+      stride *= p;
+    }
+  }
+
+  template<typename T>
+  std::shared_ptr<const FftPlan<T>> FftPlan<T>::get(std::size_t n) {
+    return cachedPlan<FftPlan>(n);
+  }
+
+  template<typename T>
+  std::size_t FftPlan<T>::scratchSize() const {
+    if (m_inner) {
+      return 2 * m_inner->size() + m_inner->scratchSize();
+    }
+    return 2 * m_n;
+  }
+
+  template<typename T>
+  void FftPlan<T>::stockham(T *re, T *im, T *scratch) const {
+    const FftKernels<T> &k = fftKernels<T>();
+    T *xr = re, *xi = im, *yr = scratch, *yi = scratch + m_n;
+    for (const Pass &p : m_passes) {
+      const T *c = m_rootCos.data() + p.root, *s = m_rootSin.data() + p.root;
+      k.pass(p.radix, p.length, p.stride, m_twiddleRe.data() + p.twiddle, m_twiddleIm.data() + p.twiddle, c, s,
+        xr, xi, yr, yi);
+      std::swap(xr, yr);
+      std::swap(xi, yi);
+    }
+    if (xr != re) {
+      std::copy(xr, xr + m_n, re);
+      std::copy(xi, xi + m_n, im);
+    }
+  }
+
+  template<typename T>
+  void FftPlan<T>::bluestein(T *re, T *im, T *scratch) const {
+    const FftKernels<T> &k = fftKernels<T>();
+    std::size_t m = m_inner->size();
+    T *ar = scratch, *ai = scratch + m, *work = scratch + 2 * m;
+    k.multiply(m_n, re, im, m_chirpRe.data(), m_chirpIm.data(), ar, ai);
+    std::fill(ar + m_n, ar + m, T(0));
+    std::fill(ai + m_n, ai + m, T(0));
+    m_inner->transform(ar, ai, work);
+    k.multiply(m, ar, ai, m_filterRe.data(), m_filterIm.data(), ar, ai);
+    m_inner->transform(ar, ai, work, true);
+    k.multiply(m_n, ar, ai, m_chirpRe.data(), m_chirpIm.data(), re, im);
+  }
+
+  template<typename T>
+  void FftPlan<T>::transform(T *re, T *im, T *scratch, bool inverse) const {
+    // 逆変換は実部と虚部を入れ替えた列の順変換の実部と虚部を入れ替えたもの
+    if (inverse) {
+      std::swap(re, im);
+    }
+    if (m_inner) {
+      bluestein(re, im, scratch);
+    } else {
+      stockham(re, im, scratch);
+    }
+  }
+
+  template<typename T>
+  void FftPlan<T>::forward(const Complex *in, Complex *out) const {
+    std::vector<T> buf(2 * m_n + scratchSize());
+    T *re = buf.data(), *im = re + m_n;
+    for (std::size_t k = 0; k < m_n; k++) {
+      re[k] = in[k].real();
+      im[k] = in[k].imag();
+    }
+    transform(re, im, im + m_n);
+    for (std::size_t k = 0; k < m_n; k++) {
+      out[k] = Complex(re[k], im[k]);
+    }
+  }
+
+  template<typename T>
+  void FftPlan<T>::inverse(const Complex *in, Complex *out) const {
+    std::vector<T> buf(2 * m_n + scratchSize());
+    T *re = buf.data(), *im = re + m_n;
+    for (std::size_t k = 0; k < m_n; k++) {
+      re[k] = in[k].real();
+      im[k] = in[k].imag();
+    }
+    transform(re, im, im + m_n, true);
+    T s = T(1) / static_cast<T>(m_n);
+    for (std::size_t k = 0; k < m_n; k++) {
+      out[k] = Complex(re[k] * s, im[k] * s);
+    }
+  }
+
+  // RealFftPlan
+
+  template<typename T>
+  RealFftPlan<T>::RealFftPlan(std::size_t n) : m_n(n) {
+    assert(n > 0);
+    if (n % 2 == 1) {
+      m_plan = FftPlan<T>::get(n);
+      return;
+    }
+    m_plan = FftPlan<T>::get(n / 2);
+    m_twiddleRe.resize(n / 2 + 1);
+    m_twiddleIm.resize(n / 2 + 1);
+    for (std::size_t k = 0; k <= n / 2; k++) {
+      double angle = 2 * kPi * static_cast<double>(k) / static_cast<double>(n);
+      m_twiddleRe[k] = static_cast<T>(std::cos(angle));
+      m_twiddleIm[k] = static_cast<T>(-std::sin(angle));
+    }
+  }
+
+  template<typename T>
+  std::shared_ptr<const RealFftPlan<T>> RealFftPlan<T>::get(std::size_t n) {
+    return cachedPlan<RealFftPlan>(n);
+  }
+
+  template<typename T>
+  std::size_t RealFftPlan<T>::scratchSize() const {
+    return 2 * m_plan->size() + m_plan->scratchSize();
+  }
+
+  template<typename T>
+  void RealFftPlan<T>::forward(const T *in, Complex *out, T *scratch) const {
+    std::vector<T> buf;
+    if (scratch == nullptr) {
+      buf.resize(scratchSize());
+      scratch = buf.data();
+    }
+    std::size_t half = m_plan->size();
+    T *zr = scratch, *zi = scratch + half, *work = scratch + 2 * half;
+    if (m_n % 2 == 1) {
+      std::copy(in, in + m_n, zr);
+      std::fill(zi, zi + m_n, T(0));
+      m_plan->transform(zr, zi, work);
+      for (std::size_t k = 0; k <= m_n / 2; k++) {
+        out[k] = Complex(zr[k], zi[k]);
+      }
+      return;
+    }
+    // z[k] = x[2k] + i x[2k + 1] の DFT Z から，偶数番目の DFT E = (Z[k] + conj(Z[h - k])) / 2 と
+    // 奇数番目の DFT O = (Z[k] - conj(Z[h - k])) / 2i を取り出して X[k] = E + exp(-2πi k / n) O とする
+    for (std::size_t k = 0; k < half; k++) {
+      zr[k] = in[2 * k];
+      zi[k] = in[2 * k + 1];
+    }
+    m_plan->transform(zr, zi, work);
+    for (std::size_t k = 0; k <= half; k++) {
+      std::size_t a = (k == half) ? 0 : k, b = (k == 0) ? 0 : half - k;
+      T er = (zr[a] + zr[b]) / 2, ei = (zi[a] - zi[b]) / 2;
+      T orr = (zi[a] + zi[b]) / 2, oi = (zr[b] - zr[a]) / 2;
+      T wr = m_twiddleRe[k], wi = m_twiddleIm[k];
+      out[k] = Complex(er + wr * orr - wi * oi, ei + wr * oi + wi * orr);
+    }
+  }
+
+  template<typename T>
+  void RealFftPlan<T>::inverse(const Complex *in, T *out, T *scratch) const {
+    std::vector<T> buf;
+    if (scratch == nullptr) {
+      buf.resize(scratchSize());
+      scratch = buf.data();
+    }
+    std::size_t half = m_plan->size();
+    T *zr = scratch, *zi = scratch + half, *work = scratch + 2 * half;
+    if (m_n % 2 == 1) {
+      // 後半を共役で補って複素数の逆変換をする
+      for (std::size_t k = 0; k < m_n; k++) {
+        bool upper = k > m_n / 2;
+        const Complex &x = upper ? in[m_n - k] : in[k];
+        zr[k] = x.real();
+        zi[k] = upper ? -x.imag() : x.imag();
+      }
+      m_plan->transform(zr, zi, work, true);
+      T s = T(1) / static_cast<T>(m_n);
+      for (std::size_t k = 0; k < m_n; k++) {
+        out[k] = zr[k] * s;
+      }
+      return;
+    }
+    // forward の逆．E = (X[k] + conj(X[h - k])) / 2, O = (X[k] - conj(X[h - k])) / 2 * exp(2πi k / n) から
+    // Z[k] = E + i O を作って長さ n / 2 の逆変換をする
+    for (std::size_t k = 0; k < half; k++) {
+      const Complex &a = in[k], &b = in[half - k];
+      T er = (a.real() + b.real()) / 2, ei = (a.imag() - b.imag()) / 2;
+      T dr = (a.real() - b.real()) / 2, di = (a.imag() + b.imag()) / 2;
+      T wr = m_twiddleRe[k], wi = -m_twiddleIm[k];
+      T orr = dr * wr - di * wi, oi = dr * wi + di * wr;
+      zr[k] = er - oi;
+      zi[k] = ei + orr;
+    }
+    m_plan->transform(zr, zi, work, true);
+    T s = T(1) / static_cast<T>(half);
+    for (std::size_t k = 0; k < half; k++) {
+      out[2 * k] = zr[k] * s;
+      out[2 * k + 1] = zi[k] * s;
+    }
+  }
+
+  template class FftPlan<float>;
+  template class FftPlan<double>;
+  template class RealFftPlan<float>;
+  template class RealFftPlan<double>;
+
+  std::size_t fftLength(std::size_t n) {
+    n = std::max<std::size_t>(n, 2);
+    std::size_t best = 2;
+    while (best < n) {
+      best <<= 1;
+    }
+    for (std::size_t p5 = 1; p5 < best; p5 *= 5) {
+      for (std::size_t p35 = p5; p35 < best; p35 *= 3) {
+        std::size_t len = 2 * p35;
+        while (len < n) {
+          len <<= 1;
+        }
+        best = std::min(best, len);
+      }
+    }
+    return best;
+  }
+} // namespace mywheels
@@ -0,0 +1,460 @@
+#include "math/Kernels.hpp"
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include "math/Multiversion.hpp"
+
+namespace mywheels {
+  namespace kernels {
+    namespace {
+      template<typename T>
+      struct ExpTraits;
+
+      template<>
+      struct ExpTraits<float> {
+        using Bits = std::uint32_t;
+        static constexpr int kMantissa = 23;
+        static constexpr int kBias = 127;
+        // 加えて引くと整数へ丸められる値 (1.5 * 2^23)
+        static constexpr float kRound = 12582912.0f;
+        static constexpr float kLo = -104.0f;
+        static constexpr float kHi = 89.0f;
+        static constexpr float kLog2e = 1.44269504088896341f;
+        static constexpr float kLn2Hi = 0.693359375f;
+        static constexpr float kLn2Lo = -2.12194440e-4f;
+        static constexpr int kDegree = 7;
+      };
+
+      template<>
+      struct ExpTraits<double> {
+        using Bits = std::uint64_t;
+        static constexpr int kMantissa = 52;
+        static constexpr int kBias = 1023;
+        // 1.5 * 2^52
+        static constexpr double kRound = 6755399441055744.0;
+        static constexpr double kLo = -746.0;
+        static constexpr double kHi = 710.0;
+        static constexpr double kLog2e = 1.4426950408889634074;
+        static constexpr double kLn2Hi = 6.93147180369123816490e-01;
+        static constexpr double kLn2Lo = 1.90821492927058770002e-10;
+        static constexpr int kDegree = 13;
+      };
+
+      // 1 / d!
+      constexpr double inverseFactorial(int d) {
+        double f = 1.0;
+        for (int i = 2; i <= d; i++) {
+          f *= i;
+        }
+        return 1.0 / f;
+      }
+
+      // exp のテイラー多項式の係数 1 / d!．要素ごとに割り算をしないようにコンパイル時に求めておく
+      template<typename T>
+      struct ExpCoefficients {
+        T c[ExpTraits<T>::kDegree + 1];
+
+        constexpr ExpCoefficients() : c() {
+          for (int d = 0; d <= ExpTraits<T>::kDegree; d++) {
+            c[d] = T(inverseFactorial(d));
+          }
+        }
+      };
+
+      template<typename T>
+      constexpr ExpCoefficients<T> kExpCoefficients{};
+
+      template<typename T, bool Fma>
+      inline T madd(T a, T b, T c) {
+        if constexpr (Fma) {
+          return std::fma(a, b, c);
+        } else {
+          return a * b + c;
+        }
+      }
+
+      // 2^k．k は指数部に収まる範囲
+      template<typename T>
+      inline T pow2(std::int32_t k) {
+        using Traits = ExpTraits<T>;
+        typename Traits::Bits bits = static_cast<typename Traits::Bits>(k + Traits::kBias) << Traits::kMantissa;
+        T ret;
+        std::memcpy(&ret, &bits, sizeof(ret));
+        return ret;
+      }
+
+      // 分岐のない exp．x = k ln2 + r と分解し，exp(r) をテイラー多項式で求めて 2^k 倍する
+      template<typename T, bool Fma>
+      inline T expKernel(T x) {
+        using Traits = ExpTraits<T>;
+        bool nan = x != x;
+        T xc = nan ? T(0) : std::min(std::max(x, Traits::kLo), Traits::kHi);
+        T kf = (xc * Traits::kLog2e + Traits::kRound) - Traits::kRound;
+        T r = madd<T, Fma>(-kf, Traits::kLn2Hi, xc);
+        r = madd<T, Fma>(-kf, Traits::kLn2Lo, r);
+        const T *c = kExpCoefficients<T>.c;
+        T p = c[Traits::kDegree];
+        for (int d = Traits::kDegree - 1; d >= 0; d--) {
+          p = madd<T, Fma>(p, r, c[d]);
+        }
+        // 2^k が非正規化数やオーバーフロー付近でも表せるように二回に分けて掛ける
+        std::int32_t k = static_cast<std::int32_t>(kf);
+        std::int32_t k1 = k / 2;
+        T ret = p * pow2<T>(k1) * pow2<T>(k - k1);
+        return nan ? x : ret;
+      }
+
+      template<typename T, bool Fma>
+      struct Kernel {
+        // a の (i, p) 要素が a[i * rsa + p * csa] にある一般の gemm
+        static void gemmStrided(std::size_t m, std::size_t n, std::size_t k, const T *a, std::size_t rsa,
+          std::size_t csa, const T *b, std::size_t ldb, T *c, std::size_t ldc) {
+          // k 方向と n 方向をキャッシュに収まる大きさに区切り，4 行ずつ b の行を使い回す
+          constexpr std::size_t kc = 256;
+          constexpr std::size_t nc = 8192 / sizeof(T);
+          for (std::size_t p0 = 0; p0 < k; p0 += kc) {
+            std::size_t p1 = std::min(k, p0 + kc);
+            for (std::size_t j0 = 0; j0 < n; j0 += nc) {
+              std::size_t len = std::min(n, j0 + nc) - j0;
+              std::size_t i = 0;
+              for (; i + 4 <= m; i += 4) {
+                T *MYWHEELS_RESTRICT c0 = c + (i + 0) * ldc + j0;
+                T *MYWHEELS_RESTRICT c1 = c + (i + 1) * ldc + j0;
+                T *MYWHEELS_RESTRICT c2 = c + (i + 2) * ldc + j0;
+                T *MYWHEELS_RESTRICT c3 = c + (i + 3) * ldc + j0;
+                for (std::size_t p = p0; p < p1; p++) {
+                  const T *MYWHEELS_RESTRICT bp = b + p * ldb + j0;
+                  T a0 = a[(i + 0) * rsa + p * csa];
+                  T a1 = a[(i + 1) * rsa + p * csa];
+                  T a2 = a[(i + 2) * rsa + p * csa];
+                  T a3 = a[(i + 3) * rsa + p * csa];
+                  for (std::size_t j = 0; j < len; j++) {
+                    T bj = bp[j];
+                    c0[j] = madd<T, Fma>(a0, bj, c0[j]);
+                    c1[j] = madd<T, Fma>(a1, bj, c1[j]);
+                    c2[j] = madd<T, Fma>(a2, bj, c2[j]);
+                    c3[j] = madd<T, Fma>(a3, bj, c3[j]);
+                  }
+                }
+              }
+              for (; i < m; i++) {
+                T *MYWHEELS_RESTRICT ci = c + i * ldc + j0;
+                for (std::size_t p = p0; p < p1; p++) {
+                  const T *MYWHEELS_RESTRICT bp = b + p * ldb + j0;
+                  T aip = a[i * rsa + p * csa];
+                  for (std::size_t j = 0; j < len; j++) {
+                    ci[j] = madd<T, Fma>(aip, bp[j], ci[j]);
+                  }
+                }
+              }
+            }
+          }
+        }
+
+        static void gemm(std::size_t m, std::size_t n, std::size_t k, const T *a, std::size_t lda, const T *b,
+          std::size_t ldb, T *c, std::size_t ldc) {
+          gemmStrided(m, n, k, a, lda, 1, b, ldb, c, ldc);
+        }
+
+        static void gemmTN(std::size_t m, std::size_t n, std::size_t k, const T *a, std::size_t lda, const T *b,
+          std::size_t ldb, T *c, std::size_t ldc) {
+          gemmStrided(m, n, k, a, 1, lda, b, ldb, c, ldc);
+        }
+
+        static void gemmNT(std::size_t m, std::size_t n, std::size_t k, const T *a, std::size_t lda, const T *b,
+          std::size_t ldb, T *c, std::size_t ldc) {
+          // a の行と b の行の内積．b の行をキャッシュに収まる本数ずつ使い回す
+          constexpr std::size_t nb = 32768 / sizeof(T);
+          std::size_t jb = std::max<std::size_t>(1, nb / std::max<std::size_t>(1, k));
+          for (std::size_t j0 = 0; j0 < n; j0 += jb) {
+            std::size_t j1 = std::min(n, j0 + jb);
+            for (std::size_t i = 0; i < m; i++) {
+              const T *MYWHEELS_RESTRICT ai = a + i * lda;
+              for (std::size_t j = j0; j < j1; j++) {
+                const T *MYWHEELS_RESTRICT bj = b + j * ldb;
+                T acc[reduction::kLanes] = {};
+                std::size_t p = 0;
+                for (; p + reduction::kLanes <= k; p += reduction::kLanes) {
+                  for (std::size_t l = 0; l < reduction::kLanes; l++) {
+                    acc[l] = madd<T, Fma>(ai[p + l], bj[p + l], acc[l]);
+                  }
+                }
+                T s = reduction::detail::combineLanes(acc);
+                for (; p < k; p++) {
+                  s = madd<T, Fma>(ai[p], bj[p], s);
+                }
+                c[i * ldc + j] += s;
+              }
+            }
+          }
+        }
+
+        static T sum(std::size_t n, const T *x, Summation method) {
+          return reduction::detail::serialSum<T>(0, n, [x](std::size_t i) {
+            return x[i];
+          }, method);
+        }
+
+        static T dot(std::size_t n, const T *x, const T *y, Summation method) {
+          return reduction::detail::serialSum<T>(0, n, [x, y](std::size_t i) {
+            return x[i] * y[i];
+          }, method);
+        }
+
+        static void add(std::size_t n, const T *x, const T *y, T *out) {
+          for (std::size_t i = 0; i < n; i++) {
+            out[i] = x[i] + y[i];
+          }
+        }
+
+        static void sub(std::size_t n, const T *x, const T *y, T *out) {
+          for (std::size_t i = 0; i < n; i++) {
+            out[i] = x[i] - y[i];
+          }
+        }
+
+        static void mul(std::size_t n, const T *x, const T *y, T *out) {
+          for (std::size_t i = 0; i < n; i++) {
+            out[i] = x[i] * y[i];
+          }
+        }
+
+        static void scale(std::size_t n, const T *x, T s, T *out) {
+          for (std::size_t i = 0; i < n; i++) {
+            out[i] = x[i] * s;
+          }
+        }
+
+        static void div(std::size_t n, const T *x, T s, T *out) {
+          for (std::size_t i = 0; i < n; i++) {
+            out[i] = x[i] / s;
+          }
+        }
+
+        static void fma(std::size_t n, const T *x, const T *y, const T *z, T *out) {
+          for (std::size_t i = 0; i < n; i++) {
+            out[i] = madd<T, Fma>(x[i], y[i], z[i]);
+          }
+        }
+
+        static void fms(std::size_t n, const T *x, const T *y, const T *z, T *out) {
+          for (std::size_t i = 0; i < n; i++) {
+            out[i] = madd<T, Fma>(x[i], y[i], -z[i]);
+          }
+        }
+
+        static void axpy(std::size_t n, T a, const T *x, const T *y, T *out) {
+          for (std::size_t i = 0; i < n; i++) {
+            out[i] = madd<T, Fma>(a, x[i], y[i]);
+          }
+        }
+
+        static void quot(std::size_t n, const T *x, const T *y, T *out) {
+          for (std::size_t i = 0; i < n; i++) {
+            out[i] = x[i] / y[i];
+          }
+        }
+
+        static void sqrt(std::size_t n, const T *x, T *out) {
+          for (std::size_t i = 0; i < n; i++) {
+            out[i] = std::sqrt(x[i]);
+          }
+        }
+
+        static void exp(std::size_t n, const T *x, T *out) {
+          for (std::size_t i = 0; i < n; i++) {
+            out[i] = expKernel<T, Fma>(x[i]);
+          }
+        }
+
+        static void sigmoid(std::size_t n, const T *x, T *out) {
+          for (std::size_t i = 0; i < n; i++) {
+            out[i] = T(1) / (T(1) + expKernel<T, Fma>(-x[i]));
+          }
+        }
+
+        static void lamp(std::size_t n, const T *x, T *out) {
+          for (std::size_t i = 0; i < n; i++) {
+            out[i] = (x[i] > T(0)) ? x[i] : T(0);
+          }
+        }
+
+        static T max(std::size_t n, const T *x) {
+          T acc[reduction::kLanes];
+          std::fill(std::begin(acc), std::end(acc), x[0]);
+          std::size_t i = 0;
+          for (; i + reduction::kLanes <= n; i += reduction::kLanes) {
+            for (std::size_t l = 0; l < reduction::kLanes; l++) {
+              acc[l] = (acc[l] < x[i + l]) ? x[i + l] : acc[l];
+            }
+          }
+          T ret = *std::max_element(std::begin(acc), std::end(acc));
+          for (; i < n; i++) {
+            ret = (ret < x[i]) ? x[i] : ret;
+          }
+          return ret;
+        }
+
+        static T expSum(std::size_t n, const T *x, T shift, T *out) {
+          // 書き込みの有無でループを分け，どちらもベクトル化させる
+          T acc[reduction::kLanes] = {};
+          std::size_t i = 0;
+          if (out != nullptr) {
+            for (; i + reduction::kLanes <= n; i += reduction::kLanes) {
+              for (std::size_t l = 0; l < reduction::kLanes; l++) {
+                T e = expKernel<T, Fma>(x[i + l] - shift);
+                out[i + l] = e;
+                acc[l] += e;
+              }
+            }
+          } else {
+            for (; i + reduction::kLanes <= n; i += reduction::kLanes) {
+              for (std::size_t l = 0; l < reduction::kLanes; l++) {
+                acc[l] += expKernel<T, Fma>(x[i + l] - shift);
+              }
+            }
+          }
+          T ret = reduction::detail::combineLanes(acc);
+          for (; i < n; i++) {
+            T e = expKernel<T, Fma>(x[i] - shift);
+            if (out != nullptr) {
+              out[i] = e;
+            }
+            ret += e;
+          }
+          return ret;
+        }
+      };
+    } // namespace
+
+// 命令セット ISA 向けに Kernel<T, kFma> を TARGET でコンパイルした関数表 NS::table<T> を定義する．FMA は AVX2 から
+#define MYWHEELS_DEFINE_KERNELS(NS, ISA, TARGET)                                                                   \
+  namespace NS {                                                                                                     \
+    namespace {                                                                                                      \
+      constexpr bool kFma = (ISA >= Isa::AVX2);                                                                      \
+      template<typename T>                                                                                           \
+      TARGET void gemm(std::size_t m, std::size_t n, std::size_t k, const T *a, std::size_t lda, const T *b,         \
+        std::size_t ldb, T *c, std::size_t ldc) {                                                                    \
+        Kernel<T, kFma>::gemm(m, n, k, a, lda, b, ldb, c, ldc);                                                      \
+      }                                                                                                              \
+      template<typename T>                                                                                           \
+      TARGET void gemmTN(std::size_t m, std::size_t n, std::size_t k, const T *a, std::size_t lda, const T *b,       \
+        std::size_t ldb, T *c, std::size_t ldc) {                                                                    \
+        Kernel<T, kFma>::gemmTN(m, n, k, a, lda, b, ldb, c, ldc);                                                    \
+      }                                                                                                              \
+      template<typename T>                                                                                           \
+      TARGET void gemmNT(std::size_t m, std::size_t n, std::size_t k, const T *a, std::size_t lda, const T *b,       \
+        std::size_t ldb, T *c, std::size_t ldc) {                                                                    \
+        Kernel<T, kFma>::gemmNT(m, n, k, a, lda, b, ldb, c, ldc);                                                    \
+      }                                                                                                              \
+      template<typename T>                                                                                           \
+      TARGET T sum(std::size_t n, const T *x, Summation method) {                                                    \
+        return Kernel<T, kFma>::sum(n, x, method);                                                                   \
+      }                                                                                                              \
+      template<typename T>                                                                                           \
+      TARGET T dot(std::size_t n, const T *x, const T *y, Summation method) {                                        \
+        return Kernel<T, kFma>::dot(n, x, y, method);                                                                \
+      }                                                                                                              \
+      template<typename T>                                                                                           \
+      TARGET void add(std::size_t n, const T *x, const T *y, T *out) {                                               \
+        Kernel<T, kFma>::add(n, x, y, out);                                                                          \
+      }                                                                                                              \
+      template<typename T>                                                                                           \
+      TARGET void sub(std::size_t n, const T *x, const T *y, T *out) {                                               \
+        Kernel<T, kFma>::sub(n, x, y, out);                                                                          \
+      }                                                                                                              \
+      template<typename T>                                                                                           \
+      TARGET void mul(std::size_t n, const T *x, const T *y, T *out) {                                               \
+        Kernel<T, kFma>::mul(n, x, y, out);                                                                          \
+      }                                                                                                              \
+      template<typename T>                                                                                           \
+      TARGET void scale(std::size_t n, const T *x, T s, T *out) {                                                    \
+        Kernel<T, kFma>::scale(n, x, s, out);                                                                        \
+      }                                                                                                              \
+      template<typename T>                                                                                           \
+      TARGET void div(std::size_t n, const T *x, T s, T *out) {                                                      \
+        Kernel<T, kFma>::div(n, x, s, out);                                                                          \
+      }                                                                                                              \
+      template<typename T>                                                                                           \
+      TARGET void fma(std::size_t n, const T *x, const T *y, const T *z, T *out) {                                   \
+        Kernel<T, kFma>::fma(n, x, y, z, out);                                                                       \
+      }                                                                                                              \
+      template<typename T>                                                                                           \
+      TARGET void fms(std::size_t n, const T *x, const T *y, const T *z, T *out) {                                   \
+        Kernel<T, kFma>::fms(n, x, y, z, out);                                                                       \
+      }                                                                                                              \
+      template<typename T>                                                                                           \
+      TARGET void axpy(std::size_t n, T a, const T *x, const T *y, T *out) {                                         \
+        Kernel<T, kFma>::axpy(n, a, x, y, out);                                                                      \
+      }                                                                                                              \
+      template<typename T>                                                                                           \
+      TARGET void quot(std::size_t n, const T *x, const T *y, T *out) {                                              \
+        Kernel<T, kFma>::quot(n, x, y, out);                                                                         \
+      }                                                                                                              \
+      template<typename T>                                                                                           \
+      TARGET void sqrt(std::size_t n, const T *x, T *out) {                                                          \
+        Kernel<T, kFma>::sqrt(n, x, out);                                                                            \
+      }                                                                                                              \
+      template<typename T>                                                                                           \
+      TARGET void exp(std::size_t n, const T *x, T *out) {                                                           \
+        Kernel<T, kFma>::exp(n, x, out);                                                                             \
+      }                                                                                                              \
+      template<typename T>                                                                                           \
+      TARGET void sigmoid(std::size_t n, const T *x, T *out) {                                                       \
+        Kernel<T, kFma>::sigmoid(n, x, out);                                                                         \
+      }                                                                                                              \
+      template<typename T>                                                                                           \
+      TARGET void lamp(std::size_t n, const T *x, T *out) {                                                          \
+        Kernel<T, kFma>::lamp(n, x, out);                                                                            \
+      }                                                                                                              \
+      template<typename T>                                                                                           \
+      TARGET T max(std::size_t n, const T *x) {                                                                      \
+        return Kernel<T, kFma>::max(n, x);                                                                           \
+      }                                                                                                              \
+      template<typename T>                                                                                           \
+      TARGET T expSum(std::size_t n, const T *x, T shift, T *out) {                                                  \
+        return Kernel<T, kFma>::expSum(n, x, shift, out);                                                            \
+      }                                                                                                              \
+      template<typename T>                                                                                           \
+      const Table<T> table = {ISA, gemm<T>, gemmTN<T>, gemmNT<T>, sum<T>, dot<T>, add<T>, sub<T>, mul<T>, scale<T>,  \
+        div<T>, fma<T>, fms<T>, axpy<T>, quot<T>, sqrt<T>, exp<T>, sigmoid<T>, lamp<T>, max<T>, expSum<T>};          \
+    }                                                                                                                \
+  }
+
+    MYWHEELS_DEFINE_FOR_EACH_ISA(MYWHEELS_DEFINE_KERNELS)
+
+#undef MYWHEELS_DEFINE_KERNELS
+
+    namespace {
+      template<typename T>
+      const Table<T> *select(Isa isa) {
+        return &selectIsa(isa, generic::table<T>, sse42::table<T>, avx2::table<T>, avx512::table<T>);
+      }
+
+      template<typename T>
+      std::atomic<const Table<T> *> &current() {
+        static std::atomic<const Table<T> *> ptr{select<T>(activeIsa())};
+        return ptr;
+      }
+    } // namespace
+
+    template<>
+    const Table<float> &table<float>() {
+      return *current<float>().load(std::memory_order_acquire);
+    }
+
+    template<>
+    const Table<double> &table<double>() {
+      return *current<double>().load(std::memory_order_acquire);
+    }
+
+    Isa useIsa(Isa isa) {
+      isa = std::min(isa, detectedIsa());
+      current<float>().store(select<float>(isa), std::memory_order_release);
+      current<double>().store(select<double>(isa), std::memory_order_release);
+      return isa;
+    }
+  } // namespace kernels
+} // namespace mywheels
@@ -0,0 +1,160 @@
+#include "math/Modular.hpp"
+#include <algorithm>
+#include "math/Multiversion.hpp"
+
+namespace mywheels {
+  namespace kernels {
+    namespace {
+      // 一度に計算する c の行数と列数．4 行分の 64 ビットの和 (8 KB) を L1 に置く
+      constexpr std::size_t kModRows = 4;
+      constexpr std::size_t kModCols = 256;
+
+      // 上位 32 ビットを 2^32 mod m 倍して下位 32 ビットに足す
+      inline void fold(std::size_t n, std::uint64_t *acc, std::uint64_t f) {
+        for (std::size_t j = 0; j < n; j++) {
+          acc[j] = (acc[j] >> 32) * f + (acc[j] & 0xffffffffu);
+        }
+      }
+
+      inline void modGemmImpl(std::size_t m, std::size_t n, std::size_t k, const std::uint32_t *a, std::size_t lda,
+        const std::uint32_t *b, std::size_t ldb, std::uint32_t *c, std::size_t ldc, const Modulus &mod) {
+        alignas(64) std::uint64_t acc[kModRows][kModCols];
+        std::size_t lazy = std::max<std::size_t>(1, std::min(mod.lazyTerms(), k));
+        for (std::size_t i0 = 0; i0 < m; i0 += kModRows) {
+          std::size_t h = std::min(kModRows, m - i0);
+          for (std::size_t j0 = 0; j0 < n; j0 += kModCols) {
+            std::size_t w = std::min(kModCols, n - j0);
+            for (std::size_t r = 0; r < kModRows; r++) {
+              std::fill(acc[r], acc[r] + w, std::uint64_t(0));
+            }
+            for (std::size_t p0 = 0; p0 < k; p0 += lazy) {
+              std::size_t p1 = std::min(k, p0 + lazy);
+              for (std::size_t p = p0; p < p1; p++) {
+                // 行数が足りない分は 0 を掛けて捨てる
+                std::uint32_t a0 = a[i0 * lda + p];
+                std::uint32_t a1 = (h > 1) ? a[(i0 + 1) * lda + p] : 0;
+                std::uint32_t a2 = (h > 2) ? a[(i0 + 2) * lda + p] : 0;
+                std::uint32_t a3 = (h > 3) ? a[(i0 + 3) * lda + p] : 0;
+                const std::uint32_t *MYWHEELS_RESTRICT bp = b + p * ldb + j0;
+                std::uint64_t *MYWHEELS_RESTRICT c0 = acc[0];
+                std::uint64_t *MYWHEELS_RESTRICT c1 = acc[1];
+                std::uint64_t *MYWHEELS_RESTRICT c2 = acc[2];
+                std::uint64_t *MYWHEELS_RESTRICT c3 = acc[3];
+                for (std::size_t j = 0; j < w; j++) {
+                  std::uint64_t bj = bp[j];
+                  c0[j] += std::uint64_t(a0) * bj;
+                  c1[j] += std::uint64_t(a1) * bj;
+                  c2[j] += std::uint64_t(a2) * bj;
+                  c3[j] += std::uint64_t(a3) * bj;
+                }
+              }
+              // 最後の reduce は 64 ビットのどんな値でも扱えるので，最後の区間の後は畳み込まない
+              if (p1 < k) {
+                for (std::size_t r = 0; r < h; r++) {
+                  fold(w, acc[r], mod.fold());
+                }
+              }
+            }
+            for (std::size_t r = 0; r < h; r++) {
+              for (std::size_t j = 0; j < w; j++) {
+                c[(i0 + r) * ldc + j0 + j] = mod.reduce(acc[r][j]);
+              }
+            }
+          }
+        }
+      }
+
+      // x, y < m <= 2^31 なので和はあふれない．s - m は s < m なら大きな値に回り込むので min で選べる
+      inline void modAddImpl(std::size_t n, const std::uint32_t *x, const std::uint32_t *y, std::uint32_t *out,
+        std::uint32_t m) {
+        for (std::size_t i = 0; i < n; i++) {
+          std::uint32_t s = x[i] + y[i];
+          out[i] = std::min(s, s - m);
+        }
+      }
+
+      inline void modSubImpl(std::size_t n, const std::uint32_t *x, const std::uint32_t *y, std::uint32_t *out,
+        std::uint32_t m) {
+        for (std::size_t i = 0; i < n; i++) {
+          std::uint32_t d = x[i] - y[i];
+          out[i] = std::min(d, d + m);
+        }
+      }
+
+      // q = floor(x s' / 2^32) (s' = floor(s 2^32 / m)) は x s / m の商より高々 1 小さいので，x s - q m は [0, 2m)
+      inline void modScaleImpl(std::size_t n, const std::uint32_t *x, std::uint32_t s, std::uint32_t shoup,
+        std::uint32_t *out, std::uint32_t m) {
+        for (std::size_t i = 0; i < n; i++) {
+          std::uint32_t q = static_cast<std::uint32_t>((std::uint64_t(x[i]) * shoup) >> 32);
+          std::uint32_t r = x[i] * s - q * m;
+          out[i] = std::min(r, r - m);
+        }
+      }
+
+      struct ModTable {
+        void (*gemm)(std::size_t m, std::size_t n, std::size_t k, const std::uint32_t *a, std::size_t lda,
+          const std::uint32_t *b, std::size_t ldb, std::uint32_t *c, std::size_t ldc, const Modulus &mod);
+        void (*add)(std::size_t n, const std::uint32_t *x, const std::uint32_t *y, std::uint32_t *out,
+          std::uint32_t m);
+        void (*sub)(std::size_t n, const std::uint32_t *x, const std::uint32_t *y, std::uint32_t *out,
+          std::uint32_t m);
+        void (*scale)(std::size_t n, const std::uint32_t *x, std::uint32_t s, std::uint32_t shoup, std::uint32_t *out,
+          std::uint32_t m);
+      };
+    } // namespace
+
+// 命令セット向けにコンパイルした剰余演算のカーネルを NS::modTable として定義する
+#define MYWHEELS_DEFINE_MOD_KERNELS(NS, ISA, TARGET)                                                               \
+  namespace NS {                                                                                                     \
+    namespace {                                                                                                      \
+      TARGET void gemm(std::size_t m, std::size_t n, std::size_t k, const std::uint32_t *a, std::size_t lda,         \
+        const std::uint32_t *b, std::size_t ldb, std::uint32_t *c, std::size_t ldc, const Modulus &mod) {            \
+        modGemmImpl(m, n, k, a, lda, b, ldb, c, ldc, mod);                                                           \
+      }                                                                                                              \
+      TARGET void add(std::size_t n, const std::uint32_t *x, const std::uint32_t *y, std::uint32_t *out,             \
+        std::uint32_t m) {                                                                                           \
+        modAddImpl(n, x, y, out, m);                                                                                 \
+      }                                                                                                              \
+      TARGET void sub(std::size_t n, const std::uint32_t *x, const std::uint32_t *y, std::uint32_t *out,             \
+        std::uint32_t m) {                                                                                           \
+        modSubImpl(n, x, y, out, m);                                                                                 \
+      }                                                                                                              \
+      TARGET void scale(std::size_t n, const std::uint32_t *x, std::uint32_t s, std::uint32_t shoup,                 \
+        std::uint32_t *out, std::uint32_t m) {                                                                       \
+        modScaleImpl(n, x, s, shoup, out, m);                                                                        \
+      }                                                                                                              \
+      const ModTable modTable = {gemm, add, sub, scale};                                                             \
+    }                                                                                                                \
+  }
+
+    MYWHEELS_DEFINE_FOR_EACH_ISA(MYWHEELS_DEFINE_MOD_KERNELS)
+
+#undef MYWHEELS_DEFINE_MOD_KERNELS
+
+    namespace {
+      // 浮動小数点数のカーネルと同じ命令セットのもの (useIsa に従う)
+      const ModTable &modTable() {
+        return selectIsa(table<float>().isa, generic::modTable, sse42::modTable, avx2::modTable, avx512::modTable);
+      }
+    } // namespace
+
+    void modGemm(std::size_t m, std::size_t n, std::size_t k, const std::uint32_t *a, std::size_t lda,
+      const std::uint32_t *b, std::size_t ldb, std::uint32_t *c, std::size_t ldc, const Modulus &mod) {
+      modTable().gemm(m, n, k, a, lda, b, ldb, c, ldc, mod);
+    }
+
+    void modAdd(std::size_t n, const std::uint32_t *x, const std::uint32_t *y, std::uint32_t *out, const Modulus &mod) {
+      modTable().add(n, x, y, out, mod.value());
+    }
+
+    void modSub(std::size_t n, const std::uint32_t *x, const std::uint32_t *y, std::uint32_t *out, const Modulus &mod) {
+      modTable().sub(n, x, y, out, mod.value());
+    }
+
+    void modScale(std::size_t n, const std::uint32_t *x, std::uint32_t s, std::uint32_t *out, const Modulus &mod) {
+      assert(s < mod.value());
+      std::uint32_t shoup = static_cast<std::uint32_t>((std::uint64_t(s) << 32) / mod.value());
+      modTable().scale(n, x, s, shoup, out, mod.value());
+    }
+  } // namespace kernels
+} // namespace mywheels
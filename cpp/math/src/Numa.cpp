@@ -0,0 +1,358 @@
+#include "math/Numa.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#if defined(__linux__)
+#  define MYWHEELS_LINUX 1
+#  include <dirent.h>
+#  include <sched.h>
+#  include <unistd.h>
+#  include <sys/syscall.h>
+#endif
+
+namespace mywheels {
+  namespace numa {
+    namespace {
+      // <linux/mempolicy.h> の値．libnuma には依存せず mbind を直接呼ぶ
+      constexpr int kMpolDefault = 0;
+      constexpr int kMpolBind = 2;
+      constexpr int kMpolInterleave = 3;
+      constexpr unsigned kMpolMfMove = 1u << 1;
+      // mbind に渡すノードのビットマスクの大きさ
+      constexpr std::size_t kMaxNodes = 1024;
+
+      struct Topology {
+        // cpus[node] はノード node の CPU
+        std::vector<std::vector<int>> cpus;
+        // node[cpu] は CPU cpu のノード
+        std::vector<std::size_t> node;
+      };
+
+      // "0-3,8-11" の形式の CPU の一覧
+      std::vector<int> parseCpuList(const std::string &list) {
+        std::vector<int> ret;
+        std::size_t pos = 0;
+        while (pos < list.size()) {
+          std::size_t end = list.find(',', pos);
+          if (end == std::string::npos) {
+            end = list.size();
+          }
+          std::string range = list.substr(pos, end - pos);
+          std::size_t dash = range.find('-');
+          if (!range.empty() && range[0] != '\n') {
+            int first = std::atoi(range.c_str());
+            int last = (dash == std::string::npos) ? first : std::atoi(range.c_str() + dash + 1);
+            for (int cpu = first; cpu <= last; cpu++) {
+              ret.push_back(cpu);
+            }
+          }
+          pos = end + 1;
+        }
+        return ret;
+      }
+
+      bool allowedCpu(int cpu) {
+#ifdef MYWHEELS_LINUX
+        static const cpu_set_t allowed = []() {
+          cpu_set_t set;
+          CPU_ZERO(&set);
+          if (sched_getaffinity(0, sizeof(set), &set) != 0) {
+            for (int i = 0; i < CPU_SETSIZE; i++) {
+              CPU_SET(i, &set);
+            }
+          }
+          return set;
+        }();
+        return cpu >= 0 && cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed);
+#else
+        (void)cpu;
+        return true;
+#endif
+      }
+
+      Topology detect() {
+        Topology t;
+#ifdef MYWHEELS_LINUX
+        // /sys/devices/system/node/node<N>/cpulist を読む．番号が飛ぶこともあるので一覧を取る
+        std::vector<std::size_t> ids;
+        if (DIR *dir = opendir("/sys/devices/system/node")) {
+          while (dirent *e = readdir(dir)) {
+            if (std::strncmp(e->d_name, "node", 4) == 0 && e->d_name[4] >= '0' && e->d_name[4] <= '9') {
+              ids.push_back(static_cast<std::size_t>(std::atoi(e->d_name + 4)));
+            }
+          }
+          closedir(dir);
+        }
+        std::sort(ids.begin(), ids.end());
+        if (!ids.empty() && ids.back() < kMaxNodes) {
+          t.cpus.resize(ids.back() + 1);
+          for (std::size_t id : ids) {
+            std::ifstream file("/sys/devices/system/node/node" + std::to_string(id) + "/cpulist");
+            std::string list;
+            std::getline(file, list);
+            for (int cpu : parseCpuList(list)) {
+              if (allowedCpu(cpu)) {
+                t.cpus[id].push_back(cpu);
+              }
+            }
+          }
+        }
+#endif
+        bool any = std::any_of(t.cpus.begin(), t.cpus.end(), [](const std::vector<int> &c) {
+          return !c.empty();
+        });
+        if (!any) {
+          t.cpus.assign(1, {});
+          int n = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+          for (int cpu = 0; cpu < n; cpu++) {
+            if (allowedCpu(cpu)) {
+              t.cpus[0].push_back(cpu);
+            }
+          }
+        }
+        for (std::size_t node = 0; node < t.cpus.size(); node++) {
+          for (int cpu : t.cpus[node]) {
+            if (static_cast<std::size_t>(cpu) >= t.node.size()) {
+              t.node.resize(cpu + 1, 0);
+            }
+            t.node[cpu] = node;
+          }
+        }
+        return t;
+      }
+
+      const Topology &topology() {
+        static const Topology t = detect();
+        return t;
+      }
+
+      // affinity の順に並べた CPU
+      std::vector<int> cpuOrder(Affinity affinity) {
+        const Topology &t = topology();
+        std::vector<int> ret;
+        if (affinity == Affinity::Compact) {
+          for (const auto &cpus : t.cpus) {
+            ret.insert(ret.end(), cpus.begin(), cpus.end());
+          }
+        } else if (affinity == Affinity::Spread) {
+          for (std::size_t k = 0;; k++) {
+            bool added = false;
+            for (const auto &cpus : t.cpus) {
+              if (k < cpus.size()) {
+                ret.push_back(cpus[k]);
+                added = true;
+              }
+            }
+            if (!added) {
+              break;
+            }
+          }
+        }
+        return ret;
+      }
+
+      bool parsePlacement(const char *name, Placement &policy, std::size_t &node) {
+        if (std::strcmp(name, "first-touch") == 0 || std::strcmp(name, "default") == 0) {
+          policy = Placement::FirstTouch;
+          return true;
+        }
+        if (std::strcmp(name, "interleave") == 0) {
+          policy = Placement::Interleave;
+          return true;
+        }
+        if (std::strncmp(name, "bind:", 5) == 0 && name[5] >= '0' && name[5] <= '9') {
+          policy = Placement::Bind;
+          node = static_cast<std::size_t>(std::atoi(name + 5));
+          return node < nodeCount();
+        }
+        return false;
+      }
+
+      struct PlacementState {
+        std::atomic<Placement> policy{Placement::FirstTouch};
+        std::atomic<std::size_t> node{0};
+
+        PlacementState() {
+          const char *env = std::getenv("MYWHEELS_NUMA");
+          if (env == nullptr || *env == '\0') {
+            return;
+          }
+          Placement p;
+          std::size_t n = 0;
+          if (!parsePlacement(env, p, n)) {
+            std::cerr << "mywheels: unknown MYWHEELS_NUMA=" << env << ", using first-touch\n";
+            return;
+          }
+          policy.store(p, std::memory_order_relaxed);
+          node.store(n, std::memory_order_relaxed);
+        }
+      };
+
+      PlacementState &placementState() {
+        static PlacementState state;
+        return state;
+      }
+
+      // 既定でない方針を適用したことがあるか．なければ reset は何もしない
+      std::atomic<bool> &placedAny() {
+        static std::atomic<bool> placed{false};
+        return placed;
+      }
+
+#ifdef MYWHEELS_LINUX
+      // [p, p + bytes) に完全に含まれるページの範囲 [first, last)．前後のページを共有する他の確保には触れない
+      bool pageRange(void *p, std::size_t bytes, std::uintptr_t &first, std::uintptr_t &last) {
+        std::uintptr_t page = static_cast<std::uintptr_t>(sysconf(_SC_PAGESIZE));
+        first = (reinterpret_cast<std::uintptr_t>(p) + page - 1) / page * page;
+        last = (reinterpret_cast<std::uintptr_t>(p) + bytes) / page * page;
+        return first < last;
+      }
+#endif
+    } // namespace
+
+    std::size_t nodeCount() {
+      return topology().cpus.size();
+    }
+
+    const std::vector<int> &nodeCpus(std::size_t node) {
+      return topology().cpus.at(node);
+    }
+
+    std::size_t currentNode() {
+#ifdef MYWHEELS_LINUX
+      int cpu = sched_getcpu();
+      const Topology &t = topology();
+      if (cpu >= 0 && static_cast<std::size_t>(cpu) < t.node.size()) {
+        return t.node[cpu];
+      }
+#endif
+      return 0;
+    }
+
+    Placement placement() {
+      return placementState().policy.load(std::memory_order_relaxed);
+    }
+
+    std::size_t placementNode() {
+      return placementState().node.load(std::memory_order_relaxed);
+    }
+
+    void setPlacement(Placement policy, std::size_t node) {
+      placementState().node.store(std::min(node, nodeCount() - 1), std::memory_order_relaxed);
+      placementState().policy.store(policy, std::memory_order_relaxed);
+    }
+
+    bool place(void *p, std::size_t bytes, Placement policy, std::size_t node) {
+#ifdef MYWHEELS_LINUX
+      std::uintptr_t first, last;
+      if (!pageRange(p, bytes, first, last)) {
+        return false;
+      }
+      unsigned long mask[kMaxNodes / (8 * sizeof(unsigned long))] = {};
+      constexpr std::size_t bits = 8 * sizeof(unsigned long);
+      int mode = kMpolDefault;
+      if (policy == Placement::Interleave) {
+        mode = kMpolInterleave;
+        for (std::size_t n = 0; n < nodeCount(); n++) {
+          if (!nodeCpus(n).empty()) {
+            mask[n / bits] |= 1ul << (n % bits);
+          }
+        }
+      } else if (policy == Placement::Bind) {
+        if (node >= nodeCount()) {
+          return false;
+        }
+        mode = kMpolBind;
+        mask[node / bits] |= 1ul << (node % bits);
+      }
+      // maxnode はビット数 + 1 を渡す (カーネルは maxnode - 1 ビットを読む)
+      long r = syscall(SYS_mbind, first, last - first, mode, (mode == kMpolDefault) ? nullptr : mask, kMaxNodes + 1,
+        kMpolMfMove);
+      if (r != 0) {
+        return false;
+      }
+      if (mode != kMpolDefault) {
+        placedAny().store(true, std::memory_order_relaxed);
+      }
+      return true;
+#else
+      (void)p;
+      (void)bytes;
+      (void)policy;
+      (void)node;
+      return false;
+#endif
+    }
+
+    void place(void *p, std::size_t bytes) {
+      Placement policy = placement();
+      if (policy != Placement::FirstTouch) {
+        place(p, bytes, policy, placementNode());
+      }
+    }
+
+    void reset(void *p, std::size_t bytes) {
+#ifdef MYWHEELS_LINUX
+      std::uintptr_t first, last;
+      if (!placedAny().load(std::memory_order_relaxed) || !pageRange(p, bytes, first, last)) {
+        return;
+      }
+      // 解放する領域なのでページは移動しない
+      syscall(SYS_mbind, first, last - first, kMpolDefault, nullptr, kMaxNodes + 1, 0u);
+#else
+      (void)p;
+      (void)bytes;
+#endif
+    }
+
+    bool pinCurrentThread(int cpu) {
+#ifdef MYWHEELS_LINUX
+      if (cpu < 0 || cpu >= CPU_SETSIZE) {
+        return false;
+      }
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      CPU_SET(cpu, &set);
+      return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+      (void)cpu;
+      return false;
+#endif
+    }
+
+    int affinityCpu(Affinity affinity, std::size_t i) {
+      static const std::vector<int> compact = cpuOrder(Affinity::Compact);
+      static const std::vector<int> spread = cpuOrder(Affinity::Spread);
+      const std::vector<int> &order = (affinity == Affinity::Compact) ? compact : spread;
+      if (affinity == Affinity::None || order.empty()) {
+        return -1;
+      }
+      return order[i % order.size()];
+    }
+
+    Affinity defaultAffinity() {
+      static const Affinity affinity = []() {
+        const char *env = std::getenv("MYWHEELS_AFFINITY");
+        if (env == nullptr || *env == '\0' || std::strcmp(env, "none") == 0) {
+          return Affinity::None;
+        }
+        if (std::strcmp(env, "compact") == 0) {
+          return Affinity::Compact;
+        }
+        if (std::strcmp(env, "spread") == 0) {
+          return Affinity::Spread;
+        }
+        std::cerr << "mywheels: unknown MYWHEELS_AFFINITY=" << env << ", using none\n";
+        return Affinity::None;
+      }();
+      return affinity;
+    }
+  } // namespace numa
+} // namespace mywheels
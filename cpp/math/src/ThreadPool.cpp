@@ -0,0 +1,160 @@
+#include "math/ThreadPool.hpp"
+#include <algorithm>
+#include <cstdlib>
+
+namespace mywheels {
+  namespace {
+    thread_local bool t_inWorker = false;
+
+    std::size_t defaultThreadCount() {
+      const char *env = std::getenv("MYWHEELS_NUM_THREADS");
+      if (env != nullptr) {
+        long n = std::strtol(env, nullptr, 10);
+        if (n >= 1) {
+          return static_cast<std::size_t>(n);
+        }
+      }
+      return std::max<std::size_t>(1, std::thread::hardware_concurrency());
+    }
+  } // namespace
+
+  ThreadPool::ThreadPool(std::size_t threads, numa::Affinity affinity) : m_affinity(affinity) {
+    threads = std::max<std::size_t>(1, threads);
+    for (std::size_t i = 0; i < threads; i++) {
+      m_queues.push_back(std::make_unique<Queue>());
+    }
+    // キュー 0 はプール外から呼び出したスレッドが使う
+    for (std::size_t i = 1; i < threads; i++) {
+      m_workers.emplace_back([this, i]() {
+        if (m_affinity != numa::Affinity::None) {
+          numa::pinCurrentThread(numa::affinityCpu(m_affinity, i));
+        }
+        workerLoop(i);
+      });
+    }
+  }
+
+  ThreadPool::~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(m_sleepMutex);
+      m_stop = true;
+    }
+    m_wake.notify_all();
+    for (auto &worker : m_workers) {
+      worker.join();
+    }
+  }
+
+  bool ThreadPool::inWorker() {
+    return t_inWorker;
+  }
+
+  ThreadPool &ThreadPool::global() {
+    static ThreadPool pool(defaultThreadCount(), numa::defaultAffinity());
+    return pool;
+  }
+
+  bool ThreadPool::tryPop(std::size_t index, Task &task) {
+    Queue &queue = *m_queues[index];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty()) {
+      return false;
+    }
+    task = queue.tasks.front();
+    queue.tasks.pop_front();
+    m_queued.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+  }
+
+  bool ThreadPool::trySteal(std::size_t thief, Task &task) {
+    std::size_t n = m_queues.size();
+    for (std::size_t k = 1; k < n; k++) {
+      Queue &queue = *m_queues[(thief + k) % n];
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      if (queue.tasks.empty()) {
+        continue;
+      }
+      task = queue.tasks.back();
+      queue.tasks.pop_back();
+      m_queued.fetch_sub(1, std::memory_order_relaxed);
+      return true;
+    }
+    return false;
+  }
+
+  void ThreadPool::run(const Task &task) {
+    Job *job = task.job;
+    try {
+      job->invoke(job->context, task.first, task.last);
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(job->errorMutex);
+      if (!job->error) {
+        job->error = std::current_exception();
+      }
+    }
+    if (job->pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      std::lock_guard<std::mutex> lock(m_sleepMutex);
+      m_done.notify_all();
+    }
+  }
+
+  void ThreadPool::workerLoop(std::size_t index) {
+    t_inWorker = true;
+    while (true) {
+      Task task;
+      if (tryPop(index, task) || trySteal(index, task)) {
+        run(task);
+        continue;
+      }
+      std::unique_lock<std::mutex> lock(m_sleepMutex);
+      m_wake.wait(lock, [this]() {
+        return m_stop || m_queued.load(std::memory_order_relaxed) > 0;
+      });
+      if (m_stop && m_queued.load(std::memory_order_relaxed) == 0) {
+        return;
+      }
+    }
+  }
+
+  void ThreadPool::submit(Job &job, std::size_t first, std::size_t last, std::size_t grain) {
+    std::size_t chunks = (last - first + grain - 1) / grain;
+    std::size_t n = m_queues.size();
+    job.pending.store(chunks, std::memory_order_relaxed);
+    m_queued.fetch_add(chunks, std::memory_order_relaxed);
+
+    // 連続したチャンクを同じキューに積み，盗まれない限り同じスレッドが隣接する領域を処理する
+    for (std::size_t q = 0; q < n; q++) {
+      std::size_t c0 = chunks * q / n;
+      std::size_t c1 = chunks * (q + 1) / n;
+      if (c0 == c1) {
+        continue;
+      }
+      Queue &queue = *m_queues[q];
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      for (std::size_t c = c0; c < c1; c++) {
+        queue.tasks.push_back({&job, first + c * grain, std::min(last, first + (c + 1) * grain)});
+      }
+    }
+    {
+      std::lock_guard<std::mutex> lock(m_sleepMutex);
+    }
+    m_wake.notify_all();
+
+    // 完了を待つ間も呼び出し元のスレッドでタスクを処理する
+    while (job.pending.load(std::memory_order_acquire) > 0) {
+      Task task;
+      if (tryPop(0, task) || trySteal(0, task)) {
+        run(task);
+        continue;
+      }
+      std::unique_lock<std::mutex> lock(m_sleepMutex);
+      m_done.wait(lock, [&job]() {
+        return job.pending.load(std::memory_order_acquire) == 0;
+      });
+    }
+
+    if (job.error) {
+      std::rethrow_exception(job.error);
+    }
+  }
+} // namespace mywheels
@@ -0,0 +1,70 @@
+// 領域を共有する Buffer を別々のスレッドから同時に書き換えても，互いの値が混ざらないことを確かめる
+#include <cstdio>
+#include <thread>
+#include <vector>
+#include "math/Buffer.hpp"
+
+using namespace mywheels;
+
+namespace {
+  constexpr std::size_t kThreads = 4;
+  constexpr std::size_t kSize = 1 << 12;
+  constexpr int kRounds = 200;
+
+  bool filledWith(const Buffer<int> &b, int val) {
+    for (std::size_t i = 0; i < b.size(); i++) {
+      if (b[i] != val) {
+        return false;
+      }
+    }
+    return true;
+  }
+} // namespace
+
+int main() {
+  std::vector<int> failures(kThreads, 0);
+  for (int round = 0; round < kRounds; round++) {
+    // 元の Buffer を先に捨てるので，最後に detach するスレッドは複製せずに領域を引き取る
+    std::vector<Buffer<int>> copies;
+    {
+      Buffer<int> source(kSize);
+      std::fill(source.begin(), source.end(), -1);
+      copies.assign(kThreads, source);
+    }
+    // 共有元を const のまま複数のスレッドからコピーし，コピーを書き換える
+    const Buffer<int> common = copies[0];
+    std::vector<std::thread> threads;
+    for (std::size_t t = 0; t < kThreads; t++) {
+      threads.emplace_back([&, t]() {
+        Buffer<int> &mine = copies[t];
+        Buffer<int> local = common;
+        if (!filledWith(mine, -1) || !filledWith(local, -1)) {
+          failures[t]++;
+        }
+        std::fill(mine.begin(), mine.end(), int(t));
+        std::fill(local.begin(), local.end(), int(t + kThreads));
+        if (!filledWith(mine, int(t)) || !filledWith(local, int(t + kThreads)) || !filledWith(common, -1)) {
+          failures[t]++;
+        }
+      });
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+    for (std::size_t t = 0; t < kThreads; t++) {
+      if (!filledWith(copies[t], int(t))) {
+        failures[t]++;
+      }
+    }
+  }
+  int total = 0;
+  for (std::size_t t = 0; t < kThreads; t++) {
+    total += failures[t];
+  }
+  if (total != 0) {
+    std::printf("FAILED: %d mismatches\n", total);
+    return 1;
+  }
+  std::printf("ok\n");
+  return 0;
+}
@@ -0,0 +1,88 @@
+// 同じ格納領域を別の並びで参照する右辺との複合代入が，変更前の値を読むことを確かめる
+#include <cstdio>
+#include "math/Tensor.hpp"
+
+using namespace mywheels;
+
+namespace {
+  int g_failures = 0;
+
+  void check(bool ok, const char *what, std::size_t n, Execution policy) {
+    if (!ok) {
+      std::printf("FAILED: %s (n = %zu, %s)\n", what, n, policy == Execution::Parallel ? "parallel" : "sequential");
+      g_failures++;
+    }
+  }
+
+  Tensor<double> iota(std::size_t n) {
+    Tensor<double> ret(Tensor<double>::Shape{n, n});
+    for (std::size_t i = 0; i < n; i++) {
+      for (std::size_t j = 0; j < n; j++) {
+        ret(i, j) = double(i * n + j);
+      }
+    }
+    return ret;
+  }
+
+  void run(std::size_t n, Execution policy) {
+    // s += s^T
+    {
+      Tensor<double> s = iota(n);
+      s.add(s.transpose(0, 1), policy);
+      bool ok = true;
+      for (std::size_t i = 0; i < n && ok; i++) {
+        for (std::size_t j = 0; j < n && ok; j++) {
+          ok = s(i, j) == double(i * n + j) + double(j * n + i);
+        }
+      }
+      check(ok, "s += s.transpose(0, 1)", n, policy);
+    }
+    // s = s^T
+    {
+      Tensor<double> s = iota(n);
+      s.assign(s.transpose(0, 1), policy);
+      bool ok = true;
+      for (std::size_t i = 0; i < n && ok; i++) {
+        for (std::size_t j = 0; j < n && ok; j++) {
+          ok = s(i, j) == double(j * n + i);
+        }
+      }
+      check(ok, "s.assign(s.transpose(0, 1))", n, policy);
+    }
+    // 先頭行を expand して各行から引く
+    {
+      Tensor<double> s = iota(n);
+      s.sub(s.select(0, 0).unsqueeze(0).expand(s.shape()), policy);
+      bool ok = true;
+      for (std::size_t i = 0; i < n && ok; i++) {
+        for (std::size_t j = 0; j < n && ok; j++) {
+          ok = s(i, j) == double(i * n);
+        }
+      }
+      check(ok, "s -= s.select(0, 0).expand(...)", n, policy);
+    }
+    // 同じ並びなら複製せずにそのまま計算できる
+    {
+      Tensor<double> s = iota(n);
+      s.mul(s, policy);
+      bool ok = true;
+      for (std::size_t i = 0; i < n && ok; i++) {
+        for (std::size_t j = 0; j < n && ok; j++) {
+          ok = s(i, j) == double(i * n + j) * double(i * n + j);
+        }
+      }
+      check(ok, "s *= s", n, policy);
+    }
+  }
+} // namespace
+
+int main() {
+  for (std::size_t n : {4, 600}) {
+    run(n, Execution::Sequential);
+    run(n, Execution::Parallel);
+  }
+  if (g_failures == 0) {
+    std::printf("ok\n");
+  }
+  return g_failures == 0 ? 0 : 1;
+}